@@ -85,6 +85,9 @@
 #include "mongo/util/assert_util.h"
 #include "mongo/util/log.h"
 
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
 //#include "boost/date_time/posix_time/posix_time.hpp"
 
 namespace mongo {
@@ -103,9 +106,9 @@ namespace mongo {
           _descriptorCache( NamespaceDetails::NIndexesMax ),
           _accessMethodCache( NamespaceDetails::NIndexesMax ),
           _forcedBtreeAccessMethodCache( NamespaceDetails::NIndexesMax ) {
-        indexMaskMap = std::vector< idx_mask_map_vector >( numIndexesTotal() );
-        indexStatusMap = std::vector< idx_status_map_vector >( numIndexesTotal() );
-        queueMap = std::vector< queue_map >( numIndexesTotal() );
+        indexDeltas = idx_delta_map_vector( numIndexesTotal() );
+        numIndexDeltas = 0;
+        numRemovedIndexDeltas = 0;
     }
 
     IndexCatalog::~IndexCatalog() {
@@ -170,59 +173,153 @@ namespace mongo {
             
     void IndexCatalog::initializeIndexMaskMap()
     {
-        // index mask map
-        idx_mask_map_vector indexMaskMapVector;
-        // index status map
-        idx_status_map_vector indexStatusMapVector;
-        idx_status indexStatus (0x0);
+        // entries of all indexes start as unaltered, i.e., without deltas
+        clearIndexMaskMap();
+        indexDeltas.resize( numIndexesTotal() );
+        
+        log() << "Index Deltas initialized for " << numIndexesTotal() << " indexes" << endl;
+    }
+    
+    void IndexCatalog::clearIndexMaskMap()
+    {
+        for ( int i = 0; i < (int)indexDeltas.size(); i++ )
+            indexDeltas[i].clear();
+        numIndexDeltas = 0;
+        numRemovedIndexDeltas = 0;
+    }
+    
+    IDX_MASK_STATUS IndexCatalog::checkIndexStatus(int &a, ID &id, int &idx_number,
+                                                   int scanWord, uint64_t &scanMask,
+                                                   const BSONObj& key)
+    {
+        // records without a status mask were inserted after the scan started
+        const st_mask_map_vector& statusMaskMapVector = _collection->statusMaskPlanes[scanWord];
+        if ( a >= (int)statusMaskMapVector.size() || id >= statusMaskMapVector[a].size() )
+            return SKIP;
+        
+        if ( numIndexDeltas == 0 )
+            return UNALTERED;
+        
+        indexMaskReadLock imr_lock(_collection->IMLock);
+        
+        if ( idx_number >= (int)indexDeltas.size() )
+            return UNALTERED;
+        
+        const idx_delta_map& deltas = indexDeltas[idx_number];
+        std::pair<idx_delta_map::const_iterator, idx_delta_map::const_iterator> range =
+            deltas.equal_range( deltaKey( a, id ) );
+        
+        // an entry left in the index by a record that moved away has a delta
+        // of its own; the other entries at the slot are the record's
+        const idx_delta* delta = NULL;
+        for ( idx_delta_map::const_iterator it = range.first; it != range.second; ++it ) {
+            if ( !it->second.removed ) {
+                if ( delta == NULL )
+                    delta = &it->second;
+            }
+            else if ( !key.isEmpty() && it->second.key.woCompare( key ) == 0 ) {
+                delta = &it->second;
+                break;
+            }
+        }
+        if ( delta == NULL )
+            return UNALTERED;
+        
+        uint64_t mask = ( delta->mask.words[scanWord] & scanMask );
+        bool removed = delta->removed;
+        
+        if ( ( mask == 0x0 ) && !removed )
+            return UNALTERED;
+        else if ( ( mask == 0x0 ) && removed )
+            return REMOVED;
+        else if ( ( mask != 0x0 ) && !removed )
+            return INSERTED;
+        else // ( ( mask != 0x0 ) && removed )
+            return SKIP;
+    }
+    
+    bool IndexCatalog::resetIndexDeltas(int n)
+    {
+        if ( numIndexDeltas == 0 )
+            return false;
         
-        for ( unsigned int i = 0; i < _collection->statusMaskMapVector.size(); i++ )
+        indexMaskWriteLock imw_lock(_collection->IMLock);
+        
+        bool skipped = false;
+        for ( int i = 0; i < (int)indexDeltas.size(); i++ )
         {
-            indexMaskMapVector.push_back( idx_mask_map( ) );
-            indexStatusMapVector.push_back( idx_status_map( ) );
-            for ( unsigned int j = 0; j < _collection->statusMaskMapVector[i].size(); j++ )
-            {                    
-                indexMaskMapVector[i].push_back( _collection->statusMaskMapVector[i][j] );
-                indexStatusMapVector[i].push_back( indexStatus );
-            } 
+            idx_delta_map& deltas = indexDeltas[i];
+            idx_delta_map::iterator it = deltas.begin();
+            while ( it != deltas.end() )
+            {
+                idx_delta& delta = it->second;
+                if ( delta.removed )
+                {
+                    // the entry stays in the index (see unindexRecord()),
+                    // so later scans on bit n must skip it; once every
+                    // scan skips it, a writer can take it out
+                    delta.mask.set( n );
+                    skipped = skipped || delta.mask.all();
+                    it++;
+                }
+                else
+                {
+                    delta.mask.reset( n );
+                    if ( delta.mask.none() ) {
+                        it = deltas.erase( it );
+                        numIndexDeltas -= 1;
+                    }
+                    else
+                        it++;
+                }
+            }
         }
+        return skipped;
+    }
+    
+    void IndexCatalog::unindexSkippedEntries()
+    {
+        if ( numRemovedIndexDeltas == 0 )
+            return;
         
-        for ( int i = 0; i < numIndexesTotal(); i++ )
+        // entries left in the index that no scan reads anymore
+        std::vector< std::pair<int, idx_delta> > unindexed;
         {
-            indexMaskMap[i] = indexMaskMapVector;
-            indexStatusMap[i] = indexStatusMapVector;
-            queueMap[i] = queue_map();
+            indexMaskWriteLock imw_lock(_collection->IMLock);
             
-            for (int a = 0; a < (int)indexMaskMapVector.size(); a++)
+            for ( int i = 0; i < (int)indexDeltas.size(); i++ )
             {
-                indexMaskMap[i][a].reserve( indexMaskMap[i][a].size()*3 );
-                indexStatusMap[i][a].reserve( indexStatusMap[i][a].size()*3 );
+                idx_delta_map& deltas = indexDeltas[i];
+                idx_delta_map::iterator it = deltas.begin();
+                while ( it != deltas.end() )
+                {
+                    if ( it->second.removed && it->second.mask.all() ) {
+                        unindexed.push_back( std::make_pair( i, it->second ) );
+                        it = deltas.erase( it );
+                        numIndexDeltas -= 1;
+                        numRemovedIndexDeltas -= 1;
+                    }
+                    else
+                        it++;
+                }
             }
-            
-            log() << "Index Mask Map initialized for Index N. " << i << endl;
-            log() << "Index Mask Map Size: " << indexMaskMap[i].size() << endl;
         }
-
-        indexMaskMapVector.clear();
+        
+        for ( size_t j = 0; j < unindexed.size(); j++ )
+            _unindexRemovedEntry( unindexed[j].first, unindexed[j].second.key,
+                                  unindexed[j].second.loc );
     }
     
-    IDX_MASK_STATUS IndexCatalog::checkIndexStatus(int &a, ID &id, int &idx_number, uint64_t &scanMask)
+    bool IndexCatalog::hasIndexDeltas(int a, ID id) const
     {
-        if ( id >= indexMaskMap[idx_number][a].size() )
-            return SKIP;
-
-        uint64_t mask = ( (indexMaskMap[idx_number][a][id]) & scanMask );
-        idx_status mask_status = indexStatusMap[idx_number][a][id];
-        idx_status one (0x1);
+        if ( numIndexDeltas == 0 )
+            return false;
         
-        if ( ( mask == 0x0 ) && ( mask_status != one ) )
-            return UNALTERED;
-        else if ( ( mask == 0x0 ) && ( mask_status == one ) )
-            return REMOVED;
-        else if ( ( mask != 0x0 ) && ( mask_status != one ) )
-            return INSERTED;
-        else // ( ( mask != 0x0 ) && ( mask_status == one ) )
-            return SKIP;
+        uint64_t key = deltaKey( a, id );
+        for ( int i = 0; i < (int)indexDeltas.size(); i++ )
+            if ( indexDeltas[i].count( key ) > 0 )
+                return true;
+        return false;
     }
     
     Status IndexCatalog::unindexRecordChronos( int idxNo, const BSONObj& obj, const DiskLoc &loc, bool logIfError ) {
@@ -1122,60 +1219,82 @@ namespace mongo {
     }
 
 
+    void IndexCatalog::_unindexRemovedEntry( int idxNo, const BSONObj& key, const DiskLoc& loc ) {
+        if ( idxNo >= numIndexesTotal() )
+            return;
+        
+        // every access method of the catalog is btree based
+        IndexAccessMethod* iam = getIndex( getDescriptor( idxNo ) );
+        static_cast<BtreeBasedAccessMethod*>( iam )->removeOneKey( key, loc );
+    }
+
+
     void IndexCatalog::indexRecord( const BSONObj& obj, const DiskLoc &loc ) {
 
+        // with no index scan running and no removed entry the record could
+        // take back, the new entries need no delta: IMLock is not taken
+        const bool indexDeltasNeeded = _collection->statusMaskMapInit &&
+            !( _collection->localIndexActiveMask.all() && numRemovedIndexDeltas == 0 );
+
         for ( int i = 0; i < numIndexesTotal(); i++ ) {
             try {
                 Status s = _indexRecord( i, obj, loc );
                 uassert(s.location(), s.reason(), s.isOK() );
                 
-                if ( _collection->isUserCollection )
+                if ( indexDeltasNeeded )
                 {
-                    // inserting index mask
-                    //log() << "Inserting Index Mask" << endl;
+                    // inserting index mask: running index scans must not
+                    // read the new entry, the others see it as unaltered
+                    vls_mask indexMask = ~( _collection->localIndexActiveMask );
+                    uint64_t key = deltaKey( loc.a(), _collection->recordId(loc) );
+                    
+                    indexMaskWriteLock imw_lock(_collection->IMLock);
                     
-                    int a = loc.a();
-                    uint64_t indexActiveMask = _collection->localIndexActiveMask;
-                            
-                    tbb::atomic<uint64_t> init_atomic_mask;
-                    init_atomic_mask = 0x0;
-                    idx_status indexStatus (0x0);
+                    if ( i >= (int)indexDeltas.size() )
+                        indexDeltas.resize( i + 1 );
                     
-                    if ( i >= (int)indexMaskMap.size() )
-                    {
-                        indexMaskMap.push_back( idx_mask_map_vector() );
-                        indexStatusMap.push_back( idx_status_map_vector() );
-                        queueMap.push_back( queue_map() );
+                    idx_delta_map& deltas = indexDeltas[i];
+                    std::pair<idx_delta_map::iterator, idx_delta_map::iterator> range =
+                        deltas.equal_range( key );
+                    
+                    // removed deltas at the slot belong to entries of a record
+                    // that moved away, unless the new record has the same
+                    // entry, which is then its own again
+                    idx_delta_map::iterator own = deltas.end();
+                    BSONObjSet keys;
+                    bool keysLoaded = false;
+                    for ( idx_delta_map::iterator it = range.first; it != range.second; ) {
+                        if ( !it->second.removed ) {
+                            own = it++;
+                            continue;
+                        }
+                        if ( !keysLoaded ) {
+                            IndexAccessMethod* iam = getIndex( getDescriptor( i ) );
+                            static_cast<BtreeBasedAccessMethod*>( iam )->getKeys( obj, &keys );
+                            keysLoaded = true;
+                        }
+                        if ( keys.count( it->second.key ) ) {
+                            it = deltas.erase( it );
+                            numIndexDeltas -= 1;
+                            numRemovedIndexDeltas -= 1;
+                        }
+                        else
+                            it++;
                     }
                     
-                    if ( a <= (int)indexMaskMap[i].size() )
-                    {
-                        if ( a == (int)indexMaskMap[i].size() )
-                        {
-                            indexMaskMap[i].push_back( idx_mask_map( ) );
-                            indexStatusMap[i].push_back( idx_status_map( ) );
-                            
-                            indexMaskMap[i][a].reserve( 800000 );
-                            indexStatusMap[i][a].reserve( 800000 );
+                    if ( indexMask.none() ) {
+                        if ( own != deltas.end() ) {
+                            deltas.erase( own );
+                            numIndexDeltas -= 1;
                         }
-                        
-                        ID id = loc.id(_collection->ofsMap[a]);
-                        tbb::atomic<uint64_t> atomic_mask;
-                        atomic_mask = ~( indexActiveMask );
-                        
-                        idx_mask_map* _indexMaskMap = &indexMaskMap[i][a];
-                        idx_status_map* _indexStatusMap = &indexStatusMap[i][a];
-                        
-                        while (id >= _indexMaskMap->size()) {
-                            _indexMaskMap->push_back( init_atomic_mask );
-                            _indexStatusMap->push_back( indexStatus );
+                    }
+                    else {
+                        if ( own == deltas.end() ) {
+                            own = deltas.insert( std::make_pair( key, idx_delta() ) );
+                            numIndexDeltas += 1;
                         }
-                        
-                        _indexMaskMap->at(id) = atomic_mask;
-                        _indexStatusMap->at(id) = indexStatus;
+                        own->second.mask = indexMask;
                     }
-                    else
-                        log() << "Oops ..." << endl;
                 }
             }
             catch ( AssertionException& ae ) {
@@ -1200,43 +1319,87 @@ namespace mongo {
     void IndexCatalog::unindexRecord( const BSONObj& obj, const DiskLoc& loc, bool noWarn, uint64_t queueID ) {
         int numIndices = numIndexesTotal();
         
-        uint64_t indexActiveMask = _collection->localIndexActiveMask;
-        idx_status indexStatus (0x1);
-        int a = loc.a();
-        ID id = _collection->isUserCollection ? loc.id(_collection->ofsMap[a]) : 0;
+        if ( !_collection->statusMaskMapInit ) {
+            for (int i = 0; i < numIndices; i++) {
+                // If i >= d->nIndexes, it's a background index, and we DO NOT want to log anything.
+                bool logIfError = ( i < numIndexesTotal() ) ? !noWarn : false;
+                _unindexRecord( i, obj, loc, logIfError );
+            }
+            return;
+        }
+        
+        vls_mask indexActiveMask = _collection->localIndexActiveMask;
+        uint64_t key = deltaKey( loc.a(), _collection->recordId(loc) );
         
         for (int i = 0; i < numIndices; i++) {
             // If i >= d->nIndexes, it's a background index, and we DO NOT want to log anything.
             bool logIfError = ( i < numIndexesTotal() ) ? !noWarn : false;
             
-            if ( !_collection->isUserCollection )
-            {
-                //boost::posix_time::ptime t1(boost::posix_time::microsec_clock::local_time());
+            // removing index entry
+            //log() << "Removing Index Entry" << endl;
+            
+            if ( indexActiveMask.all() )
+                // no active index scans
                 _unindexRecord( i, obj, loc, logIfError );
-                //boost::posix_time::ptime t2(boost::posix_time::microsec_clock::local_time());
-                //boost::posix_time::time_duration dt = t2 - t1;
-                //log() << "Unindexing takes " << dt.total_nanoseconds() << endl;
-            }
             else
             {
-                // removing index entry
-                //log() << "Removing Index Entry" << endl;
+                // do not unindex now: running index scans see the entry as
+                // removed, the scans that start later skip it
+                indexMaskWriteLock imw_lock(_collection->IMLock);
                 
-                if ( indexActiveMask == 0xFFFFFFFFFFFFFFFF )
-                    // no active index scans
-                    _unindexRecord( i, obj, loc, logIfError );
-                else
-                {
-                    // do not unindex now
-                    queueMap[i][id] = queueID;
-                    ( &indexMaskMap[i][a] )->at(id) = ( ( &indexMaskMap[i][a] )->at(id) | indexActiveMask );
-                    ( &indexStatusMap[i][a] )->at(id) = indexStatus;
+                if ( i >= (int)indexDeltas.size() )
+                    indexDeltas.resize( i + 1 );
+                
+                idx_delta_map& deltas = indexDeltas[i];
+                std::pair<idx_delta_map::iterator, idx_delta_map::iterator> range =
+                    deltas.equal_range( key );
+                
+                // scans that saw the entries inserted must not read them either
+                vls_mask removedMask = indexActiveMask;
+                for ( idx_delta_map::iterator it = range.first; it != range.second; ) {
+                    if ( it->second.removed ) {
+                        it++;
+                        continue;
+                    }
+                    removedMask |= it->second.mask;
+                    it = deltas.erase( it );
+                    numIndexDeltas -= 1;
+                }
+                
+                // one delta per entry: a record written at the same offset
+                // later gets the slot back (see checkIndexStatus())
+                BSONObjSet keys;
+                IndexAccessMethod* iam = getIndex( getDescriptor( i ) );
+                static_cast<BtreeBasedAccessMethod*>( iam )->getKeys( obj, &keys );
+                for ( BSONObjSet::const_iterator k = keys.begin(); k != keys.end(); ++k ) {
+                    idx_delta delta;
+                    delta.mask = removedMask;
+                    delta.removed = true;
+                    delta.queueID = queueID;
+                    delta.key = k->getOwned();
+                    delta.loc = loc;
+                    deltas.insert( std::make_pair( key, delta ) );
+                    numIndexDeltas += 1;
+                    numRemovedIndexDeltas += 1;
                 }
             }
         }
 
     }
 
+    void IndexCatalog::unindexDeletedRecord( const BSONObj& obj, const DiskLoc& loc, bool noWarn ) {
+        int numIndices = numIndexesTotal();
+        
+        // running VLS index scans over the removed entries get the record
+        // in their scan sets (see BtreeAccessMethod::addRemovedKey()), and
+        // read the version preserved in the document set
+        for (int i = 0; i < numIndices; i++) {
+            // If i >= d->nIndexes, it's a background index, and we DO NOT want to log anything.
+            bool logIfError = ( i < numIndexesTotal() ) ? !noWarn : false;
+            _unindexRecord( i, obj, loc, logIfError );
+        }
+    }
+
     Status IndexCatalog::checkNoIndexConflicts( const BSONObj &obj ) {
         for ( int idxNo = 0; idxNo < numIndexesTotal(); idxNo++ ) {
 
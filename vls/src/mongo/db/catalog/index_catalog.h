@@ -59,10 +59,10 @@
 #pragma once
 
 #include <vector>
-#include <bitset>
 
 #include "mongo/db/diskloc.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/db/structure/vls_mask.h"
 
 #include <boost/unordered_map.hpp>
 #include "tbb/atomic.h"
@@ -85,33 +85,37 @@ namespace mongo {
     /* Identifies a Disk Loc (_a, ofs)*/
     typedef uint32_t ID;
     
-    /* Index Mask Map */
-    typedef std::vector< tbb::atomic<uint64_t> > idx_mask_map;
-    
-    /* Vector of Index Mask Map -- one per DiskLoc Volume */
-    typedef std::vector<idx_mask_map> idx_mask_map_vector;
-    
-    /* Map of Index Mask Map Vectors -- one per index */
-    typedef std::vector< idx_mask_map_vector > idx_mask_map_map;
-    
-    /* Index Status -- indicates the current status of the corresponding index entry
-       1 for deletion, and 0 otherwise */
-    typedef std::bitset<1> idx_status;
-    
-    /* Index Status Map */
-    typedef std::vector< idx_status > idx_status_map;
-    
-    /* Vector of Index Status Map -- one per DiskLoc Volume */
-    typedef std::vector< idx_status_map > idx_status_map_vector;
-    
-    /* Map of Index Status Map Vectors -- one per index */
-    typedef std::vector< idx_status_map_vector > idx_status_map_map;
+    /* Change of the index entries of a record (see IndexCatalog::indexDeltas)
+       made while VLS index scans were running. The mask has one bit per scan
+       and, with the removed flag, tells how each scan sees the entries:
+       
+           mask bit  removed
+           0         false    unaltered (same as no delta)
+           0         true     removed while scanning
+           1         false    inserted while scanning
+           1         true     removed before the scan started
+       
+       A delta that is not removed covers every entry of the record at its
+       slot. A removed delta covers one entry (key, loc) left in the index for
+       the scans that still read it; since a record written at the offset of
+       a deleted record gets its slot back, removed deltas are told apart
+       from the entries of the new record by their key. */
+    struct idx_delta {
+        vls_mask mask;
+        bool removed;
+        uint64_t queueID; // document set key of the removed version
+        BSONObj key;      // removed: key of the entry left in the index
+        DiskLoc loc;      // removed: location of the entry left in the index
+        
+        idx_delta() : mask( 0x0 ), removed( false ), queueID( 0 ) { }
+    };
     
-    /* Mapping between record ID and queue record ID for the index */
-    typedef boost::unordered_map< ID, uint64_t > queue_map;
+    /* Index Delta Map -- sparse, keyed by record slot (see deltaKey()); a slot
+       has at most one delta that is not removed, and one per removed entry */
+    typedef boost::unordered_multimap< uint64_t, idx_delta > idx_delta_map;
     
-    /* Vector of queue maps, one per index */
-    typedef std::vector< queue_map > queue_map_vector;
+    /* Vector of Index Delta Maps -- one per index */
+    typedef std::vector< idx_delta_map > idx_delta_map_vector;
     
     enum IDX_MASK_STATUS {
         REMOVED,  // entry removed while scanning
@@ -133,21 +137,56 @@ namespace mongo {
         
         // ---- VLS ---- //
         
-        /* Map of Index Mask Map Vectors */
-        idx_mask_map_map indexMaskMap;
+        /* Index deltas, one sparse map per index. Index entries have no
+           mask of their own: an entry without a delta reads as the status
+           mask of its record (see Collection::statusMaskPlanes), which all
+           indexes share, and only records whose entries change while index
+           scans run get a delta. Deltas are written under the database
+           write lock, and readers that may run without it use IMLock. */
+        idx_delta_map_vector indexDeltas;
         
-        /* Map of Index Status Map Vectors */
-        idx_status_map_map indexStatusMap;
+        /* Number of deltas over all indexes; lets index scans skip the
+           lookup (and IMLock) while no entry has changed */
+        tbb::atomic<size_t> numIndexDeltas;
         
-        /* Vector of Queue Maps */
-        queue_map_vector queueMap;
+        /* Number of removed deltas over all indexes; index scans only pass
+           the key of an entry to checkIndexStatus() while there are some */
+        tbb::atomic<size_t> numRemovedIndexDeltas;
         
-        /* Method to check the status of the index */
-        IDX_MASK_STATUS checkIndexStatus(int &a, ID &id, int &idx_number, uint64_t &scanMask);
+        /* Key of a record slot in an Index Delta Map */
+        static uint64_t deltaKey(int a, ID id) {
+            return ( (uint64_t)a << 32 ) | id;
+        }
+        
+        /* Method to check the status of the index entry (key, (a, id));
+           key may be empty while numRemovedIndexDeltas is 0 */
+        IDX_MASK_STATUS checkIndexStatus(int &a, ID &id, int &idx_number,
+                                         int scanWord, uint64_t &scanMask,
+                                         const BSONObj& key);
+        
+        /* Called once the scan holding bit n is done with the index:
+           its bit is dropped from the deltas of inserted entries and set in
+           the ones of removed entries, and deltas left empty are freed.
+           Returns true if some removed entries are now skipped by every
+           scan, for unindexSkippedEntries(). Requires a read lock on the
+           database. */
+        bool resetIndexDeltas(int n);
+        
+        /* Takes the removed entries that every scan skips out of the index,
+           with their deltas. Requires a write lock on the database. */
+        void unindexSkippedEntries();
+        
+        /* Whether an index has a delta for the record slot (a, id), which
+           keeps the slot from going to another record. Requires a write
+           lock on the database. */
+        bool hasIndexDeltas(int a, ID id) const;
         
         /* Initialize all index masks */
         void initializeIndexMaskMap();
         
+        /* Release all index masks */
+        void clearIndexMaskMap();
+        
         // ---- VLS ---- //
 
         bool ok() const;
@@ -273,6 +312,9 @@ namespace mongo {
 
         void unindexRecord( const BSONObj& obj, const DiskLoc& loc, bool noWarn, uint64_t queueID = 0 );
         
+        // unlike unindexRecord, never keeps the entries for running VLS index scans
+        void unindexDeletedRecord( const BSONObj& obj, const DiskLoc& loc, bool noWarn );
+        
         Status unindexRecordChronos( int idxNo, const BSONObj& obj, const DiskLoc &loc, bool logIfError );
 
         /**
@@ -330,6 +372,9 @@ namespace mongo {
         Status _indexRecord( int idxNo, const BSONObj& obj, const DiskLoc &loc );
         Status _unindexRecord( int idxNo, const BSONObj& obj, const DiskLoc &loc, bool logIfError );
 
+        // VLS: removes the entry (key, loc) left in index idxNo (see unindexSkippedEntries())
+        void _unindexRemovedEntry( int idxNo, const BSONObj& key, const DiskLoc& loc );
+
         /**
          * this does no sanity checks
          */
@@ -41,6 +41,7 @@
 #include "mongo/db/kill_current_op.h"
 #include "mongo/db/pdfile.h"
 #include "mongo/db/query/get_runner.h"
+#include "mongo/db/query/lite_parsed_query.h"
 #include "mongo/db/query/query_planner_common.h"
 #include "mongo/db/query/type_explain.h"
 #include "mongo/util/timer.h"
@@ -64,7 +65,8 @@ namespace mongo {
         }
 
         virtual void help( stringstream &help ) const {
-            help << "{ distinct : 'collection name' , key : 'a.b' , query : {} }";
+            help << "{ distinct : 'collection name' , key : 'a.b' , query : {} }\n"
+                 << "snapshot : 'vls' reads the values as of when the scan started";
         }
 
         bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result,
@@ -78,6 +80,12 @@ namespace mongo {
 
             BSONObj query = getQuery( cmdObj );
 
+            StatusWith<bool> vlsSnapshot = LiteParsedQuery::parseVLSSnapshotCommand( cmdObj );
+            if ( !vlsSnapshot.isOK() ) {
+                errmsg = vlsSnapshot.getStatus().reason();
+                return false;
+            }
+
             int bufSize = BSONObjMaxUserSize - 4096;
             BufBuilder bb( bufSize );
             char * start = bb.buf();
@@ -106,8 +114,13 @@ namespace mongo {
                 return 0;
             }
 
+            // Updates only need to preserve the key and the fields of the query
+            size_t dot = key.find('.');
+            BSONObj vlsFields = BSON("_id" << true
+                                     << (dot == string::npos ? key : key.substr(0, dot)) << true);
+
             Runner* rawRunner;
-            if (!getRunner(cq, &rawRunner).isOK()) {
+            if (!getRunner(cq, &rawRunner, 0, vlsSnapshot.getValue(), vlsFields).isOK()) {
                 uasserted(17216, "Can't get runner for query " + query.toString());
                 return 0;
             }
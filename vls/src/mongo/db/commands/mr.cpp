@@ -44,6 +44,7 @@
 #include "mongo/db/kill_current_op.h"
 #include "mongo/db/matcher.h"
 #include "mongo/db/query/get_runner.h"
+#include "mongo/db/query/lite_parsed_query.h"
 #include "mongo/db/query/query_planner.h"
 #include "mongo/db/repl/is_master.h"
 #include "mongo/db/repl/oplog.h"
@@ -312,6 +313,10 @@ namespace mongo {
                     limit = cmdObj["limit"].numberLong();
                 else
                     limit = 0;
+
+                StatusWith<bool> snapshot = LiteParsedQuery::parseVLSSnapshotCommand( cmdObj );
+                uassertStatusOK( snapshot.getStatus() );
+                vlsSnapshot = snapshot.getValue();
             }
         }
 
@@ -1286,7 +1291,7 @@ namespace mongo {
                         }
 
                         Runner* rawRunner;
-                        if (!getRunner(cq, &rawRunner).isOK()) {
+                        if (!getRunner(cq, &rawRunner, 0, config.vlsSnapshot).isOK()) {
                             uasserted(17239, "Can't get runner for query " + config.filter.toString());
                             return 0;
                         }
@@ -185,6 +185,9 @@ namespace mongo {
             BSONObj sort;
             long long limit;
 
+            // {snapshot: "vls"}: the map phase reads through a VLS snapshot
+            bool vlsSnapshot;
+
             // functions
 
             scoped_ptr<Mapper> mapper;
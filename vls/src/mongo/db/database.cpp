@@ -133,7 +133,8 @@ namespace mongo {
     }
 
     Database::Database(const char *nm, bool& newDb, const string& path )
-        : _name(nm), _path(path),
+        : activeMask( vlsMaskWords() * 64 ),
+          _name(nm), _path(path),
           _namespaceIndex( _path, _name ),
           _extentManager(_name, _path, 0, storageGlobalParams.directoryperdb),
           _profileName(_name + ".system.profile"),
@@ -176,15 +177,6 @@ namespace mongo {
         }
         
         log() << "Init for database " << nm << endl;
-        
-        // initializing active mask
-        activeMask = 0xFFFFFFFFFFFFFFFF; // vector of 1's
-        indexActiveMask = 0xFFFFFFFFFFFFFFFF; // vector of 1's
-        
-        // maximum number of scans
-        maxNumberScans = 64;
-        
-        activeMaskFull = false;
     }
 
     void Database::checkDuplicateUncasedNames(bool inholderlock) const {
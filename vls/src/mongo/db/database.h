@@ -65,6 +65,7 @@
 #include "mongo/db/storage/extent_manager.h"
 #include "mongo/db/storage/record.h"
 #include "mongo/db/storage_options.h"
+#include "mongo/db/structure/scan_bit_allocator.h"
 #include "mongo/util/string_map.h"
 #include "mongo/db/jsobj.h"
 
@@ -74,15 +75,6 @@
 
 namespace mongo {
 
-    // ---- VLS ---- //
-
-    /* Active Mask locks */
-    typedef boost::shared_mutex activeMaskLock;
-    typedef boost::unique_lock< activeMaskLock > activeMaskWriteLock;
-    typedef boost::shared_lock< activeMaskLock > activeMaskReadLock;
-    
-    // ---- VLS ---- //
-
     class Collection;
     class Extent;
     class DataFile;
@@ -114,25 +106,10 @@ namespace mongo {
         
         /* activeMask controls which vector of bits are active in the database;
            activeMask is a global mask, different from stableMask,
-           which is unique for each collection */
-        uint64_t activeMask;
-        
-        /* similar to activeMask, but exclusively for index scans */
-        uint64_t indexActiveMask;
-        
-        /* Active Mask lock */
-        activeMaskLock AMLock;
-        
-        /* Boolean value that indicates if there is an available bit
-           for a new scan. */
-        bool activeMaskFull;
-        
-        /* Active Mask Condition Variable;
-           used for awaiting scans */
-        boost::condition_variable_any activeMaskCondition;
-        
-        /* Maximum number of scans that can execute concurrently */
-        int maxNumberScans;
+           which is unique for each collection. Its width is the maximum
+           number of scans that can execute concurrently ('vlsMaskBits');
+           further scans wait for a bit. */
+        ScanBitAllocator activeMask;
         
         // ---- VLS ---- //
 
@@ -659,32 +659,6 @@ namespace mongo {
 #endif // __linux__
     }
     
-    void initializeStatusMaskMap() {
-        
-        std::vector<std::string> dbNames;
-        getDatabaseNames(dbNames);
-        
-        std::list<std::string> collNames;
-        for (std::vector<std::string>::const_iterator dbName = dbNames.begin();
-             dbName < dbNames.end(); dbName++) {
-            Client::ReadContext ctx(*dbName);
-            Database* db = cc().database();
-            db->namespaceIndex().getNamespaces(collNames, true);
-        }
-        
-        for (std::list<std::string>::const_iterator it = collNames.begin();
-                it != collNames.end(); ++it) {
-
-            Client::WriteContext ctx(*it);
-            Collection* collection = ctx.ctx().db()->getCollection( *it );
-            if ( collection == NULL )
-                continue;
-
-            /* Initializing status mask of all existing records */
-            collection->initializeStatusMaskMap();
-        }
-    }
-
     void _initAndListen(int listenPort ) {
 
         Client::initThread("initandlisten");
@@ -800,8 +774,6 @@ namespace mongo {
         }
 
         getDeleter()->startWorkers();
-        
-        initializeStatusMaskMap();
 
         // Starts a background thread that rebuilds all incomplete indices. 
         indexRebuilder.go(); 
@@ -1063,6 +1063,7 @@ namespace mongo {
             help << 
                 "Sets collection options.\n"
                 "Example: { collMod: 'foo', usePowerOf2Sizes:true }\n"
+                "Example: { collMod: 'foo', vls:true }\n"
                 "Example: { collMod: 'foo', index: {keyPattern: {a: 1}, expireAfterSeconds: 600} }";
         }
         virtual void addRequiredPrivileges(const std::string& dbname,
@@ -1106,6 +1107,29 @@ namespace mongo {
                         result.appendBool( "usePowerOf2Sizes_new", newPowerOf2 );
                     }
                 }
+                else if ( str::equals( "vls", e.fieldName() ) ) {
+                    // VLS may also be on through the vlsNamespaces server parameter
+                    bool oldVLS = coll->vlsEnabled;
+                    bool newVLS = e.trueValue();
+
+                    // allocates or releases the VLS structures of the collection
+                    Status status = coll->setVLSEnabled( newVLS );
+                    if ( !status.isOK() ) {
+                        errmsg = status.reason();
+                        ok = false;
+                        continue;
+                    }
+
+                    bool flagChanged = newVLS ? nsd->setUserFlag( NamespaceDetails::Flag_VLS ) :
+                                                nsd->clearUserFlag( NamespaceDetails::Flag_VLS );
+                    if ( flagChanged )
+                        nsd->syncUserFlags( ns ); // must keep system.namespaces up-to-date
+
+                    if ( oldVLS != newVLS ) {
+                        result.appendBool( "vls_old", oldVLS );
+                        result.appendBool( "vls_new", newVLS );
+                    }
+                }
                 else if ( str::equals( "index", e.fieldName() ) ) {
                     BSONObj indexObj = e.Obj();
                     BSONObj keyPattern = indexObj.getObjectField( "keyPattern" );
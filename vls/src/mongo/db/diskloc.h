@@ -105,15 +105,6 @@ namespace mongo {
             _a=l._a;
             ofs=l.ofs;
         }
-        
-        /*uint64_t id() const {
-            return ((uint64_t)_a) << 32 | ofs;
-        }*/
-        
-        uint32_t id(int init_ofs) const {
-            return ceil((ofs-init_ofs)/256);
-            //return ceil(abs(ofs-init_ofs)/44);
-        }
 
         bool questionable() const {
             return ofs < -1 ||
@@ -138,6 +129,11 @@ namespace mongo {
             ofs = 0;
         }
         bool isChronosInvalid() const { return _a == -3; }
+        
+        void setChronosExec() {
+            _a = -4;
+            ofs = 0;
+        }
         bool chronosExec() const { return _a == -4; }
 
         string toString() const {
@@ -60,6 +60,7 @@
 #include "mongo/db/exec/filter.h"
 #include "mongo/db/exec/working_set.h"
 #include "mongo/db/structure/collection_iterator.h"
+#include "mongo/util/timer.h"
 
 #include "mongo/db/client.h" // XXX-ERH
 #include "mongo/db/pdfile.h" // XXX-ERH/ACM
@@ -69,69 +70,75 @@ namespace mongo {
     CollectionScan::CollectionScan(const CollectionScanParams& params,
                                    WorkingSet* workingSet,
                                    const MatchExpression* filter,
-                                   bool use_chronos)
+                                   bool use_chronos,
+                                   const BSONObj& vlsFields)
         : _workingSet(workingSet),
           _filter(filter),
           _params(params),
           _nsDropped(false),
           _use_chronos(use_chronos),
+          scanBit( 0 ),
           scanMask( 0x0 ),
-          documentSetKeysInit( false ),
-          sharedQueueScanDone( false ) {
+          scanEpoch( 0 ),
+          documentSetStart( 0 ),
+          documentSetCursorInit( false ),
+          sharedQueueScanDone( false ),
+          scanBitHeld( false ) {
         
         // --------- VLS --------- //
         
-        documentSetKeysIndex = -1;
-        documentSetKeysSize = 0;
-        
         // getting database and collection
         database = cc().database();
         collection = database->getCollection( _params.ns );
         
         if (( collection != NULL ) && ( database != NULL )) {
-            if ( _use_chronos && collection->isUserCollection ) {
+            if ( _use_chronos && collection->vlsEnabled ) {
                 
-                // locking active mask
-                activeMaskWriteLock w_lock(database->AMLock);
+                // the status masks and the document set are only kept once
+                // a VLS scan runs over the collection
+                collection->initializeStatusMaskMap();
+                collection->getDocumentSet();
                 
-                // waiting for an available bit
-                while (database->activeMaskFull) {
-                    log() << "Waiting..." << endl;
-                    database->activeMaskCondition.wait(w_lock);
+                // finding a bit for the scan; only waits if every bit is
+                // taken, without the lock, so the collection may be gone then
+                Timer t;
+                int n = Collection::acquireScanBit( _params.ns, &database, &collection );
+                _specificStats.bitWaitMillis = t.millis();
+                if ( n < 0 ) {
+                    _use_chronos = false;
+                    return;
                 }
+                scanBitHeld = true;
+                databaseId = database->activeMask.instanceId();
+                collectionId = collection->instanceId;
                 
-                //log() << "Bit is available!" << endl;
-                
-                uint64_t mask = 0x1;
+                //log() << "N: " << n << endl;
                 
-                // finding a bit for the scan
-                for (int n = 0; n < database->maxNumberScans; n++)
-                {
-                    if ( (database->activeMask & (mask << n)) != 0x0 )
-                    {
-                        //log() << "N: " << n << endl;
-                        //log() << "Mask : " << std::hex << (~(mask << n)) << endl;
-                        
-                        // assigning scan to bit n
-                        database->activeMask &= ~(mask << n);
-                        collection->localActiveMask &= ~(mask << n);
-                        scanMask = (mask << n);
-                        break;
-                    }
-                }
+                // assigning scan to bit n; the scan only reads and
+                // flips the word of the status masks that holds it
+                scanBit = n;
+                scanMask = vls_mask::bitOf( n );
                 
                 // getting stable mask for that particular scan
                 // this helps avoid reading the collection's stable mask
                 {
-                    stableMaskReadLock smr_lock(collection->SMLock);
-                    scanStableMask = collection->stableMask & scanMask;
+                    stableMaskWriteLock smw_lock(collection->SMLock);
+                    collection->localActiveMask.reset( n );
+                    scanStableMask = collection->stableMask.words[vls_mask::wordOf( n )] & scanMask;
+                    scanEpoch = collection->beginScanEpoch( n );
+                    
+                    // updates only preserve the fields the scan reads
+                    collection->setScanFields( n, vlsFields );
+                    
+                    // documents preserved from now on are the ones the scan may need
+                    documentSetStart = collection->getDocumentSet()->end();
+                    
+                    // joining the extents another scan is reading, if any
+                    if ( _params.direction == CollectionScanParams::FORWARD &&
+                         _params.start.isNull() && !_params.tailable )
+                        scanStartExtent = collection->sharedScanStart( n );
                 }
                 
-                // if OR(Active Mask) is 0, there is no bit available
-                // other scans should be aware of this
-                if ( database->activeMask == 0x0 )
-                    database->activeMaskFull = true;
-                
             } else {
                 _use_chronos = false;
             }
@@ -145,35 +152,35 @@ namespace mongo {
         
     }
     
+    CollectionScan::~CollectionScan() {
+        // a VLS scan that stops before the end (e.g., a losing plan
+        // candidate) still has to give its bit back; the cursor may be
+        // destroyed without a lock, or after the collection was dropped
+        if ( scanBitHeld )
+            Collection::abandonVLSScan( _params.ns, databaseId, collectionId,
+                                        scanBit, scanStableMask, true, -1 );
+    }
+    
     bool CollectionScan::chronosNextObj(DiskLoc &nextLoc, BSONObj &nextObj) {
         
         bool skip = false;
             
         // "materializing" the document set for this particular scan
-        // since this scan will not need new documents added to the set
-        if ( !documentSetKeysInit ) {
+        // since this scan will not need new documents added to the set:
+        // the current end of the log is the high-water mark of the scan
+        if ( !documentSetCursorInit ) {
+            
+            DocumentSet* documentSet = collection->getDocumentSet();
+            documentSetCursor = documentSet->cursor( documentSetStart, documentSet->end() );
+            documentSetCursorInit = true;
             
-            if ( collection->documentSetSize == 0 )
+            if ( !documentSetCursor.more() )
                 sharedQueueScanDone = true;
-            else
-            {
-                {
-                    // locking document set -- prevent concurrency with erase operation
-                    documentSetWriteLock dsw_lock(collection->DSLock);
-                    
-                    for( doc_set::const_iterator it = collection->documentSet.begin();
-                            it != collection->documentSet.end(); ++it )
-                        documentSetKeys.push_back(it->first);
-                    
-                    // experimental purpose
-                    /*struct timeval tp;
-                    gettimeofday(&tp, NULL);
-                    collection->debug_str << "Queue Size: " << collection->documentSet.size() << "/" << collection->worstQueueSize.fetch_and_add(0) << "/" << collection->noReclamationQueueSize.fetch_and_add(0) << "/" << tp.tv_sec * 1000000000 + tp.tv_usec * 1000 << endl;*/
-                }
-    
-                documentSetKeysInit = true;
-                documentSetKeysSize = documentSetKeys.size();
-            }
+            
+            // experimental purpose
+            /*struct timeval tp;
+            gettimeofday(&tp, NULL);
+            collection->debug_str << "Queue Size: " << collection->getDocumentSet()->size() << "/" << collection->worstQueueSize.fetch_and_add(0) << "/" << collection->noReclamationQueueSize.fetch_and_add(0) << "/" << tp.tv_sec * 1000000000 + tp.tv_usec * 1000 << endl;*/
 
         }
         
@@ -181,79 +188,41 @@ namespace mongo {
         if ( !sharedQueueScanDone ) {
             
             bool nextDocument = true;
-            bool find = false;
-            queue_document queueDocument;
-            uint64_t queueStatusMask = 0x0;
             
             while ( nextDocument ) {
                 
-                if ( (++documentSetKeysIndex + 1) <= documentSetKeysSize ) {
-
-                    doc_set::accessor a;
-                    find = collection->documentSet.find(a, documentSetKeys[documentSetKeysIndex]);
+                if ( documentSetCursor.more() ) {
 
-                    // document has not been removed from shared queue
-                    if ( find ) {
+                    // getting the document from the shared queue; documents
+                    // in the range of the scan are not freed before it ends
+                    const queue_document& queueDocument = documentSetCursor.next();
+                    
+                    // if OR(Status) is 0, read the document from the queue
+                    // status = ( scan mask & queue status mask ); documents
+                    // preserved before the scan started belong to earlier scans
+                    // that held the same bit
+                    if ( !queueDocument.queueStatusMask.test( scanBit ) &&
+                         queueDocument.epoch >= scanEpoch ) {
+                        
+                        // read document
+                        nextDocument = false;
+                        skip = true;
                         
-                        // getting the document from the shared queue
-                        queueDocument = a->second;
-                        queueStatusMask = queueDocument.queueStatusMask;
+                        nextLoc.setChronosInvalid();
+                        nextObj = documentSetCursor.document();
+                        ++_specificStats.docsFromRemset;
                         
-                        // if OR(Status) is 0, read the document from the queue
-                        // status = ( scan mask & queue status mask )
-                        if ( ( scanMask & queueStatusMask ) == 0x0 ) {
-                            
-                            // read document
-                            nextDocument = false;
-                            skip = true;
-                            
-                            nextLoc = *(new DiskLoc(-3, 0)); //invalid
-                            nextObj = queueDocument.document;
-                            
-                            // computing new Queue Status Mask
-                            queueStatusMask |= scanMask;
-                            
-                            // experimental purpose
-                            /*{
-                                documentSetWriteLock dsw_lock(collection->DSLock);
-                                struct timeval tp;
-                                gettimeofday(&tp, NULL);
-                                collection->debug_str << "Queue Size: " << collection->documentSet.size() << "/" << collection->worstQueueSize.fetch_and_decrement() - 1 << "/" << collection->noReclamationQueueSize.fetch_and_add(0) << "/" << tp.tv_sec * 1000000000 + tp.tv_usec * 1000 << endl;
-                            }*/
-                            
-                            // if AND(New Queue Status Mask) is 1
-                            // document can be removed from queue
-                            if ( queueStatusMask == 0xFFFFFFFFFFFFFFFF ) {
-                                {
-                                    // locking document set -- prevent concurrency with traversal
-                                    documentSetWriteLock dsw_lock(collection->DSLock);
-                                    collection->documentSet.erase(a);
-                                    
-                                    // experimental purpose
-                                    /*struct timeval tp;
-                                    gettimeofday(&tp, NULL);
-                                    collection->debug_str << "Queue Size: " << collection->documentSet.size() << "/" << collection->worstQueueSize.fetch_and_add(0) << "/" << collection->noReclamationQueueSize.fetch_and_add(0) << "/" << tp.tv_sec * 1000000000 + tp.tv_usec * 1000 << endl;*/
-                                }
-                                
-                                collection->documentSetSize -= 1;
-                                
-                                //log() << "Removing " << queueDocument.document.getField("_id").toInt() << endl;
-                                //log() << "Size of queue: " << collection->documentSet.size() << endl;
-                            }
-                            
-                            // if AND(New Queue Status Mask) is 0
-                            // update Queue Status Mask
-                            else {
-                                queueDocument.queueStatusMask = queueStatusMask;
-                                
-                                // updating document
-                                a->second = queueDocument;
-                            }
-                            
-                        }
+                        // experimental purpose
+                        /*{
+                            documentSetWriteLock dsw_lock(collection->DSLock);
+                            struct timeval tp;
+                            gettimeofday(&tp, NULL);
+                            collection->debug_str << "Queue Size: " << collection->getDocumentSet()->size() << "/" << collection->worstQueueSize.fetch_and_decrement() - 1 << "/" << collection->noReclamationQueueSize.fetch_and_add(0) << "/" << tp.tv_sec * 1000000000 + tp.tv_usec * 1000 << endl;
+                        }*/
                         
+                        // the document is not removed here: it goes with its
+                        // segment once no running scan needs it anymore
                     }
-                    //a.release();
                     
                 } else {
                     nextDocument = false;
@@ -266,40 +235,37 @@ namespace mongo {
         if ( !skip )
         {
             // no more documents to be read by the scan
-            // free the bits
-            if ( (documentSetKeysIndex + 1) >= documentSetKeysSize ) {
+            // free the bits, only once: the bit may be another scan's by now
+            if ( scanBitHeld && !documentSetCursor.more() ) {
                 
-                // updating Active Mask and Stable Mask
+                // updating Stable Mask, then Active Mask
                 // note that Stable Mask can be updated before scanning the queue
+                uint64_t oldestEpoch;
                 {
-                    activeMaskWriteLock amw_lock(database->AMLock);
+                    stableMaskWriteLock smw_lock(collection->SMLock);
                     
-                    {
-                        stableMaskWriteLock smw_lock(collection->SMLock);
-                        
-                        database->activeMask |= scanMask;
-                        collection->localActiveMask |= scanMask;
-                        collection->stableMask = ~( ( ~collection->stableMask ) ^ scanMask );
-                        
-                        //log() << "Active Mask: " << std::hex << database->activeMask << endl;
-                        //log() << "Stable Mask: " << std::hex << collection->stableMask << endl;
-                        
-                        // allow an awaiting scan to start
-                        database->activeMaskFull = false;
-                        
-                        // experimental purposes
-                        /*if (database->activeMask == 0xFFFFFFFFFFFFFFFF)
-                        {
-                            std::ofstream out("PATH");
-                            out << collection->debug_str.str();
-                            out.close();
-                        }*/
-                        
-                    } // releasing stable mask lock 
+                    collection->localActiveMask.set( scanBit );
+                    collection->stableMask.flip( scanBit );
+                    oldestEpoch = collection->endScanEpoch( scanBit );
+                    
+                    //log() << "Stable Mask: " << collection->stableMask.toString() << endl;
                     
-                } // releasing active mask lock
+                } // releasing stable mask lock
                 
-                database->activeMaskCondition.notify_one();
+                // freeing the generations of the document set no scan needs anymore
+                collection->reclaimDocumentSet( oldestEpoch );
+                
+                // allow an awaiting scan to start
+                database->activeMask.release( scanBit );
+                scanBitHeld = false;
+                
+                // experimental purposes
+                /*if (database->activeMask.allFree())
+                {
+                    std::ofstream out("PATH");
+                    out << collection->debug_str.str();
+                    out.close();
+                }*/
                 
             }
         }
@@ -324,7 +290,9 @@ namespace mongo {
                                                   _params.direction,
                                                   _use_chronos,
                                                   scanMask,
-                                                  scanStableMask) );
+                                                  scanStableMask,
+                                                  vls_mask::wordOf( scanBit ),
+                                                  scanStartExtent) );
 
             ++_commonStats.needTime;
             return PlanStage::NEED_TIME;
@@ -362,9 +330,25 @@ namespace mongo {
                 chronosNextObj(nextLoc, nextObj);
             else if (nextLoc.isChronosInvalid())
             {
+                ++_specificStats.docsSkipped;
                 ++_commonStats.needTime;
                 return PlanStage::NEED_TIME;
             }
+            else if (_use_chronos &&
+                     _params.direction == CollectionScanParams::FORWARD) {
+                // writers need not check the records of the extents the
+                // scan left behind
+                DiskLoc extentLoc = collection->extentOf(nextLoc);
+                if (extentLoc != scanExtent) {
+                    scanExtent = extentLoc;
+                    collection->setScanPosition(scanBit, extentLoc);
+                    
+                    // a shared scan only left the extents before extentLoc
+                    // behind once it wrapped around
+                    if (scanStartExtent.isNull() || _iter->wrappedAround())
+                        collection->advanceScanWatermark(scanBit, extentLoc);
+                }
+            }
         }
         
         WorkingSetID id = _workingSet->allocate();
@@ -62,6 +62,7 @@
 #include "mongo/db/matcher/expression.h"
 #include "mongo/db/structure/collection_iterator.h"
 #include "mongo/db/structure/collection.h"
+#include "mongo/db/structure/document_set.h"
 #include "mongo/db/database.h"
 
 #include <vector>
@@ -83,7 +84,10 @@ namespace mongo {
         CollectionScan(const CollectionScanParams& params,
                        WorkingSet* workingSet,
                        const MatchExpression* filter,
-                       bool use_VLS = false);
+                       bool use_VLS = false,
+                       const BSONObj& vlsFields = BSONObj());
+
+        virtual ~CollectionScan();
 
         virtual StageState work(WorkingSetID* out);
         virtual bool isEOF();
@@ -113,17 +117,30 @@ namespace mongo {
         // --------- VLS --------- //
         
         bool _use_chronos;
+        int scanBit;
         uint64_t scanMask;
         uint64_t scanStableMask;
-        std::vector<uint64_t> documentSetKeys;
-        bool documentSetKeysInit;
+        uint64_t scanEpoch;
+        uint64_t documentSetStart;
+        DocumentSet::Cursor documentSetCursor;
+        bool documentSetCursorInit;
         bool sharedQueueScanDone;
+        bool scanBitHeld;
+        
+        // extent of the last record read, for the scan's watermark
+        DiskLoc scanExtent;
+        
+        // extent where a shared scan starts (see Collection::sharedScanStart())
+        DiskLoc scanStartExtent;
         
-        int documentSetKeysIndex;
-        int documentSetKeysSize;
         Collection* collection;
         Database* database;
         
+        // instance ids of collection and database: the pointers above are
+        // not safe to use once the cursor outlives a drop (see ~CollectionScan())
+        uint64_t collectionId;
+        uint64_t databaseId;
+        
         // --------- VLS --------- //
 
         // Stats
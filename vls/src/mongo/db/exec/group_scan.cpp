@@ -0,0 +1,228 @@
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/db/exec/group_scan.h"
+
+#include "mongo/db/exec/working_set.h"
+
+namespace mongo {
+
+namespace {
+
+    const size_t kMaxBytes = 100 * 1024 * 1024;
+
+    // The value of a top-level field, as an ExpressionFieldPath would read it.
+    Value fieldValue(const BSONObj& obj, const string& field) {
+        BSONElement elem = obj[field];
+        return elem.eoo() ? Value() : Value(elem);
+    }
+
+} // namespace
+
+    GroupScanStage::GroupScanStage(const GroupScanParams& params,
+                                   WorkingSet* ws,
+                                   PlanStage* child,
+                                   MatchExpression* filter)
+        : _params(params),
+          _ws(ws),
+          _filter(filter),
+          _child(child),
+          _populated(false),
+          _constantGroup(NULL),
+          _memUsage(0) { }
+
+    GroupScanStage::~GroupScanStage() { }
+
+    bool GroupScanStage::isEOF() { return _populated && _groupsIt == _groups.end(); }
+
+    PlanStage::StageState GroupScanStage::work(WorkingSetID* out) {
+        ++_commonStats.works;
+
+        if (isEOF()) { return PlanStage::IS_EOF; }
+
+        if (!_populated) {
+            WorkingSetID id;
+            StageState status = _child->work(&id);
+
+            if (PlanStage::ADVANCED == status) {
+                WorkingSetMember* member = _ws->get(id);
+                verify(member->hasObj());
+                accumulate(member->obj);
+                _ws->free(id);
+                ++_commonStats.needTime;
+                return PlanStage::NEED_TIME;
+            }
+            else if (PlanStage::IS_EOF == status) {
+                for (size_t i = 0; i < _batches.size(); i++) {
+                    flushBatch(i);
+                }
+                _populated = true;
+                _groupsIt = _groups.begin();
+                ++_commonStats.needTime;
+                return PlanStage::NEED_TIME;
+            }
+            else {
+                if (PlanStage::NEED_FETCH == status) {
+                    *out = id;
+                    ++_commonStats.needFetch;
+                }
+                else if (PlanStage::NEED_TIME == status) {
+                    ++_commonStats.needTime;
+                }
+                return status;
+            }
+        }
+
+        WorkingSetID id = _ws->allocate();
+        WorkingSetMember* member = _ws->get(id);
+        member->obj = makeResult(_groupsIt->first, _groupsIt->second);
+        member->state = WorkingSetMember::OWNED_OBJ;
+        ++_groupsIt;
+
+        *out = id;
+        ++_commonStats.advanced;
+        return PlanStage::ADVANCED;
+    }
+
+    void GroupScanStage::accumulate(const BSONObj& obj) {
+        const size_t numAccumulators = _params.accumulatorFactories.size();
+
+        Accumulators* group = _constantGroup;
+        if (!group) {
+            Value id = _params.idField.empty() ? _params.idConstant
+                                               : fieldValue(obj, _params.idField);
+
+            // treat missing values the same as NULL, as $group does
+            if (id.missing())
+                id = Value(BSONNULL);
+
+            const size_t oldSize = _groups.size();
+            group = &_groups[id];
+            if (_groups.size() != oldSize) {
+                _memUsage += id.getApproximateSize();
+                group->reserve(numAccumulators);
+                for (size_t i = 0; i < numAccumulators; i++) {
+                    group->push_back(_params.accumulatorFactories[i]());
+                    _memUsage += (*group)[i]->memUsageForSorter();
+                }
+            }
+
+            if (_params.idField.empty()) {
+                _constantGroup = group;
+
+                // all the documents go to this group: batch their inputs
+                _batches.resize(numAccumulators);
+                for (size_t i = 0; i < numAccumulators; i++) {
+                    _batched.push_back((*group)[i]->canProcessBatch());
+                }
+            }
+        }
+
+        for (size_t i = 0; i < numAccumulators; i++) {
+            if (!_batched.empty() && _batched[i]) {
+                NumericBatch& batch = _batches[i];
+                const bool appended = _params.inputFields[i].empty()
+                                    ? batch.append(_params.inputConstants[i])
+                                    : batch.append(obj[_params.inputFields[i]]);
+                if (appended) {
+                    if (batch.full())
+                        flushBatch(i);
+                    continue;
+                }
+
+                // a value of another type: the batch goes first
+                flushBatch(i);
+            }
+
+            Accumulator* accum = (*group)[i].get();
+            _memUsage -= accum->memUsageForSorter();
+            if (_params.inputFields[i].empty()) {
+                accum->process(_params.inputConstants[i], false);
+            }
+            else {
+                accum->process(fieldValue(obj, _params.inputFields[i]), false);
+            }
+            _memUsage += accum->memUsageForSorter();
+        }
+
+        uassert(16945, "Exceeded memory limit for $group, but didn't allow external sort",
+                _memUsage <= kMaxBytes);
+    }
+
+    void GroupScanStage::flushBatch(size_t i) {
+        NumericBatch& batch = _batches[i];
+        if (batch.empty())
+            return;
+
+        Accumulator* accum = (*_constantGroup)[i].get();
+        _memUsage -= accum->memUsageForSorter();
+        accum->processBatch(batch);
+        _memUsage += accum->memUsageForSorter();
+        batch.clear();
+    }
+
+    BSONObj GroupScanStage::makeResult(const Value& id, const Accumulators& accums) const {
+        BSONObjBuilder bob;
+        id.addToBsonObj(&bob, "_id");
+
+        for (size_t i = 0; i < accums.size(); i++) {
+            Value val = accums[i]->getValue(_params.mergeableOutput);
+            if (val.missing()) {
+                // null, as in the documents of $group
+                bob.appendNull(_params.fieldNames[i]);
+            }
+            else {
+                val.addToBsonObj(&bob, _params.fieldNames[i]);
+            }
+        }
+        return bob.obj();
+    }
+
+    void GroupScanStage::prepareToYield() {
+        ++_commonStats.yields;
+        _child->prepareToYield();
+    }
+
+    void GroupScanStage::recoverFromYield() {
+        ++_commonStats.unyields;
+        _child->recoverFromYield();
+    }
+
+    void GroupScanStage::invalidate(const DiskLoc& dl) {
+        ++_commonStats.invalidates;
+        _child->invalidate(dl);
+    }
+
+    PlanStageStats* GroupScanStage::getStats() {
+        _commonStats.isEOF = isEOF();
+        auto_ptr<PlanStageStats> ret(new PlanStageStats(_commonStats, STAGE_GROUP_SCAN));
+        ret->children.push_back(_child->getStats());
+        return ret.release();
+    }
+
+}  // namespace mongo
@@ -0,0 +1,126 @@
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#pragma once
+
+#include <boost/unordered_map.hpp>
+
+#include "mongo/db/exec/plan_stage.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/db/matcher/expression.h"
+#include "mongo/db/pipeline/accumulator.h"
+#include "mongo/db/pipeline/value.h"
+
+namespace mongo {
+
+    class WorkingSet;
+
+    /**
+     * A $group that reads the top-level fields it needs straight from the BSON of
+     * the documents of its child, without building a Document for each of them.
+     */
+    struct GroupScanParams {
+        GroupScanParams() : mergeableOutput(false) { }
+
+        // The group key: the top-level field 'idField', or 'idConstant' if it is empty.
+        string idField;
+        Value idConstant;
+
+        // One entry per accumulator, as the fields of the $group. An accumulator reads
+        // the top-level field inputFields[i], or inputConstants[i] if it is empty.
+        vector<string> fieldNames;
+        vector<intrusive_ptr<Accumulator> (*)()> accumulatorFactories;
+        vector<string> inputFields;
+        vector<Value> inputConstants;
+
+        // True if the results are merged by another $group, as on a shard.
+        bool mergeableOutput;
+    };
+
+    /**
+     * This stage groups all the documents of its child, and then returns one owned
+     * object per group, as a $group over the same documents would.
+     *
+     * Preconditions: The child returns objects.
+     */
+    class GroupScanStage : public PlanStage {
+    public:
+        /**
+         * Takes ownership of 'child' and of 'filter', the filter of the scan under
+         * 'child' (or NULL).
+         */
+        GroupScanStage(const GroupScanParams& params,
+                       WorkingSet* ws,
+                       PlanStage* child,
+                       MatchExpression* filter);
+        virtual ~GroupScanStage();
+
+        virtual bool isEOF();
+        virtual StageState work(WorkingSetID* out);
+
+        virtual void prepareToYield();
+        virtual void recoverFromYield();
+        virtual void invalidate(const DiskLoc& dl);
+
+        virtual PlanStageStats* getStats();
+
+    private:
+        typedef vector<intrusive_ptr<Accumulator> > Accumulators;
+        typedef boost::unordered_map<Value, Accumulators, Value::Hash> GroupsMap;
+
+        void accumulate(const BSONObj& obj);
+        void flushBatch(size_t i);
+        BSONObj makeResult(const Value& id, const Accumulators& accums) const;
+
+        GroupScanParams _params;
+        WorkingSet* _ws;
+
+        // Declared before _child, which reads it until it is deleted.
+        scoped_ptr<MatchExpression> _filter;
+        scoped_ptr<PlanStage> _child;
+
+        GroupsMap _groups;
+        GroupsMap::const_iterator _groupsIt;
+        bool _populated;
+
+        // The group of a constant key, once the first document has been read.
+        Accumulators* _constantGroup;
+
+        // The inputs of the accumulators of the constant group that take batches
+        // (see Accumulator::processBatch()), until the batches are full.
+        vector<NumericBatch> _batches;
+        vector<bool> _batched;
+
+        // Same limit and accounting as the one of $group without external sort.
+        size_t _memUsage;
+
+        // Stats
+        CommonStats _commonStats;
+    };
+
+}  // namespace mongo
@@ -61,6 +61,7 @@
 #include "mongo/db/index/index_access_method.h"
 #include "mongo/db/index/index_cursor.h"
 #include "mongo/db/index/index_descriptor.h"
+#include "mongo/util/timer.h"
 
 //#include <boost/timer.hpp>
 
@@ -78,14 +79,20 @@ namespace {
 namespace mongo {
 
     IndexScan::IndexScan(const IndexScanParams& params, WorkingSet* workingSet,
-                         const MatchExpression* filter, bool use_chronos)
+                         const MatchExpression* filter, bool use_chronos,
+                         const BSONObj& vlsFields)
         : _workingSet(workingSet), _descriptor(params.descriptor), _hitEnd(false), _filter(filter), 
           _shouldDedup(params.descriptor->isMultikey()), _yieldMovedCursor(false), _params(params),
           _btreeCursor(NULL),
-          _use_chronos(true),
+          _use_chronos(use_chronos),
+          scanBit( 0 ),
           scanMask( 0x0 ),
-          documentSetKeysInit( false ),
+          scanEpoch( 0 ),
+          documentSetStart( 0 ),
+          _scanId( -1 ),
+          documentSetCursorInit( false ),
           sharedQueueScanDone( false ),
+          scanBitHeld( false ),
           _chronosExec(false),
           documentsRead(0),
           entriesAltered(0) {
@@ -122,75 +129,69 @@ namespace mongo {
         
         // --------- VLS --------- //
         
-        req.tv_sec = 0;
-        req.tv_nsec = 50000L;
-
-        documentSetKeysIndex = -1;
-        documentSetKeysSize = 0;
         //_scanId = 0;
         
         // getting database and collection
         database = cc().database();
         collection = database->getCollection( _params.ns );
         
-        int scanSetVectorSize = (int)collection->statusMaskMapVector.size();
-        for (int i = 0; i < scanSetVectorSize; i++)
-            scanSetVector.push_back( scan_set(collection->max_id[i] + 1, 0) );
-        
         if (( collection != NULL ) && ( database != NULL )) {
-            if ( _use_chronos && collection->isUserCollection ) {
+            if ( _use_chronos && collection->vlsEnabled ) {
                 
-                // locking active mask
-                activeMaskWriteLock w_lock(database->AMLock);
+                // the status masks and the document set are only kept once
+                // a VLS scan runs over the collection
+                collection->initializeStatusMaskMap();
+                collection->getDocumentSet();
                 
-                // waiting for an available bit
-                while (database->activeMaskFull) {
-                    log() << "Waiting..." << endl;
-                    database->activeMaskCondition.wait(w_lock);
+                // finding a bit for the scan; only waits if every bit is
+                // taken, without the lock, so the collection may be gone then
+                Timer t;
+                int n = Collection::acquireScanBit( _params.ns, &database, &collection );
+                _specificStats.bitWaitMillis = t.millis();
+                if ( n < 0 ) {
+                    _use_chronos = false;
+                    return;
+                }
+                if ( collection->getIndexCatalog()->findIndexByName( _specificStats.indexName ) !=
+                     _descriptor ) {
+                    database->activeMask.release( n );
+                    uasserted( 17336, "index dropped while the VLS index scan waited for a bit" );
                 }
+                scanBitHeld = true;
+                databaseId = database->activeMask.instanceId();
+                collectionId = collection->instanceId;
                 
-                //log() << "Bit is available!" << endl;
+                //log() << "N: " << n << endl;
                 
-                uint64_t mask = 0x1;
+                // assigning scan to bit n; the scan only reads and
+                // flips the word of the status masks that holds it
+                scanBit = n;
+                scanMask = vls_mask::bitOf( n );
                 
-                // finding a bit for the scan
-                for (int n = 0; n < database->maxNumberScans; n++)
-                {
-                    if ( (database->activeMask & (mask << n)) != 0x0 )
-                    {
-                        //log() << "N: " << n << endl;
-                        //log() << "Mask : " << std::hex << (~(mask << n)) << endl;
-                        
-                        // assigning scan to bit n
-                        database->activeMask &= ~(mask << n);
-                        database->indexActiveMask &= ~(mask << n);
-                        collection->localActiveMask &= ~(mask << n);
-                        collection->localIndexActiveMask &= ~(mask << n);
-                        scanMask = (mask << n);
-                        
-                        // including scan set in collection
-                        //_scanId = collection->indexScanId++;
-                        //log() << "Scan ID: " << _scanId << endl;
-                        //collection->indexScanMap.insert( std::make_pair(_scanId,
-                        //        index_scan_info( _params.bounds, _descriptor->keyPattern(),
-                        //                _params.direction, &scanSetVector )) );
-                        
-                        break;
-                    }
-                }
+                // including scan set in collection, so that index entries
+                // removed from now on are not missed by the scan
+                _scanId = collection->registerIndexScan(
+                        index_scan_info( _params.bounds, _descriptor->keyPattern(),
+                                _params.direction, _descriptor->getIndexNumber(), &scanSet ) );
+                //log() << "Scan ID: " << _scanId << endl;
                 
                 // getting stable mask for that particular scan
                 // this helps avoid reading the collection's stable mask
                 {
-                    stableMaskReadLock smr_lock(collection->SMLock);
-                    scanStableMask = collection->stableMask & scanMask;
+                    stableMaskWriteLock smw_lock(collection->SMLock);
+                    collection->localActiveMask.reset( n );
+                    collection->localIndexActiveMask.reset( n );
+                    scanStableMask = collection->stableMask.words[vls_mask::wordOf( n )] & scanMask;
+                    scanEpoch = collection->beginScanEpoch( n );
+                    
+                    // updates only preserve the fields the scan reads,
+                    // including the ones of its index keys
+                    collection->setScanFields( n, vlsFields, _descriptor->keyPattern() );
+                    
+                    // documents preserved from now on are the ones the scan may need
+                    documentSetStart = collection->getDocumentSet()->end();
                 }
                 
-                // if OR(Active Mask) is 0, there is no bit available
-                // other scans should be aware of this
-                if ( database->activeMask == 0x0 )
-                    database->activeMaskFull = true;
-                
                 //log() << "Active Mask (1): " << std::hex << database->activeMask << endl;
                 //log() << "Local Active Mask (1): " << std::hex << collection->localActiveMask << endl;
                 //log() << "Stable Mask (1): " << std::hex << collection->stableMask << endl;
@@ -224,11 +225,12 @@ namespace mongo {
         _indexCursor.reset(cursor);
         _indexCursor->setOptions(cursorOptions);
         if ( _use_chronos )
-            _indexCursor->setChronosParameters(&(collection->statusMaskMapVector),
-                                               &(collection->ofsMap),
-                                               &scanSetVector,
+            _indexCursor->setChronosParameters(&(collection->statusMaskPlanes[vls_mask::wordOf( scanBit )]),
+                                               &(collection->slotTableVector),
+                                               &scanSet,
                                                collection->getIndexCatalog(),
                                                _descriptor->getIndexNumber(),
+                                               vls_mask::wordOf( scanBit ),
                                                entriesAltered);
 
         if (_params.bounds.isSimpleRange) {
@@ -265,163 +267,48 @@ namespace mongo {
         }
     }
     
-    void IndexScan::resetStatusMaskBits() {
-        
-        //boost::timer t;
-        
-        //uint64_t statusMask = 0x0;
-        //bool success = false;
-        
-        bool stableIsZero = (scanStableMask == 0x0) ? true : false;
-        
-        for (int i = 0; i < (int)collection->statusMaskMapVector.size(); i++)
-        {
-            st_mask_map* statusMaskMap = &(collection->statusMaskMapVector[i]);
-            for( st_mask_map::iterator it = statusMaskMap->begin();
-                    it != statusMaskMap->end(); it++)
-            {
-                
-                if ( stableIsZero )
-                    (it)->fetch_and_store( scanMask | (*it) );
-                else
-                    (it)->fetch_and_store( ~scanMask & (*it) );
-                
-                /*success = false;
-                while ( !success )
-                {
-                    statusMask = *it;
-                    
-                    // update status mask
-                    if ( ( ( scanStableMask ^ statusMask ) & scanMask ) == 0x0 )
-                        success = ( (it)->compare_and_swap( ~( ( ~statusMask ) ^ scanMask ), statusMask ) == statusMask ) ? true : false;
-                    else
-                        success = true;
-                }*/
-            }
-        }
-        
-        // experimental purposes
-        //debug_str << "Time Resetting (" << _scanId << "): " << std::setprecision(15) << t.elapsed() << endl;
-    }
-    
-    void IndexScan::resetIndexMaskBits(int idx_number)
-    {
-        //log() << "Resetting Index Masks..." << endl;
-        
-        idx_status zero (0x0);
-        IndexCatalog* indexCatalog = collection->getIndexCatalog();
-        
-        for (int a = 0; a < (int)indexCatalog->indexMaskMap[idx_number].size(); a++)
-        {
-            idx_mask_map* _indexMaskMap = &(indexCatalog->indexMaskMap[idx_number][a]);
-            
-            idx_mask_map::iterator it = _indexMaskMap->begin();
-            idx_status_map::iterator status_it = ( &(indexCatalog->indexStatusMap[idx_number][a]) )->begin();
-            ID id = 0;
-            
-            while ( it != _indexMaskMap->end() )
-            {
-                {
-                    //indexMaskWriteLock imw_lock(collection->IMLock);
-                
-                    if ( (*status_it) == zero )
-                    {
-                        //log() << "Resetting Insert!" << endl;
-                        (it)->fetch_and_store( ~scanMask & (*it) );
-                    }
-                    else
-                    {
-                        //log() << "Resetting Remove!" << endl;
-                        (it)->fetch_and_store( scanMask | (*it) );
-                        
-                        if ( (*it) == 0xFFFFFFFFFFFFFFFF )
-                        {
-                            // unindex corresponding record
-                            // need to get corresponding record (in shared queue)
-                            doc_set::const_accessor const_a;
-                            bool find = collection->documentSet.find(const_a, indexCatalog->queueMap[idx_number][id]);
-                            
-                            if ( find )
-                            {
-                                //log() << "Unindexing record with id " << (const_a->second).document.getField("_id").toInt() << endl;
-                                
-                                // here, we should unindex for real, but due to MongoDB locking mechanism,
-                                // we skip this for now, and add a timer that reflects the process
-                                /*indexCatalog->unindexRecordChronos( idx_number,
-                                        (const_a->second).document,
-                                        DiskLoc(a, collection->idOfsMap[a][id]),
-                                        false );*/
-                                nanosleep(&req, (struct timespec *)NULL);
-                                
-                                indexCatalog->queueMap[idx_number].erase(id);
-                            }
-                            else
-                                log() << "Oops... something is wrong here..." << endl;
-                            
-                            // resetting bit -- in comments because we are not unindexing right now
-                            // (*status_it) = zero;
-                        }
-                    }
-                    
-                } // lock
-                
-                // iterators and id
-                status_it++;
-                it++;
-                id++;
-            }
-        }
+    IndexScan::~IndexScan() {
+        // a VLS scan that stops before the end (e.g., a losing plan
+        // candidate) still has to give its bit back; once reading the
+        // document set, the scan is no longer active. The cursor may be
+        // destroyed without a lock, or after the collection was dropped
+        if ( scanBitHeld )
+            Collection::abandonVLSScan( _params.ns, databaseId, collectionId,
+                                        scanBit, scanStableMask, !documentSetCursorInit,
+                                        _scanId );
     }
     
     bool IndexScan::chronosNextObj(BSONObj &nextObj) {
             
         bool skip = false;
         
-        if ( !documentSetKeysInit ) {
+        if ( !documentSetCursorInit ) {
             
             // do not add records to record set anymore
-            //collection->indexScanMap.erase( _scanId );
+            collection->unregisterIndexScan( _scanId );
+            _scanId = -1;
             
             // resetting local active masks and stable mask
             {
-                activeMaskWriteLock amw_lock(database->AMLock);
-                {
-                    stableMaskWriteLock smw_lock(collection->SMLock);
-                    
-                    collection->localActiveMask |= scanMask;
-                    collection->localIndexActiveMask |= scanMask;
-                    collection->stableMask = ~( ( ~collection->stableMask ) ^ scanMask );
-                }
+                stableMaskWriteLock smw_lock(collection->SMLock);
+                
+                collection->localActiveMask.set( scanBit );
+                collection->localIndexActiveMask.set( scanBit );
+                collection->stableMask.flip( scanBit );
             }
             
-            // resetting index masks
-            //if (entriesAltered > 0)
-            //    resetIndexMaskBits( _descriptor->getIndexNumber() );
-            
-            // resetting all status mask map for this scan
-            // the idea is for all documents to look "already read" by the scan
-            // this avoids more updates to put records in the queue for this scan
-            //if (documentsRead < collection->numRecords())
-            //    resetStatusMaskBits();
+            // index deltas no longer need the bit of the scan once
+            // FlipPhase is done with it (see resetIndexDeltas())
             
             // "materializing" the document set for this particular scan
-             // since this scan will not need new documents added to the set
-            if ( collection->documentSetSize == 0 )
+            // since this scan will not need new documents added to the set:
+            // the current end of the log is the high-water mark of the scan
+            DocumentSet* documentSet = collection->getDocumentSet();
+            documentSetCursor = documentSet->cursor( documentSetStart, documentSet->end() );
+            documentSetCursorInit = true;
+            
+            if ( !documentSetCursor.more() )
                 sharedQueueScanDone = true;
-            else
-            {
-                {
-                    // locking document set
-                    documentSetWriteLock dsw_lock(collection->DSLock);
-                    
-                    for( doc_set::const_iterator it = collection->documentSet.begin();
-                            it != collection->documentSet.end(); ++it )
-                        documentSetKeys.push_back(it->first);
-                }
-    
-                documentSetKeysInit = true;
-                documentSetKeysSize = documentSetKeys.size();
-            }
 
         }
         
@@ -431,74 +318,39 @@ namespace mongo {
             //boost::timer t;
             
             bool nextDocument = true;
-            bool find = false;
-            queue_document queueDocument;
-            uint64_t queueStatusMask = 0x0;
             ID id;
             int _a;
             
             while ( nextDocument ) {
                 
-                documentSetKeysIndex += 1;
-                
-                if ( (documentSetKeysIndex + 1) <= documentSetKeysSize ) {
-
-                    doc_set::accessor a;
-                    find = collection->documentSet.find(a, documentSetKeys[documentSetKeysIndex]);
+                if ( documentSetCursor.more() ) {
 
-                    // document has not been removed from shared queue
-                    if ( find ) {
+                    // getting the document from the shared queue; documents
+                    // in the range of the scan are not freed before it ends
+                    const queue_document& queueDocument = documentSetCursor.next();
+                    id = queueDocument.id;
+                    _a = queueDocument._a;
+                    
+                    // if OR(Status) is 0, read the document from the queue
+                    // status = ( scan mask & queue status mask ); documents
+                    // preserved before the scan started belong to earlier scans
+                    // that held the same bit
+                    if ( !queueDocument.queueStatusMask.test( scanBit ) &&
+                         queueDocument.epoch >= scanEpoch ) {
                         
-                        // getting the document from the shared queue
-                        queueDocument = a->second;
-                        queueStatusMask = queueDocument.queueStatusMask;
-                        id = queueDocument.id;
-                        _a = queueDocument._a;
+                        if ( scanSet.contains( _a, id ) ) {
                         
-                        // if OR(Status) is 0, read the document from the queue
-                        // status = ( scan mask & queue status mask )
-                        if ( ( scanMask & queueStatusMask ) == 0x0 ) {
-                            
-                            if ( scanSetVector[_a][id] == 1 ) {
-                            
-                                // read document
-                                nextDocument = false;
-                                skip = true;
-        
-                                nextObj = queueDocument.document;
-                                
-                            }
-                                
-                            // computing new Queue Status Mask
-                            queueStatusMask |= scanMask;
-                            
-                            // if AND(New Queue Status Mask) is 1
-                            // document can be removed from queue
-                            if ( queueStatusMask == 0xFFFFFFFFFFFFFFFF ) {
-                                {
-                                    // locking document set -- prevent concurrency with traversal
-                                    documentSetWriteLock dsw_lock(collection->DSLock);
-                                    collection->documentSet.erase(a);
-                                }
-                                collection->documentSetSize -= 1;
-                                
-                                //log() << "Removing " << queueDocument.document.getField("_id").toInt() << endl;
-                                //log() << "Size of queue: " << collection->documentSet.size() << endl;
-                            }
-                            
-                            // if AND(New Queue Status Mask) is 0
-                            // update Queue Status Mask
-                            else {
-                                queueDocument.queueStatusMask = queueStatusMask;
-                                
-                                //log() << "Queue Mask: " << queueStatusMask << endl;
-                                
-                                // updating document
-                                a->second = queueDocument;
-                            }
+                            // read document
+                            nextDocument = false;
+                            skip = true;
+    
+                            nextObj = documentSetCursor.document();
+                            ++_specificStats.docsFromRemset;
                             
                         }
                         
+                        // the document is not removed here: it goes with its
+                        // segment once no running scan needs it anymore
                     }
                     
                 } else {
@@ -515,8 +367,8 @@ namespace mongo {
         if ( !skip )
         {
             // no more documents to be read by the scan
-            // free the bits
-            if ( (documentSetKeysIndex + 1) >= documentSetKeysSize ) {
+            // free the bits, only once: the bit may be another scan's by now
+            if ( scanBitHeld && !documentSetCursor.more() ) {
                 
                 // updating Active Mask and Stable Mask
                 // note that Stable Mask can be updated before scanning the queue
@@ -550,9 +402,19 @@ namespace mongo {
                 
                 database->activeMaskCondition.notify_one();*/
                 
+                // done with the document set: freeing the generations
+                // no scan needs anymore
+                uint64_t oldestEpoch;
+                {
+                    stableMaskWriteLock smw_lock(collection->SMLock);
+                    oldestEpoch = collection->endScanEpoch( scanBit );
+                }
+                collection->reclaimDocumentSet( oldestEpoch );
+                
                 FlipPhase* flip = new FlipPhase(database, collection,
-                        scanStableMask, scanMask);
+                        scanStableMask, scanBit);
                 flip->go();
+                scanBitHeld = false;
     
             }
             
@@ -585,6 +447,7 @@ namespace mongo {
             checkEnd();
             
             documentsRead += 1;
+            ++_specificStats.docsSkipped;
             
             ++_commonStats.needTime;
             return PlanStage::NEED_TIME;
@@ -597,7 +460,7 @@ namespace mongo {
         {
             if ( _use_chronos ) {
                 //log() << "Chronos" << endl;
-                loc = *(new DiskLoc(-2, 0)); //invalid
+                loc.setInvalid();
                 chronos = chronosNextObj(_ownedKeyObj);
             }
             
@@ -64,6 +64,7 @@
 #include "mongo/db/matcher/expression.h"
 #include "mongo/db/query/index_bounds.h"
 #include "mongo/db/structure/collection.h"
+#include "mongo/db/structure/document_set.h"
 #include "mongo/db/database.h"
 #include "mongo/db/client.h"
 #include "mongo/platform/unordered_set.h"
@@ -119,9 +120,10 @@ namespace mongo {
     class IndexScan : public PlanStage {
     public:
         IndexScan(const IndexScanParams& params, WorkingSet* workingSet,
-                  const MatchExpression* filter, bool use_chronos = false);
+                  const MatchExpression* filter, bool use_chronos = false,
+                  const BSONObj& vlsFields = BSONObj());
 
-        virtual ~IndexScan() { }
+        virtual ~IndexScan();
 
         virtual StageState work(WorkingSetID* out);
         virtual bool isEOF();
@@ -133,8 +135,6 @@ namespace mongo {
         virtual PlanStageStats* getStats();
         
         bool chronosNextObj(BSONObj &nextObj);
-        void resetStatusMaskBits();
-        void resetIndexMaskBits(int idx_number);
 
     private:
         /**
@@ -189,25 +189,31 @@ namespace mongo {
         // --------- VLS --------- //
                 
         bool _use_chronos;
+        int scanBit;
         uint64_t scanMask;
         uint64_t scanStableMask;
-        std::vector<uint64_t> documentSetKeys;
-        scan_set_vector scanSetVector;
-        //int _scanId;
-        bool documentSetKeysInit;
+        uint64_t scanEpoch;
+        uint64_t documentSetStart;
+        DocumentSet::Cursor documentSetCursor;
+        ScanSet scanSet;
+        int _scanId;
+        bool documentSetCursorInit;
         bool sharedQueueScanDone;
+        bool scanBitHeld;
         bool _chronosExec;
         unsigned int documentsRead;
         unsigned int entriesAltered;
         IndexBoundsChecker indexChecker;
         BSONObj _ownedKeyObj;
         
-        int documentSetKeysIndex;
-        int documentSetKeysSize;
         Collection* collection;
         Database* database;
+        
+        // instance ids of collection and database: the pointers above are
+        // not safe to use once the cursor outlives a drop (see ~IndexScan())
+        uint64_t collectionId;
+        uint64_t databaseId;
 
-        struct timespec req;
         //std::stringstream debug_str;
         
         // --------- VLS --------- //
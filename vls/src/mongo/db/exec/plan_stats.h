@@ -109,10 +109,28 @@ namespace mongo {
     };
 
     struct CollectionScanStats : public SpecificStats {
-        CollectionScanStats() : docsTested(0) { }
+        CollectionScanStats() : docsTested(0),
+                                docsFromRemset(0),
+                                docsSkipped(0),
+                                bitWaitMillis(0) { }
 
         // How many documents did we check against our filter?
         uint64_t docsTested;
+
+        // --------- VLS --------- //
+
+        // How many documents were stable versions read from the document set?
+        uint64_t docsFromRemset;
+
+        // How many records were skipped by their status mask (i.e., their
+        // stable version is in the document set, or they were inserted
+        // after the scan started)?
+        uint64_t docsSkipped;
+
+        // How long did the scan wait for a bit of the active mask?
+        uint64_t bitWaitMillis;
+
+        // --------- VLS --------- //
     };
 
     struct AndHashStats : public SpecificStats {
@@ -181,7 +199,10 @@ namespace mongo {
                            dupsDropped(0),
                            seenInvalidated(0),
                            matchTested(0),
-                           keysExamined(0) { }
+                           keysExamined(0),
+                           docsFromRemset(0),
+                           docsSkipped(0),
+                           bitWaitMillis(0) { }
 
         virtual ~IndexScanStats() { }
 
@@ -217,6 +238,14 @@ namespace mongo {
         // Number of entries retrieved from the index during the scan.
         uint64_t keysExamined;
 
+        // --------- VLS --------- //
+
+        // Same as in CollectionScanStats, for the entries of the index.
+        uint64_t docsFromRemset;
+        uint64_t docsSkipped;
+        uint64_t bitWaitMillis;
+
+        // --------- VLS --------- //
     };
 
     struct OrStats : public SpecificStats {
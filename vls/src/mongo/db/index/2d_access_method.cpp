@@ -229,6 +229,6 @@ namespace mongo {
     
     void TwoDAccessMethod::setCollection(Collection *collection) {}
     
-    void TwoDAccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName) {}
+    void TwoDAccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key) {}
 
 }  // namespace mongo
@@ -138,7 +138,7 @@ namespace mongo {
         // This is called by the two getKeys above.
         void getKeys(const BSONObj &obj, BSONObjSet* keys, vector<BSONObj>* locs) const;
         
-        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName);
+        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key);
 
         BSONObj _nullObj;
         BSONElement _nullElt;
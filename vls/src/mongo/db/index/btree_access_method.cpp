@@ -112,7 +112,7 @@ namespace mongo {
                 } else if (!options.dupsAllowed) {
                     // Assuming it's a duplicate key exception.  Clean up any inserted keys.
                     for (BSONObjSet::const_iterator j = keys.begin(); j != i; ++j) {
-                        removeOneKey(*j, loc, "");
+                        removeOneKey(*j, loc);
                     }
                     *numInserted = 0;
                     return Status(ErrorCodes::DuplicateKey, e.what(), e.getCode());
@@ -132,7 +132,7 @@ namespace mongo {
         return ret;
     }
 
-    bool BtreeBasedAccessMethod::removeOneKey(const BSONObj& key, const DiskLoc& loc, const char* fieldName) {
+    bool BtreeBasedAccessMethod::removeOneKey(const BSONObj& key, const DiskLoc& loc) {
         bool ret = false;
 
         try {
@@ -140,7 +140,6 @@ namespace mongo {
                                       _btreeState->head(),
                                       key,
                                       loc);
-            //addRemovedKey(loc, key, fieldName);
         } catch (AssertionException& e) {
             problem() << "Assertion failure: _unindex failed "
                 << _descriptor->indexNamespace() << endl;
@@ -162,13 +161,12 @@ namespace mongo {
         getKeys(obj, &keys);
         *numDeleted = 0;
 
-        unsigned field_name_i = 0;
         for (BSONObjSet::const_iterator i = keys.begin(); i != keys.end(); ++i) {
-            bool thisKeyOK = removeOneKey(*i, loc, fieldNames[ field_name_i ]);
-            field_name_i++;
+            bool thisKeyOK = removeOneKey(*i, loc);
 
             if (thisKeyOK) {
                 ++*numDeleted;
+                addRemovedKey(loc, *i);
             } else if (options.logIfError) {
                 log() << "unindex failed (key too big?) " << _descriptor->indexNamespace()
                       << " key: " << *i << " " << loc.obj()["_id"] << endl;
@@ -299,14 +297,12 @@ namespace mongo {
                                   true);
         }
 
-        unsigned field_name_i = 0;
         for (size_t i = 0; i < data->removed.size(); ++i) {
             _interface->unindex(_btreeState.get(),
                                 _btreeState->head(),
                                 *data->removed[i],
                                 data->loc);
-            //addRemovedKey(data->loc, *data->removed[i], fieldNames[ field_name_i ]);
-            field_name_i++;
+            addRemovedKey(data->loc, *data->removed[i]);
         }
 
         *numUpdated = data->added.size();
@@ -331,33 +327,12 @@ namespace mongo {
         _collection = NULL;
     }
     
-    void BtreeAccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName)
+    void BtreeAccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key)
     {
-        /*if (_collection != NULL)
-        {
-            if ((_collection->indexScanMap.size() > 0) && (strlen(fieldName) != 0) )
-            {
-                BSONObjBuilder b;
-                b.appendAs(key.getField(""), fieldName);
-                BSONObj obj = b.obj();
-                
-                int _a = loc.a();
-                uint32_t loc_id = loc.id(_collection->ofsMap[_a]);
-                
-                boost::unordered_map< int, index_scan_info >::iterator it;
-                for (it = _collection->indexScanMap.begin(); it != _collection->indexScanMap.end(); it++)
-                {
-                    IndexBoundsChecker checker = IndexBoundsChecker(&((it->second).bounds),
-                            (it->second).keyPattern, (it->second).direction);
-                    if ( checker.isValidKey(obj) ) {
-                        //log() << "Saving " << key << " (id=" << loc_id << ")" << endl;
-                        ( ((it->second).scanSetVector)->at(_a) )[loc_id] = 1;
-                    //} else {
-                    //    log() << "DO NOT SAVE " << key << " (id=" << loc_id << ")" << endl;
-                    //}
-                }
-            }
-        }*/
+        // running VLS index scans that have not reached the entry yet
+        // read the version of the record preserved in the document set
+        if ( _collection != NULL && _collection->statusMaskMapInit )
+            _collection->addRemovedIndexKey( _descriptor->getIndexNumber(), loc, key );
     }
 
     void BtreeAccessMethod::getKeys(const BSONObj& obj, BSONObjSet* keys) {
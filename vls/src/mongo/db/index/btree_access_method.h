@@ -91,7 +91,7 @@ namespace mongo {
 
     private:
         virtual void getKeys(const BSONObj& obj, BSONObjSet* keys);
-        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName);
+        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key);
 
         // Our keys differ for V0 and V1.
         scoped_ptr<BtreeKeyGenerator> _keyGenerator;
@@ -88,12 +88,13 @@ namespace mongo {
     protected:
         // Friends who need getKeys.
         friend class BtreeBasedBuilder;
+        friend class IndexCatalog; // VLS: index deltas, see IndexCatalog::unindexRecord()
 
         // See below for body.
         class BtreeBasedPrivateUpdateData;
 
         virtual void getKeys(const BSONObj &obj, BSONObjSet *keys) = 0;
-        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName) = 0;
+        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key) = 0;
 
         scoped_ptr<BtreeInMemoryState> _btreeState; // OWNED HERE
         const IndexDescriptor* _descriptor;
@@ -107,7 +108,7 @@ namespace mongo {
         vector<const char*> fieldNames;
 
     private:
-        bool removeOneKey(const BSONObj& key, const DiskLoc& loc, const char* fieldName);
+        bool removeOneKey(const BSONObj& key, const DiskLoc& loc);
         
     };
 
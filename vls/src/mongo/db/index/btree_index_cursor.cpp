@@ -78,7 +78,7 @@ namespace mongo {
         : _direction(1), _btreeState(btreeState), _interface(interface),
           _bucket(btreeState->head()), _keyOffset(0),
           _scanStableMask(scanStableMask), _scanMask(scanMask),
-          _use_chronos(false), _idxNumber(0) {
+          _use_chronos(false), _idxNumber(0), _scanWord(0) {
 
         SimpleMutex::scoped_lock lock(_activeCursorsMutex);
         _activeCursors.insert(this);
@@ -94,17 +94,19 @@ namespace mongo {
     }
     
     void BtreeIndexCursor::setChronosParameters(st_mask_map_vector* statusMaskMapVector,
-                                                ofs_map* ofsMap,
-                                                scan_set_vector* scanSetVector,
+                                                slot_table_vector* slotTableVector,
+                                                ScanSet* scanSet,
                                                 IndexCatalog* indexCatalog,
                                                 int idxNumber,
+                                                int scanWord,
                                                 unsigned int &entriesAltered) {
         
         _statusMaskMapVector = statusMaskMapVector;
-        _ofsMap = ofsMap;
-        _scanSetVector  = scanSetVector;
+        _slotTableVector = slotTableVector;
+        _scanSet = scanSet;
         _indexCatalog = indexCatalog;
         _idxNumber = idxNumber;
+        _scanWord = scanWord;
         _entriesAltered = &entriesAltered;
         _use_chronos = true;
     }
@@ -313,8 +315,8 @@ namespace mongo {
     void BtreeIndexCursor::advance(const char* caller) {
         if (_use_chronos)
             _bucket = _interface->chronosAdvance(_btreeState, _bucket, _chronosBucket, _loc,
-                                                 _statusMaskMapVector, _ofsMap, _scanSetVector,
-                                                 _scanStableMask, _scanMask,
+                                                 _statusMaskMapVector, _slotTableVector, _scanSet,
+                                                 _scanStableMask, _scanMask, _scanWord,
                                                  _indexCatalog, _idxNumber, _entriesAltered,
                                                  _keyOffset, _direction, caller);
         else
@@ -323,11 +325,11 @@ namespace mongo {
     
     void BtreeIndexCursor::verifyDocument() {
         if ( ! _interface->chronosVerify(_btreeState, _bucket, _loc,
-                                         _statusMaskMapVector, _ofsMap, _scanSetVector,
-                                         _scanStableMask, _scanMask,
+                                         _statusMaskMapVector, _slotTableVector, _scanSet,
+                                         _scanStableMask, _scanMask, _scanWord,
                                          _indexCatalog, _idxNumber, _entriesAltered,
                                          _keyOffset) )
-            _chronosBucket = *(new DiskLoc(-3, 0)); //invalid
+            _chronosBucket.setChronosInvalid();
     }
 
 }  // namespace mongo
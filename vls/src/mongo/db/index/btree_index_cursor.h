@@ -108,10 +108,11 @@ namespace mongo {
         virtual string toString();
         
         virtual void setChronosParameters(st_mask_map_vector* statusMaskMapVector,
-                                          ofs_map* ofsMap,
-                                          scan_set_vector* scanSetVector,
+                                          slot_table_vector* slotTableVector,
+                                          ScanSet* scanSet,
                                           IndexCatalog* indexCatalog,
                                           int idxNumber,
+                                          int scanWord,
                                           unsigned int &entriesAltered);
         
         virtual DiskLoc getCurrentLoc() const;
@@ -159,11 +160,12 @@ namespace mongo {
         uint64_t &_scanStableMask;
         uint64_t &_scanMask;
         st_mask_map_vector* _statusMaskMapVector;
-        ofs_map* _ofsMap;
-        scan_set_vector* _scanSetVector;
+        slot_table_vector* _slotTableVector;
+        ScanSet* _scanSet;
         IndexCatalog* _indexCatalog;
         bool _use_chronos;
         int _idxNumber;
+        int _scanWord;
         unsigned int *_entriesAltered;
         
         DiskLoc _chronosBucket;
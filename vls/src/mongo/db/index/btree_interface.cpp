@@ -220,11 +220,12 @@ namespace mongo {
             return btreeState->getBucket<Version>(thisLoc)->advance(thisLoc, keyOfs, direction, caller);
         }
         
-        virtual bool chronosNextObj(ID id, 
+        virtual bool chronosNextObj(int a,
+                                    ID id,
                                     uint64_t &scanStableMask,
                                     uint64_t &scanMask,
                                     st_mask_map* statusMaskMap,
-                                    scan_set* scanSet) const {
+                                    ScanSet* scanSet) const {
             
             uint64_t statusMask = 0x0;
             bool success = false;
@@ -247,7 +248,7 @@ namespace mongo {
                     success = true;
                     read_document = false;
                     
-                    scanSet->at(id) = 1;
+                    scanSet->add(a, id);
                 }
             }
             
@@ -260,10 +261,11 @@ namespace mongo {
                                        DiskLoc& chronosLoc,
                                        DiskLoc& nextLoc,
                                        st_mask_map_vector* statusMaskMapVector,
-                                       ofs_map* ofsMap,
-                                       scan_set_vector* scanSetVector,
+                                       slot_table_vector* slotTableVector,
+                                       ScanSet* scanSet,
                                        uint64_t &scanStableMask,
                                        uint64_t &scanMask,
+                                       int scanWord,
                                        IndexCatalog* indexCatalog,
                                        int idxNumber,
                                        unsigned int* entriesAltered,
@@ -275,7 +277,10 @@ namespace mongo {
             if ( loc.isNull() ) {
                 // end of scan
                 chronosLoc = DiskLoc();
-                return *(new DiskLoc(-4, 0)); // start Chronos execution
+                
+                // start Chronos execution
+                loc.setChronosExec();
+                return loc;
             }
             else {
                 //log() << "ID = " << this->keyAt(loc, keyOfs).getField("").toInt() << endl;
@@ -283,16 +288,19 @@ namespace mongo {
                 
                 nextLoc = this->recordAt(loc, keyOfs);
                 int _a = nextLoc.a();
-                ID _id = nextLoc.id(ofsMap->at(_a));
+                ID _id = slotTableVector->at(_a).find(nextLoc.getOfs());
                 //log() << endl << "a: " << _a << " | id: " << _id << endl;
-                IDX_MASK_STATUS idxMaskStatus = indexCatalog->checkIndexStatus(_a, _id, idxNumber, scanMask);
+                BSONObj key;
+                if ( indexCatalog->numRemovedIndexDeltas != 0 )
+                    key = this->keyAt(loc, keyOfs);
+                IDX_MASK_STATUS idxMaskStatus = indexCatalog->checkIndexStatus(_a, _id, idxNumber, scanWord, scanMask, key);
                 
                 if ( idxMaskStatus == UNALTERED )
                 {
                     //log() << "UNALTERED" << endl;
-                    if ( !chronosNextObj( _id, scanStableMask, scanMask, &(statusMaskMapVector->at(_a)), &(scanSetVector->at(_a)) ) ) {
+                    if ( !chronosNextObj( _a, _id, scanStableMask, scanMask, &(statusMaskMapVector->at(_a)), scanSet ) ) {
                         //log() << "Ops, we should not read this record" << endl;
-                        chronosLoc = *(new DiskLoc(-3, 0)); //invalid
+                        chronosLoc.setChronosInvalid();
                     }
                     else {
                         //log() << "Reading this record" << endl;
@@ -302,20 +310,20 @@ namespace mongo {
                 else if ( idxMaskStatus == REMOVED )
                 {
                     //log() << "REMOVED" << endl;
-                    ( &(scanSetVector->at(_a)) )->at(_id) = 1;
+                    scanSet->add(_a, _id);
                     (*entriesAltered)++;
-                    chronosLoc = *(new DiskLoc(-3, 0)); //invalid
+                    chronosLoc.setChronosInvalid();
                 }
                 else if ( idxMaskStatus == INSERTED )
                 {
                     //log() << "INSERTED" << endl;
                     (*entriesAltered)++;
-                    chronosLoc = *(new DiskLoc(-3, 0)); //invalid
+                    chronosLoc.setChronosInvalid();
                 }
                 else
                 {
                     //log() << "SKIP" << endl;
-                    chronosLoc = *(new DiskLoc(-3, 0)); //invalid
+                    chronosLoc.setChronosInvalid();
                 }
             }
             
@@ -327,23 +335,27 @@ namespace mongo {
                                    const DiskLoc& thisLoc,
                                    DiskLoc& nextLoc,
                                    st_mask_map_vector* statusMaskMapVector,
-                                   ofs_map* ofsMap,
-                                   scan_set_vector* scanSetVector,
+                                   slot_table_vector* slotTableVector,
+                                   ScanSet* scanSet,
                                    uint64_t &scanStableMask,
                                    uint64_t &scanMask,
+                                   int scanWord,
                                    IndexCatalog* indexCatalog,
                                    int idxNumber,
                                    unsigned int* entriesAltered,
                                    int& keyOfs) const {
             nextLoc = this->recordAt(thisLoc, keyOfs);
             int _a = nextLoc.a();
-            ID _id = nextLoc.id(ofsMap->at(_a));
-            IDX_MASK_STATUS idxMaskStatus = indexCatalog->checkIndexStatus(_a, _id, idxNumber, scanMask); 
+            ID _id = slotTableVector->at(_a).find(nextLoc.getOfs());
+            BSONObj key;
+            if ( indexCatalog->numRemovedIndexDeltas != 0 )
+                key = this->keyAt(thisLoc, keyOfs);
+            IDX_MASK_STATUS idxMaskStatus = indexCatalog->checkIndexStatus(_a, _id, idxNumber, scanWord, scanMask, key); 
             
             if ( idxMaskStatus == REMOVED )
             {
                 (*entriesAltered)++;
-                ( &(scanSetVector->at(_a)) )->at(_id) = 1;
+                scanSet->add(_a, _id);
                 return false;
             }
             else if ( idxMaskStatus == INSERTED )
@@ -352,7 +364,7 @@ namespace mongo {
                 return false;
             }
             else if ( idxMaskStatus == UNALTERED )
-                return chronosNextObj( _id, scanStableMask, scanMask, &(statusMaskMapVector->at(_a)), &(scanSetVector->at(_a)) );
+                return chronosNextObj( _a, _id, scanStableMask, scanMask, &(statusMaskMapVector->at(_a)), scanSet );
             else // SKIP
                 return false;
         }
@@ -135,21 +135,23 @@ namespace mongo {
                                 int direction,
                                 const char* caller) const = 0;
         
-        virtual bool chronosNextObj(ID id, 
+        virtual bool chronosNextObj(int a,
+                                    ID id,
                                     uint64_t &scanStableMask,
                                     uint64_t &scanMask,
                                     st_mask_map* statusMaskMap,
-                                    scan_set* scanSet) const = 0;
+                                    ScanSet* scanSet) const = 0;
         
         virtual DiskLoc chronosAdvance(const BtreeInMemoryState* btreeState,
                                        const DiskLoc& thisLoc,
                                        DiskLoc& chronosLoc,
                                        DiskLoc& nextLoc,
                                        st_mask_map_vector* statusMaskMapVector,
-                                       ofs_map* ofsMap,
-                                       scan_set_vector* scanSetVector,
+                                       slot_table_vector* slotTableVector,
+                                       ScanSet* scanSet,
                                        uint64_t &scanStableMask,
                                        uint64_t &scanMask,
+                                       int scanWord,
                                        IndexCatalog* indexCatalog,
                                        int idxNumber,
                                        unsigned int* entriesAltered,
@@ -161,10 +163,11 @@ namespace mongo {
                                    const DiskLoc& thisLoc,
                                    DiskLoc& nextLoc,
                                    st_mask_map_vector* statusMaskMapVector,
-                                   ofs_map* ofsMap,
-                                   scan_set_vector* scanSetVector,
+                                   slot_table_vector* slotTableVector,
+                                   ScanSet* scanSet,
                                    uint64_t &scanStableMask,
                                    uint64_t &scanMask,
+                                   int scanWord,
                                    IndexCatalog* indexCatalog,
                                    int idxNumber,
                                    unsigned int* entriesAltered,
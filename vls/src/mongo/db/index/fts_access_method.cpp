@@ -76,6 +76,6 @@ namespace mongo {
     
     void FTSAccessMethod::setCollection(Collection *collection) {}
     
-    void FTSAccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName) {}
+    void FTSAccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key) {}
 
 }  // namespace mongo
@@ -79,7 +79,7 @@ namespace mongo {
     private:
         // Implemented:
         virtual void getKeys(const BSONObj& obj, BSONObjSet* keys);
-        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName);
+        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key);
 
         fts::FTSSpec _ftsSpec;
     };
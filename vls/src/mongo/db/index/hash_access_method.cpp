@@ -138,6 +138,6 @@ namespace mongo {
     
     void HashAccessMethod::setCollection(Collection *collection) {}
     
-    void HashAccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName) {}
+    void HashAccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key) {}
 
 }  // namespace mongo
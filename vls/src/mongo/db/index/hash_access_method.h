@@ -99,7 +99,7 @@ namespace mongo {
 
     private:
         virtual void getKeys(const BSONObj& obj, BSONObjSet* keys);
-        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName);
+        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key);
 
         // Only one of our fields is hashed.  This is the field name for it.
         string _hashedField;
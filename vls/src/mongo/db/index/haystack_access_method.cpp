@@ -246,6 +246,6 @@ namespace mongo {
     
     void HaystackAccessMethod::setCollection(Collection *collection) {}
     
-    void HaystackAccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName) {}
+    void HaystackAccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key) {}
 
 }  // namespace mongo
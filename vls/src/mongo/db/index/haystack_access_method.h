@@ -98,7 +98,7 @@ namespace mongo {
 
     private:
         virtual void getKeys(const BSONObj& obj, BSONObjSet* keys);
-        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName);
+        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key);
 
         // Helper methods called by getKeys:
         int hash(const BSONElement& e) const;
@@ -169,13 +169,15 @@ namespace mongo {
         virtual void explainDetails(BSONObjBuilder* b) { }
         
         /**
-         * Set parameters to be used by VLS
+         * Set parameters to be used by VLS; statusMaskMapVector is the plane
+         * of status masks (word scanWord) that holds the bit of the scan
          */
         virtual void setChronosParameters(st_mask_map_vector* statusMaskMapVector,
-                                          ofs_map* ofsMap,
-                                          scan_set_vector* scanSetVector,
+                                          slot_table_vector* slotTableVector,
+                                          ScanSet* scanSet,
                                           IndexCatalog* indexCatalog,
                                           int idxNumber,
+                                          int scanWord,
                                           unsigned int &entriesAltered) = 0;
         
         /**
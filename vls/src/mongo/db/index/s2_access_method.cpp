@@ -252,6 +252,6 @@ namespace mongo {
     
     void S2AccessMethod::setCollection(Collection *collection) {}
     
-    void S2AccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName) {}
+    void S2AccessMethod::addRemovedKey(const DiskLoc& loc, const BSONObj& key) {}
 
 }  // namespace mongo
@@ -80,7 +80,7 @@ namespace mongo {
 
     private:
         virtual void getKeys(const BSONObj& obj, BSONObjSet* keys);
-        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key, const char* fieldName);
+        virtual void addRemovedKey(const DiskLoc& loc, const BSONObj& key);
 
         // getKeys calls the helper methods below.
         void getGeoKeys(const BSONObj& document, const BSONElementSet& elements,
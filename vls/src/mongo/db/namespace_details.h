@@ -253,7 +253,8 @@ namespace mongo {
         };
 
         enum UserFlags {
-            Flag_UsePowerOf2Sizes = 1 << 0
+            Flag_UsePowerOf2Sizes = 1 << 0,
+            Flag_VLS = 1 << 1 // keep status masks and a document set for VLS scans
         };
 
         IndexDetails& idx(int idxNo, bool missingExpected = false );
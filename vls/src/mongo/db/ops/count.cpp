@@ -34,6 +34,7 @@
 #include "mongo/db/clientcursor.h"
 #include "mongo/db/pdfile.h"
 #include "mongo/db/query/get_runner.h"
+#include "mongo/db/query/lite_parsed_query.h"
 
 namespace mongo {
 
@@ -73,6 +74,18 @@ namespace mongo {
             return -1;
         }
 
+        // --------- VLS --------- //
+        
+        // {snapshot: "vls"}: count as of when the scan started, without blocking writers
+        StatusWith<bool> vlsSnapshot = LiteParsedQuery::parseVLSSnapshotCommand(cmd);
+        if (!vlsSnapshot.isOK()) {
+            err = vlsSnapshot.getStatus().reason();
+            errCode = vlsSnapshot.getStatus().code();
+            return -2;
+        }
+        
+        // --------- VLS --------- //
+
         BSONObj query = cmd.getObjectField("query");
         long long count = 0;
         long long skip = cmd["skip"].numberLong();
@@ -95,8 +108,9 @@ namespace mongo {
             return -2;
         }
 
+        // Only the fields of the query are read, so updates need not preserve any other.
         Runner* rawRunner;
-        if (!getRunner(cq, &rawRunner).isOK()) {
+        if (!getRunner(cq, &rawRunner, 0, vlsSnapshot.getValue(), BSON("_id" << true)).isOK()) {
             uasserted(17221, "could not get runner " + query.toString());
             return -2;
         }
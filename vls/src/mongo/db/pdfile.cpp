@@ -295,6 +295,18 @@ namespace mongo {
             d->replaceUserFlags( options["flags"].numberInt() );
         }
 
+        if ( options["vls"].trueValue() ) {
+            d->setUserFlag( NamespaceDetails::Flag_VLS );
+        }
+
+        if ( d->isUserFlagSet( NamespaceDetails::Flag_VLS ) ) {
+            Status status = collection->setVLSEnabled( true );
+            if ( !status.isOK() ) {
+                err = status.reason();
+                return false;
+            }
+        }
+
         return true;
     }
 
@@ -36,6 +36,70 @@
 #include "mongo/db/pipeline/value.h"
 
 namespace mongo {
+    // --------- VLS --------- //
+
+    /** The inputs of an accumulator for a batch of documents, in order, as typed
+     *  columns: ints and longs are in the long column and every number is in the
+     *  double column, while nullish values (missing, null, undefined) are gaps
+     *  that hold 0 in both columns.
+     */
+    class NumericBatch {
+    public:
+        static const size_t kMaxSize = 1024;
+
+        NumericBatch() { clear(); }
+
+        /// Appends input unless it is neither a number nor nullish; returns whether it did.
+        bool append(const Value& input);
+        bool append(const BSONElement& elem);
+
+        void clear() {
+            _size = 0;
+            _numNumbers = 0;
+            _numLongs = 0;
+            _numDoubles = 0;
+        }
+
+        bool empty() const { return _size == 0; }
+        bool full() const { return _size == kMaxSize; }
+        size_t size() const { return _size; }
+
+        /// The number of values of each kind; gaps are not numbers.
+        size_t numNumbers() const { return _numNumbers; }
+        size_t numLongs() const { return _numLongs; }
+        size_t numDoubles() const { return _numDoubles; }
+
+        /// NumberInt, NumberLong, NumberDouble, or EOO for a gap.
+        BSONType getType(size_t i) const { return static_cast<BSONType>(_types[i]); }
+        long long getLong(size_t i) const { return _longs[i]; }
+        double getDouble(size_t i) const { return _doubles[i]; }
+
+        /** Sets *sum to the sum of a batch without doubles, if adding its values
+         *  to an exact integer total (see isExactInteger()) as doubles, in order,
+         *  gives the same double as adding *sum; returns false otherwise.
+         */
+        bool sumIntegers(long long* sum) const;
+
+        /// Whether total is an integer that adding a batch to, as above, keeps exact.
+        static bool isExactInteger(double total);
+
+    private:
+        void appendGap();
+        void appendLong(BSONType type, long long value);
+        void appendDouble(double value);
+
+        size_t _size;
+        size_t _numNumbers;
+        size_t _numLongs;
+        size_t _numDoubles;
+
+        signed char _types[kMaxSize];
+        long long _longs[kMaxSize];
+        double _doubles[kMaxSize];
+    };
+
+    // --------- VLS --------- //
+
     class Accumulator : public RefCountable {
     public:
         /** Process input and update internal state.
@@ -45,6 +109,20 @@ namespace mongo {
             processInternal(input, merging);
         }
 
+        // --------- VLS --------- //
+
+        /** Whether processBatch() is implemented by this accumulator; only
+         *  accumulators that ignore nullish values can take batches.
+         */
+        virtual bool canProcessBatch() const { return false; }
+
+        /** Same as process(input, false) for each number of batch, in order.
+         *  The default processes them one at a time.
+         */
+        virtual void processBatch(const NumericBatch& batch);
+
+        // --------- VLS --------- //
+
         /** Marks the end of the evaluate() phase and return accumulated result.
          *  toBeMerged should be true when the outputs will be merged by process().
          */
@@ -123,6 +201,8 @@ namespace mongo {
     class AccumulatorSum : public Accumulator {
     public:
         virtual void processInternal(const Value& input, bool merging);
+        virtual bool canProcessBatch() const { return true; }
+        virtual void processBatch(const NumericBatch& batch);
         virtual Value getValue(bool toBeMerged) const;
         virtual const char* getOpName() const;
         virtual void reset();
@@ -141,6 +221,8 @@ namespace mongo {
     class AccumulatorMinMax : public Accumulator {
     public:
         virtual void processInternal(const Value& input, bool merging);
+        virtual bool canProcessBatch() const { return true; }
+        virtual void processBatch(const NumericBatch& batch);
         virtual Value getValue(bool toBeMerged) const;
         virtual const char* getOpName() const;
         virtual void reset();
@@ -175,6 +257,8 @@ namespace mongo {
     class AccumulatorAvg : public Accumulator {
     public:
         virtual void processInternal(const Value& input, bool merging);
+        virtual bool canProcessBatch() const { return true; }
+        virtual void processBatch(const NumericBatch& batch);
         virtual Value getValue(bool toBeMerged) const;
         virtual const char* getOpName() const;
         virtual void reset();
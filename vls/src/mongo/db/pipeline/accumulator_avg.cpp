@@ -58,6 +58,24 @@ namespace {
         }
     }
 
+    // --------- VLS --------- //
+
+    void AccumulatorAvg::processBatch(const NumericBatch& batch) {
+        long long sum;
+        if (NumericBatch::isExactInteger(_total) && batch.sumIntegers(&sum)) {
+            _total += sum;
+        }
+        else {
+            // in order, as processInternal(); the gaps add 0
+            for (size_t i = 0; i < batch.size(); ++i) {
+                _total += batch.getDouble(i);
+            }
+        }
+        _count += batch.numNumbers();
+    }
+
+    // --------- VLS --------- //
+
     intrusive_ptr<Accumulator> AccumulatorAvg::create() {
         return new AccumulatorAvg();
     }
@@ -0,0 +1,152 @@
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/pipeline/accumulator.h"
+#include "mongo/db/pipeline/value.h"
+
+namespace mongo {
+
+    bool NumericBatch::append(const Value& input) {
+        switch (input.getType()) {
+        case NumberInt:
+        case NumberLong:
+            appendLong(input.getType(), input.getLong());
+            return true;
+        case NumberDouble:
+            appendDouble(input.getDouble());
+            return true;
+        case EOO:
+        case jstNULL:
+        case Undefined:
+            appendGap();
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool NumericBatch::append(const BSONElement& elem) {
+        switch (elem.type()) {
+        case NumberInt:
+            appendLong(NumberInt, elem._numberInt());
+            return true;
+        case NumberLong:
+            appendLong(NumberLong, elem._numberLong());
+            return true;
+        case NumberDouble:
+            appendDouble(elem._numberDouble());
+            return true;
+        case EOO:
+        case jstNULL:
+        case Undefined:
+            appendGap();
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void NumericBatch::appendGap() {
+        dassert(!full());
+        _types[_size] = EOO;
+        _longs[_size] = 0;
+        _doubles[_size] = 0;
+        ++_size;
+    }
+
+    void NumericBatch::appendLong(BSONType type, long long value) {
+        dassert(!full());
+        _types[_size] = type;
+        _longs[_size] = value;
+        _doubles[_size] = static_cast<double>(value);
+        ++_size;
+        ++_numNumbers;
+        if (type == NumberLong)
+            ++_numLongs;
+    }
+
+    void NumericBatch::appendDouble(double value) {
+        dassert(!full());
+        _types[_size] = NumberDouble;
+        _longs[_size] = 0;
+        _doubles[_size] = value;
+        ++_size;
+        ++_numNumbers;
+        ++_numDoubles;
+    }
+
+    bool NumericBatch::sumIntegers(long long* sum) const {
+        if (_numDoubles)
+            return false;
+
+        // no branches, so that the compiler can vectorize the loop; unsigned, so
+        // that it wraps around as the long total of $sum does
+        unsigned long long total = 0;
+        unsigned long long magnitudes = 0;
+        for (size_t i = 0; i < _size; ++i) {
+            const long long value = _longs[i];
+            total += value;
+            magnitudes |= value ^ (value >> 63); // |value|, or |value| - 1 if negative
+        }
+
+        // every |value| <= 2^42, so the partial sums of at most 2^10 values are
+        // below 2^52 in absolute value: added to an exact integer total, all of
+        // them are integers below 2^53, which doubles hold exactly
+        if (magnitudes >= (1ULL << 42))
+            return false;
+
+        *sum = static_cast<long long>(total);
+        return true;
+    }
+
+    bool NumericBatch::isExactInteger(double total) {
+        return total > -4503599627370496.0 // 2^52
+            && total < 4503599627370496.0
+            && total == static_cast<double>(static_cast<long long>(total));
+    }
+
+    void Accumulator::processBatch(const NumericBatch& batch) {
+        for (size_t i = 0; i < batch.size(); ++i) {
+            switch (batch.getType(i)) {
+            case NumberInt:
+                processInternal(Value(static_cast<int>(batch.getLong(i))), false);
+                break;
+            case NumberLong:
+                processInternal(Value(batch.getLong(i)), false);
+                break;
+            case NumberDouble:
+                processInternal(Value(batch.getDouble(i)), false);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
@@ -45,6 +45,96 @@ namespace mongo {
         }
     }
 
+    // --------- VLS --------- //
+
+namespace {
+    // Value::compare() for numbers, with ints and longs in 'l' and 'r' and every
+    // number in 'ld' and 'rd'
+    int compareNumbers(BSONType lType, long long l, double ld,
+                       BSONType rType, long long r, double rd) {
+        if (Value::getWidestNumeric(lType, rType) == NumberDouble) {
+            // NaN is below all numbers, as in compareElementValues()
+            if (ld < rd)
+                return -1;
+            if (ld == rd)
+                return 0;
+            if (isNaN(ld))
+                return isNaN(rd) ? 0 : -1;
+            return 1;
+        }
+        return l < r ? -1 : (l == r ? 0 : 1);
+    }
+}
+
+    void AccumulatorMinMax::processBatch(const NumericBatch& batch) {
+        // other types only compare with numbers by type
+        if (!_val.missing() && !_val.numeric()) {
+            Accumulator::processBatch(batch);
+            return;
+        }
+
+        const size_t size = batch.size();
+        const size_t none = size;
+        size_t best = none;
+
+        if (batch.numDoubles() == 0 && batch.numNumbers() == size
+                && _val.getType() != NumberDouble) {
+            // ints and longs without gaps: find the extreme with a vectorized loop,
+            // and its first occurrence, which is where comparing in order stops
+            if (size == 0)
+                return;
+            long long extreme = batch.getLong(0);
+            if (_sense == 1) {
+                for (size_t i = 1; i < size; ++i)
+                    extreme = std::min(extreme, batch.getLong(i));
+            }
+            else {
+                for (size_t i = 1; i < size; ++i)
+                    extreme = std::max(extreme, batch.getLong(i));
+            }
+            for (best = 0; batch.getLong(best) != extreme; ++best) { }
+
+            if (!_val.missing()) {
+                const long long current = _val.getLong();
+                if (compareNumbers(_val.getType(), current, static_cast<double>(current),
+                                   batch.getType(best), extreme, batch.getDouble(best))
+                        * _sense <= 0)
+                    return;
+            }
+        }
+        else {
+            // as processInternal(), in order, without the Values: the comparisons
+            // of longs with doubles are not transitive
+            BSONType type = _val.getType(); // EOO if missing
+            long long l = type == NumberDouble || type == EOO ? 0 : _val.getLong();
+            double d = type == EOO ? 0 : _val.getDouble();
+            for (size_t i = 0; i < size; ++i) {
+                const BSONType t = batch.getType(i);
+                if (t == EOO)
+                    continue;
+                if (type == EOO
+                        || compareNumbers(type, l, d, t, batch.getLong(i), batch.getDouble(i))
+                               * _sense > 0) {
+                    best = i;
+                    type = t;
+                    l = batch.getLong(i);
+                    d = batch.getDouble(i);
+                }
+            }
+            if (best == none)
+                return;
+        }
+
+        switch (batch.getType(best)) {
+        case NumberInt: _val = Value(static_cast<int>(batch.getLong(best))); break;
+        case NumberLong: _val = Value(batch.getLong(best)); break;
+        default: _val = Value(batch.getDouble(best)); break;
+        }
+        _memUsageBytes = sizeof(*this) + _val.getApproximateSize() - sizeof(Value);
+    }
+
+    // --------- VLS --------- //
+
     Value AccumulatorMinMax::getValue(bool toBeMerged) const {
         return _val;
     }
@@ -56,6 +56,41 @@ namespace mongo {
         }
     }
 
+    // --------- VLS --------- //
+
+    void AccumulatorSum::processBatch(const NumericBatch& batch) {
+        // ints and longs: one vectorized sum, unless the double total could round
+        long long sum;
+        if (totalType != NumberDouble
+                && NumericBatch::isExactInteger(doubleTotal)
+                && batch.sumIntegers(&sum)) {
+            if (batch.numLongs())
+                totalType = NumberLong;
+            longTotal += sum;
+            doubleTotal += sum;
+            return;
+        }
+
+        // otherwise as processInternal(), in order, without the Values
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const BSONType type = batch.getType(i);
+            if (type == EOO)
+                continue;
+
+            totalType = Value::getWidestNumeric(totalType, type);
+            if (totalType == NumberDouble) {
+                doubleTotal += batch.getDouble(i);
+            }
+            else {
+                long long v = batch.getLong(i);
+                longTotal += v;
+                doubleTotal += v;
+            }
+        }
+    }
+
+    // --------- VLS --------- //
+
     intrusive_ptr<Accumulator> AccumulatorSum::create() {
         return new AccumulatorSum();
     }
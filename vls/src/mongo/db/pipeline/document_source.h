@@ -49,6 +49,7 @@
 
 namespace mongo {
     class Accumulator;
+    class NumericBatch;
     class Cursor;
     class Document;
     class Expression;
@@ -443,6 +444,89 @@ namespace mongo {
     };
 
 
+    // --------- VLS --------- //
+
+    /**
+     * Runs the leading $match, $project and $group stages of an aggregate over
+     * a VLS-enabled collection with several threads, one extent per thread.
+     *
+     * The threads share the bit of a single VLS scan, so the documents read are
+     * the ones of the snapshot taken when the scan starts, as with a sequential
+     * collection scan.  Each thread runs its own copy of the stages, turned into
+     * a shard-side pipeline, and the partial groups it outputs are returned in
+     * extent order, followed by those of the document set; the pipeline merges
+     * them as mongos merges the output of the shards.
+     *
+     * The read lock is taken for one batch of extents at a time.
+     */
+    class DocumentSourceVLSParallelScan :
+        public DocumentSource {
+    public:
+        // virtuals from DocumentSource
+        virtual boost::optional<Document> getNext();
+        virtual const char *getSourceName() const;
+        virtual Value serialize(bool explain = false) const;
+        virtual void setSource(DocumentSource *pSource);
+        virtual bool isValidInitialSource() const { return true; }
+        virtual void dispose();
+
+        /**
+         * Create a parallel scan.
+         *
+         * @param ns the namespace to scan
+         * @param query the query the documents must match, replacing the initial $match
+         * @param workerCommand the aggregate command run by each thread, with the
+         *                      stages of the pipeline up to its $group
+         * @param vlsFields the top-level fields read by the pipeline and its query
+         * @param pExpCtx the expression context for the pipeline
+         */
+        static intrusive_ptr<DocumentSourceVLSParallelScan> create(
+            const string& ns,
+            const BSONObj& query,
+            const BSONObj& workerCommand,
+            const BSONObj& vlsFields,
+            const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+        /**
+         * Informs this object of the fields needed by the stages of the threads.
+         *
+         * @param deps The output of DocumentSource::parseDeps.
+         */
+        void setDependencies(const ParsedDeps& deps);
+
+    private:
+        DocumentSourceVLSParallelScan(
+            const string& ns,
+            const BSONObj& query,
+            const BSONObj& workerCommand,
+            const BSONObj& vlsFields,
+            const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+        /* Runs the whole scan, filling _partials */
+        void scan();
+
+        /* Counts a partial group kept by the scan against the memory limit of $group */
+        void countPartial(const Document& partial);
+
+        /* Appends a partial group to _partials, within the memory limit of $group */
+        void addPartial(const Document& partial);
+
+        bool _scanned;
+        std::deque<Document> _partials;
+        size_t _partialsBytes; // approximate size of _partials
+
+        BSONObj _query;
+        BSONObj _workerCommand;
+        BSONObj _vlsFields;
+        bool _haveDeps;
+        ParsedDeps _dependencies;
+
+        string _ns; // namespace
+    };
+
+    // --------- VLS --------- //
+
+
     class DocumentSourceGroup : public DocumentSource
                               , public SplittableDocumentSource {
     public:
@@ -493,6 +577,15 @@ namespace mongo {
         /// Tell this source if it is doing a merge from shards. Defaults to false.
         void setDoingMerge(bool doingMerge) { _doingMerge = doingMerge; }
 
+        // --------- VLS --------- //
+
+        /// The accumulator factories, in the order of the fields of serialize().
+        const vector<intrusive_ptr<Accumulator> (*)()>& getAccumulatorFactories() const {
+            return vpAccumulatorFactory;
+        }
+
+        // --------- VLS --------- //
+
         /**
           Create a grouping DocumentSource from BSON.
 
@@ -520,6 +613,13 @@ namespace mongo {
         /// Spill groups map to disk and returns an iterator to the file.
         shared_ptr<Sorter<Value, Value>::Iterator> spill();
 
+        // --------- VLS --------- //
+
+        /// Passes the batched inputs of the group of a constant key to its accumulators.
+        void flushBatches(vector<NumericBatch>& batches);
+
+        // --------- VLS --------- //
+
         // Only used by spill. Would be function-local if that were legal in C++03.
         class SpillSTLComparator;
 
@@ -359,11 +359,27 @@ namespace mongo {
         vector<shared_ptr<Sorter<Value, Value>::Iterator> > sortedFiles;
         int memoryUsageBytes = 0;
 
+        // --------- VLS --------- //
+
+        // With a constant key, all the documents go to one group, and the
+        // accumulators that can take batches get their inputs in batches
+        vector<NumericBatch> batches;
+        vector<bool> batched;
+        if (!_doingMerge && dynamic_cast<ExpressionConstant*>(pIdExpression.get())) {
+            for (size_t i = 0; i < numAccumulators; i++) {
+                batched.push_back(vpAccumulatorFactory[i]()->canProcessBatch());
+            }
+            batches.resize(numAccumulators);
+        }
+
+        // --------- VLS --------- //
+
         // This loop consumes all input from pSource and buckets it based on pIdExpression.
         while (boost::optional<Document> input = pSource->getNext()) {
             if (memoryUsageBytes > _maxMemoryUsageBytes) {
                 uassert(16945, "Exceeded memory limit for $group, but didn't allow external sort",
                         _extSortAllowed);
+                flushBatches(batches);
                 sortedFiles.push_back(spill());
                 memoryUsageBytes = 0;
             }
@@ -403,7 +419,22 @@ namespace mongo {
             /* tickle all the accumulators for the group we found */
             dassert(numAccumulators == group.size());
             for (size_t i = 0; i < numAccumulators; i++) {
-                group[i]->process(vpExpression[i]->evaluate(_variables.get()), _doingMerge);
+                Value value = vpExpression[i]->evaluate(_variables.get());
+                if (!batches.empty() && batched[i]) {
+                    if (batches[i].append(value)) {
+                        if (batches[i].full()) {
+                            group[i]->processBatch(batches[i]);
+                            batches[i].clear();
+                        }
+                        memoryUsageBytes += group[i]->memUsageForSorter();
+                        continue;
+                    }
+
+                    // a value of another type: the batch goes first
+                    group[i]->processBatch(batches[i]);
+                    batches[i].clear();
+                }
+                group[i]->process(value, _doingMerge);
                 memoryUsageBytes += group[i]->memUsageForSorter();
             }
 
@@ -417,11 +448,14 @@ namespace mongo {
                         && !_extSortAllowed // don't change behavior when testing external sort
                         && sortedFiles.size() < 20 // don't open too many FDs
                         ) {
+                    flushBatches(batches);
                     sortedFiles.push_back(spill());
                 }
             }
         }
 
+        flushBatches(batches);
+
         // These blocks do any final steps necessary to prepare to output results.
         if (!sortedFiles.empty()) {
             _spilled = true;
@@ -452,6 +486,20 @@ namespace mongo {
         populated = true;
     }
 
+    void DocumentSourceGroup::flushBatches(vector<NumericBatch>& batches) {
+        if (batches.empty() || groups.empty())
+            return;
+
+        // a constant key: the only group
+        Accumulators& group = groups.begin()->second;
+        for (size_t i = 0; i < batches.size(); i++) {
+            if (!batches[i].empty()) {
+                group[i]->processBatch(batches[i]);
+                batches[i].clear();
+            }
+        }
+    }
+
     class DocumentSourceGroup::SpillSTLComparator {
     public:
         bool operator() (const GroupsMap::value_type* lhs, const GroupsMap::value_type* rhs) const {
@@ -0,0 +1,537 @@
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/pipeline/document_source.h"
+
+#include "mongo/db/clientcursor.h"
+#include "mongo/db/instance.h"
+#include "mongo/db/interrupt_status.h"
+#include "mongo/db/matcher.h"
+#include "mongo/db/pdfile.h"
+#include "mongo/db/pipeline/document.h"
+#include "mongo/db/pipeline/pipeline.h"
+#include "mongo/db/query/get_runner.h"
+#include "mongo/db/query/runner.h"
+#include "mongo/db/storage/extent.h"
+#include "mongo/db/storage/extent_manager.h"
+#include "mongo/db/storage/record.h"
+#include "mongo/db/storage_options.h"
+#include "mongo/db/structure/collection.h"
+#include "mongo/util/fail_point_service.h"
+
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+#include "tbb/task_scheduler_init.h"
+
+namespace mongo {
+
+    // Holds the scan after it took its bit, before it reads any record, for testing.
+    MONGO_FP_DECLARE(vlsParallelScanHangAfterStart);
+
+namespace {
+
+    /* The threads of the scan have no Client, so their stages cannot check
+       for killOp(); the scan checks for it between batches instead. */
+    class NoInterruptStatus : public InterruptStatus {
+    public:
+        virtual void checkForInterrupt() const { }
+        virtual const char *checkForInterruptNoAssert() const { return ""; }
+    };
+
+    const NoInterruptStatus noInterruptStatus;
+
+    intrusive_ptr<ExpressionContext> workerContext(const string& ns) {
+        return new ExpressionContext(noInterruptStatus, NamespaceString(ns));
+    }
+
+    /* Parses the stages a thread runs over the documents of source */
+    intrusive_ptr<Pipeline> workerPipeline(const BSONObj& command,
+                                           const intrusive_ptr<ExpressionContext>& pCtx,
+                                           const intrusive_ptr<DocumentSource>& source) {
+        string errmsg;
+        intrusive_ptr<Pipeline> pipeline = Pipeline::parseCommand(errmsg, command, pCtx);
+        uassert(17330, str::stream() << "cannot parse the stages of the VLS parallel scan: "
+                                     << errmsg,
+                pipeline);
+        pipeline->addInitialSource(source);
+        pipeline->stitch();
+        return pipeline;
+    }
+
+    /* Records each thread of the scan reads per lock hold, so that writers
+       are not held off for whole extents */
+    const int chunkRecords = 4096;
+
+    /* An extent the scan is reading: the record it reads next, null once the
+       extent is read, and the partial groups of the records read so far */
+    struct ExtentCursor {
+        DiskLoc extent;
+        DiskLoc position;
+        std::vector<Document> partials;
+    };
+
+    /* Documents of the next records of one extent that the scan has to read,
+       at most chunkRecords from *position, which is moved past them. Only
+       touches the mapped files and the status masks, since it runs in the
+       threads of the scan (DiskLoc::rec() and Record::data() need a Client). */
+    class ExtentScanSource : public DocumentSource {
+    public:
+        ExtentScanSource(const intrusive_ptr<ExpressionContext>& pExpCtx,
+                         Collection* collection,
+                         ExtentManager* em,
+                         DiskLoc* position,
+                         int scanWord,
+                         uint64_t scanStableMask,
+                         uint64_t scanMask,
+                         const BSONObj& query,
+                         const DocumentSource::ParsedDeps* deps)
+            : DocumentSource(pExpCtx)
+            , _collection(collection)
+            , _em(em)
+            , _position(position)
+            , _records(0)
+            , _scanWord(scanWord)
+            , _scanStableMask(scanStableMask)
+            , _scanMask(scanMask)
+            , _matcher(query.isEmpty() ? NULL : new Matcher(query))
+            , _deps(deps)
+        {}
+
+        virtual boost::optional<Document> getNext() {
+            while (!_position->isNull() && _records < chunkRecords) {
+                DiskLoc loc = *_position;
+                Record* record = _em->recordFor(loc);
+                int nextOfs = record->np()->nextOfs;
+                *_position = nextOfs == DiskLoc::NullOfs ? DiskLoc() : DiskLoc(loc.a(), nextOfs);
+                ++_records;
+
+                if (!_collection->claimRecordForScan(loc, _scanWord, _scanStableMask, _scanMask))
+                    continue;
+
+                BSONObj obj(record->dataNoThrowing());
+                if (_matcher && !_matcher->matches(obj))
+                    continue;
+
+                return _deps ? documentFromBsonWithDeps(obj, *_deps) : Document(obj);
+            }
+            return boost::none;
+        }
+
+        virtual const char *getSourceName() const { return "$vlsExtentScan"; }
+        virtual void setSource(DocumentSource *pSource) { verify(false); }
+        virtual bool isValidInitialSource() const { return true; }
+
+    private:
+        virtual Value serialize(bool explain = false) const { return Value(); }
+
+        Collection* _collection;
+        ExtentManager* _em;
+        DiskLoc* _position;
+        int _records;
+        int _scanWord;
+        uint64_t _scanStableMask;
+        uint64_t _scanMask;
+        scoped_ptr<Matcher> _matcher;
+        const DocumentSource::ParsedDeps* _deps;
+    };
+
+    /* Moves the cursors of the scan past the records deleted, or moved by
+       updates, while the scan does not hold the lock, as FlatIterator does.
+       Only registered with ClientCursor for its notifications, never run. */
+    class ExtentCursorsRunner : public Runner {
+    public:
+        ExtentCursorsRunner(const string& ns, ExtentManager* em, std::deque<ExtentCursor>* cursors)
+            : _ns(ns), _em(em), _cursors(cursors), _killed(false) { }
+
+        virtual void invalidate(const DiskLoc& dl) {
+            if (_killed)
+                return;
+            for (size_t i = 0; i < _cursors->size(); ++i) {
+                DiskLoc& position = (*_cursors)[i].position;
+                if (position == dl) {
+                    int nextOfs = _em->recordFor(dl)->np()->nextOfs;
+                    position = nextOfs == DiskLoc::NullOfs ? DiskLoc() : DiskLoc(dl.a(), nextOfs);
+                }
+            }
+        }
+
+        virtual void kill() { _killed = true; }
+        bool killed() const { return _killed; }
+
+        virtual const string& ns() { return _ns; }
+        virtual void setYieldPolicy(YieldPolicy policy) { }
+        virtual RunnerState getNext(BSONObj* objOut, DiskLoc* dlOut) { return Runner::RUNNER_DEAD; }
+        virtual bool isEOF() { return true; }
+        virtual void saveState() { }
+        virtual bool restoreState() { return !_killed; }
+        virtual Status getExplainPlan(TypeExplain** explain) const {
+            return Status(ErrorCodes::InternalError, "no explain for the VLS parallel scan cursors");
+        }
+
+    private:
+        string _ns;
+        ExtentManager* _em;
+        std::deque<ExtentCursor>* _cursors;
+        bool _killed;
+    };
+
+    /* Documents of the document set that the scan has to read, i.e., the
+       versions preserved for it while it ran (see CollectionScan) */
+    class RemsetScanSource : public DocumentSource {
+    public:
+        RemsetScanSource(const intrusive_ptr<ExpressionContext>& pExpCtx,
+                         Collection* collection,
+                         int scanBit,
+                         uint64_t scanEpoch,
+                         uint64_t documentSetStart,
+                         const BSONObj& query,
+                         const DocumentSource::ParsedDeps* deps)
+            : DocumentSource(pExpCtx)
+            , _scanBit(scanBit)
+            , _scanEpoch(scanEpoch)
+            , _matcher(query.isEmpty() ? NULL : new Matcher(query))
+            , _deps(deps) {
+            DocumentSet* documentSet = collection->getDocumentSet();
+            _cursor = documentSet->cursor(documentSetStart, documentSet->end());
+        }
+
+        virtual boost::optional<Document> getNext() {
+            while (_cursor.more()) {
+                const queue_document& queueDocument = _cursor.next();
+                if (queueDocument.queueStatusMask.test(_scanBit) ||
+                    queueDocument.epoch < _scanEpoch)
+                    continue;
+
+                BSONObj obj = _cursor.document();
+                if (_matcher && !_matcher->matches(obj))
+                    continue;
+
+                return _deps ? documentFromBsonWithDeps(obj, *_deps) : Document(obj);
+            }
+            return boost::none;
+        }
+
+        virtual const char *getSourceName() const { return "$vlsRemsetScan"; }
+        virtual void setSource(DocumentSource *pSource) { verify(false); }
+        virtual bool isValidInitialSource() const { return true; }
+
+    private:
+        virtual Value serialize(bool explain = false) const { return Value(); }
+
+        int _scanBit;
+        uint64_t _scanEpoch;
+        DocumentSet::Cursor _cursor;
+        scoped_ptr<Matcher> _matcher;
+        const DocumentSource::ParsedDeps* _deps;
+    };
+
+    /* Runs the pipeline of each extent of a batch; errors are kept per
+       extent, since exceptions must not cross the TBB workers */
+    class ExtentScanTask {
+    public:
+        ExtentScanTask(std::vector< intrusive_ptr<Pipeline> >* pipelines,
+                       std::vector< std::vector<Document> >* partials,
+                       std::vector<Status>* statuses)
+            : _pipelines(pipelines), _partials(partials), _statuses(statuses) { }
+
+        void operator()(const tbb::blocked_range<size_t>& r) const {
+            for (size_t i = r.begin(); i != r.end(); ++i) {
+                try {
+                    DocumentSource* output = (*_pipelines)[i]->output();
+                    while (boost::optional<Document> next = output->getNext())
+                        (*_partials)[i].push_back(*next);
+                }
+                catch (const DBException& e) {
+                    (*_statuses)[i] = e.toStatus();
+                }
+                catch (const std::exception& e) {
+                    (*_statuses)[i] = Status(ErrorCodes::InternalError, e.what());
+                }
+            }
+        }
+
+    private:
+        std::vector< intrusive_ptr<Pipeline> >* _pipelines;
+        std::vector< std::vector<Document> >* _partials;
+        std::vector<Status>* _statuses;
+    };
+
+} // namespace
+
+    DocumentSourceVLSParallelScan::DocumentSourceVLSParallelScan(
+        const string& ns,
+        const BSONObj& query,
+        const BSONObj& workerCommand,
+        const BSONObj& vlsFields,
+        const intrusive_ptr<ExpressionContext> &pExpCtx)
+        : DocumentSource(pExpCtx)
+        , _scanned(false)
+        , _partialsBytes(0)
+        , _query(query.getOwned())
+        , _workerCommand(workerCommand.getOwned())
+        , _vlsFields(vlsFields.getOwned())
+        , _haveDeps(false)
+        , _ns(ns)
+    {}
+
+    intrusive_ptr<DocumentSourceVLSParallelScan> DocumentSourceVLSParallelScan::create(
+        const string& ns,
+        const BSONObj& query,
+        const BSONObj& workerCommand,
+        const BSONObj& vlsFields,
+        const intrusive_ptr<ExpressionContext> &pExpCtx) {
+        return new DocumentSourceVLSParallelScan(ns, query, workerCommand, vlsFields, pExpCtx);
+    }
+
+    const char *DocumentSourceVLSParallelScan::getSourceName() const {
+        return "$vlsParallelScan";
+    }
+
+    void DocumentSourceVLSParallelScan::setSource(DocumentSource *pSource) {
+        /* this doesn't take a source */
+        verify(false);
+    }
+
+    void DocumentSourceVLSParallelScan::setDependencies(const ParsedDeps& deps) {
+        _dependencies = deps;
+        _haveDeps = true;
+    }
+
+    boost::optional<Document> DocumentSourceVLSParallelScan::getNext() {
+        pExpCtx->checkForInterrupt();
+
+        if (!_scanned) {
+            scan();
+            _scanned = true;
+        }
+
+        if (_partials.empty())
+            return boost::none;
+
+        Document out = _partials.front();
+        _partials.pop_front();
+        return out;
+    }
+
+    void DocumentSourceVLSParallelScan::dispose() {
+        _scanned = true;
+        _partials.clear();
+        _partialsBytes = 0;
+    }
+
+    void DocumentSourceVLSParallelScan::countPartial(const Document& partial) {
+        // every chunk of records (and the document set) adds its own partial
+        // groups until the final $group merges them, so they are bounded the
+        // way DocumentSourceGroup bounds its groups
+        const size_t maxPartialsBytes = 100*1024*1024;
+        _partialsBytes += partial.getApproximateSize();
+        uassert(16945, "Exceeded memory limit for $group, but didn't allow external sort",
+                _partialsBytes <= maxPartialsBytes);
+    }
+
+    void DocumentSourceVLSParallelScan::addPartial(const Document& partial) {
+        countPartial(partial);
+        _partials.push_back(partial);
+    }
+
+    Value DocumentSourceVLSParallelScan::serialize(bool explain) const {
+        // only built by PipelineD, so we only serialize for explain
+        if (!explain)
+            return Value();
+
+        return Value(DOC(getSourceName() <<
+                         DOC("query" << _query
+                          << "pipeline" << _workerCommand["pipeline"]
+                          << "threads" << tbb::task_scheduler_init::default_num_threads())));
+    }
+
+    void DocumentSourceVLSParallelScan::scan() {
+        const ParsedDeps* deps = _haveDeps ? &_dependencies : NULL;
+
+        Database* database = NULL;
+        Collection* collection = NULL;
+        int scanBit = 0;
+        uint64_t scanMask = 0x0;
+        uint64_t scanStableMask = 0x0;
+        uint64_t scanEpoch = 0;
+        uint64_t documentSetStart = 0;
+        bool scanBitHeld = false;
+        DiskLoc nextExtent;
+
+        try {
+            // starting the scan as CollectionScan does: one bit for all the threads
+            {
+                Lock::DBRead lk(_ns);
+                Client::Context ctx(_ns, storageGlobalParams.dbpath, /*doVersion=*/false);
+
+                database = ctx.db();
+                collection = database->getCollection(_ns);
+                uassert(17331, "collection dropped before the VLS parallel scan started",
+                        collection && collection->vlsEnabled);
+
+                collection->initializeStatusMaskMap();
+                collection->getDocumentSet();
+
+                scanBit = Collection::acquireScanBit(_ns, &database, &collection);
+                uassert(17331, "collection dropped before the VLS parallel scan started",
+                        scanBit >= 0);
+                scanBitHeld = true;
+                scanMask = vls_mask::bitOf(scanBit);
+
+                {
+                    stableMaskWriteLock smw_lock(collection->SMLock);
+                    collection->localActiveMask.reset(scanBit);
+                    scanStableMask = collection->stableMask.words[vls_mask::wordOf(scanBit)]
+                                   & scanMask;
+                    scanEpoch = collection->beginScanEpoch(scanBit);
+                    collection->setScanFields(scanBit, _vlsFields);
+                    documentSetStart = collection->getDocumentSet()->end();
+                }
+
+                nextExtent = collection->details()->firstExtent();
+            }
+
+            while (MONGO_FAIL_POINT(vlsParallelScanHangAfterStart)) {
+                sleepmillis(10);
+            }
+
+            // reading the extents, a batch of them at a time and a chunk of
+            // records of each per lock hold, so that writers run between the
+            // chunks; the extents already read are left behind by the
+            // watermark of the scan
+            const size_t batchSize = tbb::task_scheduler_init::default_num_threads();
+            const int scanWord = vls_mask::wordOf(scanBit);
+            std::deque<ExtentCursor> cursors;
+            ExtentCursorsRunner cursorsRunner(_ns, &database->getExtentManager(), &cursors);
+            ScopedRunnerRegistration registration(&cursorsRunner);
+            while (!nextExtent.isNull() || !cursors.empty()) {
+                pExpCtx->interruptStatus.checkForInterrupt();
+
+                Lock::DBRead lk(_ns);
+                Client::Context ctx(_ns, storageGlobalParams.dbpath, /*doVersion=*/false);
+                uassert(17332, "collection dropped during the VLS parallel scan",
+                        !cursorsRunner.killed() && ctx.db() == database
+                        && database->getCollection(_ns) == collection);
+
+                ExtentManager* em = &database->getExtentManager();
+                for (; !nextExtent.isNull() && cursors.size() < batchSize;
+                       nextExtent = em->getExtent(nextExtent)->xnext) {
+                    Extent* e = em->getExtent(nextExtent);
+                    if (e->firstRecord.isNull())
+                        continue;
+
+                    cursors.push_back(ExtentCursor());
+                    cursors.back().extent = nextExtent;
+                    cursors.back().position = e->firstRecord;
+                }
+
+                std::vector< intrusive_ptr<Pipeline> > pipelines;
+                for (size_t i = 0; i < cursors.size(); ++i) {
+                    intrusive_ptr<ExpressionContext> pCtx = workerContext(_ns);
+                    intrusive_ptr<DocumentSource> source(
+                        new ExtentScanSource(pCtx, collection, em, &cursors[i].position,
+                                             scanWord, scanStableMask, scanMask, _query, deps));
+                    pipelines.push_back(workerPipeline(_workerCommand, pCtx, source));
+                }
+
+                std::vector< std::vector<Document> > partials(pipelines.size());
+                std::vector<Status> statuses(pipelines.size(), Status::OK());
+                tbb::parallel_for(tbb::blocked_range<size_t>(0, pipelines.size(), 1),
+                                  ExtentScanTask(&pipelines, &partials, &statuses));
+
+                for (size_t i = 0; i < pipelines.size(); ++i) {
+                    uassertStatusOK(statuses[i]);
+                    for (size_t j = 0; j < partials[i].size(); ++j) {
+                        countPartial(partials[i][j]);
+                        cursors[i].partials.push_back(partials[i][j]);
+                    }
+                }
+
+                // the partial groups keep the order of the extents, so that
+                // $first and $last see the documents in natural order
+                while (!cursors.empty() && cursors.front().position.isNull()) {
+                    std::vector<Document>& extentPartials = cursors.front().partials;
+                    _partials.insert(_partials.end(), extentPartials.begin(), extentPartials.end());
+                    cursors.pop_front();
+                }
+
+                // every record of the extents before the first one still
+                // being read was read
+                collection->advanceScanWatermark(scanBit, cursors.empty() ? nextExtent
+                                                                          : cursors.front().extent);
+            }
+
+            // reading the document set, then ending the scan
+            {
+                Lock::DBRead lk(_ns);
+                Client::Context ctx(_ns, storageGlobalParams.dbpath, /*doVersion=*/false);
+                uassert(17333, "collection dropped during the VLS parallel scan",
+                        ctx.db() == database && database->getCollection(_ns) == collection);
+
+                intrusive_ptr<ExpressionContext> pCtx = workerContext(_ns);
+                intrusive_ptr<DocumentSource> source(
+                    new RemsetScanSource(pCtx, collection, scanBit, scanEpoch,
+                                         documentSetStart, _query, deps));
+                intrusive_ptr<Pipeline> pipeline = workerPipeline(_workerCommand, pCtx, source);
+                DocumentSource* output = pipeline->output();
+                while (boost::optional<Document> next = output->getNext())
+                    addPartial(*next);
+
+                uint64_t oldestEpoch;
+                {
+                    stableMaskWriteLock smw_lock(collection->SMLock);
+                    collection->localActiveMask.set(scanBit);
+                    collection->stableMask.flip(scanBit);
+                    oldestEpoch = collection->endScanEpoch(scanBit);
+                }
+                collection->reclaimDocumentSet(oldestEpoch);
+
+                database->activeMask.release(scanBit);
+                scanBitHeld = false;
+            }
+        }
+        catch (...) {
+            // giving the bit back, as a collection scan that stops early does
+            _partials.clear();
+            _partialsBytes = 0;
+            if (scanBitHeld) {
+                Lock::DBRead lk(_ns);
+                Client::Context ctx(_ns, storageGlobalParams.dbpath, /*doVersion=*/false);
+                if (ctx.db() == database) {
+                    if (database->getCollection(_ns) == collection)
+                        collection->abandonVLSScan(database, scanBit, scanStableMask, true);
+                    else
+                        database->activeMask.release(scanBit);
+                }
+            }
+            throw;
+        }
+    }
+}
@@ -59,18 +59,42 @@
 #include "mongo/db/pipeline/pipeline_d.h"
 
 #include "mongo/client/dbclientinterface.h"
+#include "mongo/db/exec/collection_scan.h"
+#include "mongo/db/exec/group_scan.h"
+#include "mongo/db/exec/working_set.h"
+#include "mongo/db/index/index_descriptor.h"
 #include "mongo/db/instance.h"
+#include "mongo/db/matcher/expression_parser.h"
 #include "mongo/db/pdfile.h"
 #include "mongo/db/pipeline/document_source.h"
 #include "mongo/db/pipeline/pipeline.h"
+#include "mongo/db/query/canonical_query.h"
 #include "mongo/db/query/get_runner.h"
+#include "mongo/db/query/internal_runner.h"
 #include "mongo/db/query/query_planner.h"
+#include "mongo/db/queryutil.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/db/structure/collection.h"
 #include "mongo/s/d_logic.h"
 
 #include "mongo/db/server_options.h" // get index global param
 
 namespace mongo {
 
+    // --------- VLS --------- //
+
+    /* Aggregates starting with $match, $project and $group stages read
+       VLS-enabled collections with several threads (see
+       DocumentSourceVLSParallelScan), e.g. --setParameter vlsParallelScan=true */
+    MONGO_EXPORT_SERVER_PARAMETER(vlsParallelScan, bool, false);
+
+    /* Aggregates made of $project stages followed by a $group that only read
+       top-level fields and constants run the $group in the collection scan (see
+       GroupScanStage), unless --setParameter aggregateGroupScan=false */
+    MONGO_EXPORT_SERVER_PARAMETER(aggregateGroupScan, bool, true);
+
+    // --------- VLS --------- //
+
 namespace {
     class MongodImplementation : public DocumentSourceNeedsMongod::MongodInterface {
     public:
@@ -90,6 +114,88 @@ namespace {
     private:
         DBDirectClient _client;
     };
+
+    // --------- VLS --------- //
+
+    /* Whether the query planner answers 'queryObj' with an index of
+       'collection' rather than a collection scan. The _id index only counts
+       for an _id equality: a collection scan reads a range of _id as well. */
+    bool indexAnswersQuery(Collection* collection, const string& ns, const BSONObj& queryObj) {
+        if (queryObj.isEmpty())
+            return false;
+        if (isSimpleIdQuery(queryObj))
+            return true;
+
+        // an invalid query fails later, in the runner of the pipeline
+        CanonicalQuery* rawCanonicalQuery;
+        if (!CanonicalQuery::canonicalize(ns, queryObj, &rawCanonicalQuery).isOK())
+            return false;
+        scoped_ptr<CanonicalQuery> canonicalQuery(rawCanonicalQuery);
+
+        QueryPlannerParams plannerParams;
+        plannerParams.options = QueryPlannerParams::NO_TABLE_SCAN;
+        IndexCatalog::IndexIterator it = collection->getIndexCatalog()->getIndexIterator(false);
+        while (it.more()) {
+            IndexDescriptor* desc = it.next();
+            if (desc->isIdIndex())
+                continue;
+            plannerParams.indices.push_back(IndexEntry(desc->keyPattern(),
+                                                       desc->isMultikey(),
+                                                       desc->isSparse(),
+                                                       desc->indexName(),
+                                                       desc->infoObj()));
+        }
+        if (plannerParams.indices.empty())
+            return false;
+
+        // without a table scan, the planner only outputs indexed solutions
+        vector<QuerySolution*> solutions;
+        Status status = QueryPlanner::plan(*canonicalQuery, plannerParams, &solutions);
+        for (size_t i = 0; i < solutions.size(); ++i) {
+            delete solutions[i];
+        }
+        return status.isOK() && !solutions.empty();
+    }
+
+    /* Resolves 'expr', the serialized input of a $group preceded by the
+       serialized $project stages 'projects', to a constant or to a top-level
+       field of the documents of the collection; returns false if it is
+       neither. */
+    bool resolveGroupInput(const vector<Document>& projects, Value expr,
+                           string* field, Value* constant) {
+        for (size_t p = projects.size(); ; --p) {
+            if (expr.getType() == Object) {
+                const Document spec = expr.getDocument();
+                if (spec.size() != 1 || spec["$const"].missing())
+                    return false;
+                *constant = spec["$const"];
+                field->clear();
+                return true;
+            }
+
+            // only "$field", not "$$ROOT.field" nor a dotted path
+            if (expr.getType() != String)
+                return false;
+            const string path = expr.getString();
+            if (path.size() < 2 || path[0] != '$' || path[1] == '$'
+                    || path.find('.') != string::npos)
+                return false;
+
+            if (p == 0) {
+                *field = path.substr(1);
+                return true;
+            }
+
+            // _id is included unless the $project excludes it
+            const Value projected = projects[p - 1][path.substr(1)];
+            if (projected.missing() && path == "$_id")
+                continue;
+            if (!(projected.getType() == Bool && projected.getBool()))
+                expr = projected;
+        }
+    }
+
+    // --------- VLS --------- //
 }
 
     void PipelineD::prepareCursorSource(
@@ -137,6 +243,7 @@ namespace {
         bool haveProjection = false;
         bool needQueryProjection = false; // true if we need to send the project to query system
         BSONObj projection;
+        BSONObj vlsFields; // top-level fields read by the pipeline, for VLS
         DocumentSource::ParsedDeps dependencies;
         {
             const bool isTextQuery = DocumentSourceMatch::isTextQuery(queryObj);
@@ -161,6 +268,20 @@ namespace {
                 projection = DocumentSource::depsToProjection(deps);
                 dependencies = DocumentSource::parseDeps(deps);
                 haveProjection = true;
+
+                // --------- VLS --------- //
+
+                // updates only need to preserve these fields for the VLS scans
+                if (!isTextQuery) {
+                    BSONObjBuilder fields;
+                    fields.append("_id", true); // never empty, even if no field is read
+                    for (set<string>::const_iterator it = deps.begin(); it != deps.end(); ++it) {
+                        fields.append(it->substr(0, it->find('.')), true);
+                    }
+                    vlsFields = fields.obj();
+                }
+
+                // --------- VLS --------- //
             }
             else if (isTextQuery) {
                 // We still need score even if we don't know what actual fields are needed.
@@ -203,6 +324,17 @@ namespace {
         // Note: this may throw if the sharding version for this connection is out of date.
         Client::ReadContext context(fullName);
 
+        // --------- VLS --------- //
+
+        if (prepareVLSParallelScan(pPipeline, pExpCtx, queryObj, vlsFields,
+                                   haveProjection ? &dependencies : NULL))
+            return;
+
+        if (prepareGroupScan(pPipeline, pExpCtx, queryObj, vlsFields))
+            return;
+
+        // --------- VLS --------- //
+
         // Create the Runner.
         //
         // If we try to create a Runner that includes both the match and the
@@ -225,8 +357,9 @@ namespace {
         // --------- VLS --------- //
         
         // Runners need the information that we are using chronos
-        // We assume that all aggregates include a full collection scan
-        // So we use VLS for all aggregates
+        // We use VLS for all aggregates: the planner picks a collection
+        // scan or an index scan for each query, and both kinds of scans
+        // take their bits from the same active mask and share one document set
         // Information goes on getRunner
         
         // --------- VLS --------- //
@@ -249,7 +382,7 @@ namespace {
                                              needQueryProjection ? projection : BSONObj(),
                                              &cq));
             Runner* rawRunner;
-            if (getRunner(cq, &rawRunner, runnerOptions).isOK()) {
+            if (getRunner(cq, &rawRunner, runnerOptions, true, vlsFields).isOK()) {
                 // success: The Runner will handle sorting for us using an index.
                 runner.reset(rawRunner);
                 sortInRunner = true;
@@ -273,7 +406,7 @@ namespace {
                                              &cq));
 
             Runner* rawRunner;
-            uassertStatusOK(getRunner(cq, &rawRunner, runnerOptions, !serverGlobalParams.chronosIndex));
+            uassertStatusOK(getRunner(cq, &rawRunner, runnerOptions, true, vlsFields));
             runner.reset(rawRunner);
         }
 
@@ -308,4 +441,199 @@ namespace {
         pPipeline->addInitialSource(pSource);
     }
 
+    bool PipelineD::prepareVLSParallelScan(
+        const intrusive_ptr<Pipeline> &pPipeline,
+        const intrusive_ptr<ExpressionContext> &pExpCtx,
+        const BSONObj& queryObj,
+        const BSONObj& vlsFields,
+        const Document* deps) {
+
+        Pipeline::SourceContainer& sources = pPipeline->sources;
+        const string& fullName = pExpCtx->ns.ns();
+
+        // the threads run their own $group, without spilling to disk, and
+        // do not filter out the documents of other shards
+        if (!vlsParallelScan
+                || DocumentSourceMatch::isTextQuery(queryObj)
+                || pExpCtx->extSortAllowed
+                || shardingState.needCollectionMetadata(fullName))
+            return false;
+
+        // look for a $group only preceded by $match and $project stages
+        size_t groupIndex = 0;
+        for (; groupIndex < sources.size(); ++groupIndex) {
+            DocumentSource* source = sources[groupIndex].get();
+            if (dynamic_cast<DocumentSourceGroup*>(source))
+                break;
+
+            DocumentSourceMatch* match = dynamic_cast<DocumentSourceMatch*>(source);
+            if (!(match && !match->isTextQuery())
+                    && !dynamic_cast<DocumentSourceProject*>(source))
+                return false;
+        }
+        if (groupIndex == sources.size())
+            return false;
+
+        Collection* collection = cc().database()->getCollection(fullName);
+        if (!collection || !collection->vlsEnabled || collection->details()->isCapped())
+            return false;
+
+        // the query planner keeps the queries an index can answer
+        if (indexAnswersQuery(collection, fullName, queryObj))
+            return false;
+
+        // the scan filters on the query, so an update of a field of the query
+        // must also preserve the version the scan reads
+        BSONObj scanFields = vlsFields;
+        if (!vlsFields.isEmpty() && !queryObj.isEmpty()) {
+            StatusWithMatchExpression swme = MatchExpressionParser::parse(queryObj);
+            uassertStatusOK(swme.getStatus());
+            scoped_ptr<MatchExpression> filter(swme.getValue());
+            scanFields = vlsScanFields(vlsFields, filter.get());
+        }
+
+        // each thread runs the stages up to the $group as a shard would
+        vector<Value> stages;
+        for (size_t i = 0; i <= groupIndex; ++i) {
+            sources[i]->serializeToArray(stages);
+        }
+        MutableDocument command;
+        command["aggregate"] = Value(pExpCtx->ns.coll());
+        command["pipeline"] = Value::consume(stages);
+        command["fromRouter"] = Value(true);
+
+        intrusive_ptr<DocumentSourceVLSParallelScan> pSource(
+            DocumentSourceVLSParallelScan::create(fullName,
+                                                  queryObj,
+                                                  command.freeze().toBson(),
+                                                  scanFields,
+                                                  pExpCtx));
+        if (deps)
+            pSource->setDependencies(*deps);
+
+        SplittableDocumentSource* group =
+            dynamic_cast<SplittableDocumentSource*>(sources[groupIndex].get());
+        intrusive_ptr<DocumentSource> merger = group->getMergeSource();
+        sources.erase(sources.begin(), sources.begin() + groupIndex + 1);
+        sources.push_front(merger);
+
+        pPipeline->addInitialSource(pSource);
+        return true;
+    }
+
+    bool PipelineD::prepareGroupScan(
+        const intrusive_ptr<Pipeline> &pPipeline,
+        const intrusive_ptr<ExpressionContext> &pExpCtx,
+        const BSONObj& queryObj,
+        const BSONObj& vlsFields) {
+
+        Pipeline::SourceContainer& sources = pPipeline->sources;
+        const string& fullName = pExpCtx->ns.ns();
+
+        // the stage does not filter out the documents of other shards
+        if (!aggregateGroupScan
+                || DocumentSourceMatch::isTextQuery(queryObj)
+                || shardingState.needCollectionMetadata(fullName))
+            return false;
+
+        // look for a $group only preceded by $project stages
+        vector<Document> projects;
+        size_t groupIndex = 0;
+        for (; groupIndex < sources.size(); ++groupIndex) {
+            DocumentSourceProject* project =
+                dynamic_cast<DocumentSourceProject*>(sources[groupIndex].get());
+            if (!project)
+                break;
+            projects.push_back(
+                project->serialize().getDocument()[project->getSourceName()].getDocument());
+        }
+        if (groupIndex == sources.size())
+            return false;
+
+        DocumentSourceGroup* group = dynamic_cast<DocumentSourceGroup*>(sources[groupIndex].get());
+        if (!group)
+            return false;
+
+        const Document groupSpec =
+            group->serialize().getDocument()[group->getSourceName()].getDocument();
+        if (!groupSpec["$doingMerge"].missing())
+            return false;
+
+        // the key and the accumulators must read top-level fields or constants
+        GroupScanParams params;
+        if (!resolveGroupInput(projects, groupSpec["_id"], &params.idField, &params.idConstant))
+            return false;
+
+        FieldIterator fields(groupSpec);
+        fields.next(); // _id
+        while (fields.more()) {
+            const Document::FieldPair field = fields.next();
+            string inputField;
+            Value inputConstant;
+            if (!resolveGroupInput(projects,
+                                   FieldIterator(field.second.getDocument()).next().second,
+                                   &inputField,
+                                   &inputConstant))
+                return false;
+
+            params.fieldNames.push_back(field.first.toString());
+            params.inputFields.push_back(inputField);
+            params.inputConstants.push_back(inputConstant);
+        }
+        params.accumulatorFactories = group->getAccumulatorFactories();
+        params.mergeableOutput = pExpCtx->inShard;
+
+        // one group per value of a field may have to be spilled to disk
+        if (!params.idField.empty() && pExpCtx->extSortAllowed)
+            return false;
+
+        Collection* collection = cc().database()->getCollection(fullName);
+        if (!collection)
+            return false;
+
+        // the query planner keeps the queries an index can answer
+        if (indexAnswersQuery(collection, fullName, queryObj))
+            return false;
+
+        auto_ptr<MatchExpression> filter;
+        if (!queryObj.isEmpty()) {
+            StatusWithMatchExpression swme = MatchExpressionParser::parse(queryObj);
+            uassertStatusOK(swme.getStatus());
+            filter.reset(swme.getValue());
+        }
+
+        const BSONObj scanFields = vlsFields.isEmpty() || !filter.get()
+                                 ? vlsFields
+                                 : vlsScanFields(vlsFields, filter.get());
+
+        CollectionScanParams scanParams;
+        scanParams.ns = fullName;
+        auto_ptr<WorkingSet> ws(new WorkingSet());
+        PlanStage* scan = new CollectionScan(scanParams, ws.get(), filter.get(), true, scanFields);
+        PlanStage* root = new GroupScanStage(params, ws.get(), scan, filter.release());
+        auto_ptr<Runner> runner(new InternalRunner(fullName, root, ws.release()));
+
+        // as in prepareCursorSource()
+        auto_ptr<ClientCursor> cursor(
+            new ClientCursor(runner.release(), QueryOption_NoCursorTimeout));
+        verify(cursor->getRunner());
+        CursorId cursorId = cursor->cursorid();
+
+        cursor->getRunner()->setYieldPolicy(Runner::YIELD_AUTO);
+        cursor->getRunner()->saveState();
+        cursor.release(); // it is now owned by the client cursor manager
+
+        intrusive_ptr<DocumentSourceCursor> pSource(
+            DocumentSourceCursor::create(fullName, cursorId, pExpCtx));
+        pSource->setQuery(queryObj);
+
+        sources.erase(sources.begin(), sources.begin() + groupIndex + 1);
+        while (!sources.empty() && pSource->coalesce(sources.front())) {
+            sources.pop_front();
+        }
+
+        pPipeline->addInitialSource(pSource);
+        return true;
+    }
+
 } // namespace mongo
@@ -31,10 +31,22 @@
 #include "mongo/pch.h"
 
 namespace mongo {
+    class BSONObj;
+    class Document;
     class DocumentSourceCursor;
     struct ExpressionContext;
     class Pipeline;
 
+    // --------- VLS --------- //
+
+    /* 'vlsParallelScan' server parameter (see prepareVLSParallelScan()) */
+    extern bool vlsParallelScan;
+
+    /* 'aggregateGroupScan' server parameter (see prepareGroupScan()) */
+    extern bool aggregateGroupScan;
+
+    // --------- VLS --------- //
+
     /*
       PipelineD is an extension of the Pipeline class, but with additional
       material that references symbols that are not available in mongos,
@@ -69,6 +81,46 @@ namespace mongo {
 
     private:
         PipelineD(); // does not exist:  prevent instantiation
+
+        // --------- VLS --------- //
+
+        /**
+         * Replaces the leading stages of the pipeline, up to its first $group,
+         * with a DocumentSourceVLSParallelScan followed by the merging side of
+         * the $group, if the 'vlsParallelScan' server parameter is set and the
+         * pipeline and the collection allow it.  Requires a read lock.
+         *
+         * @param queryObj the initial query, already removed from the pipeline
+         * @param vlsFields the top-level fields read by the pipeline
+         * @param deps the parsed dependencies of the pipeline, or NULL
+         * @returns whether the pipeline now starts with the parallel scan
+         */
+        static bool prepareVLSParallelScan(
+            const intrusive_ptr<Pipeline> &pPipeline,
+            const intrusive_ptr<ExpressionContext> &pExpCtx,
+            const BSONObj& queryObj,
+            const BSONObj& vlsFields,
+            const Document* deps);
+
+        /**
+         * Replaces the leading $project stages and the $group that follows them
+         * with a DocumentSourceCursor over a GroupScanStage, which groups the
+         * documents of a collection scan without building a Document for each of
+         * them, if the 'aggregateGroupScan' server parameter is set and the $group
+         * only reads top-level fields of the collection and constants.  Requires
+         * a read lock.
+         *
+         * @param queryObj the initial query, already removed from the pipeline
+         * @param vlsFields the top-level fields read by the pipeline
+         * @returns whether the pipeline now starts with the grouping cursor
+         */
+        static bool prepareGroupScan(
+            const intrusive_ptr<Pipeline> &pPipeline,
+            const intrusive_ptr<ExpressionContext> &pExpCtx,
+            const BSONObj& queryObj,
+            const BSONObj& vlsFields);
+
+        // --------- VLS --------- //
     };
 
 } // namespace mongo
@@ -48,6 +48,24 @@ namespace mongo {
             }
         }
 
+        // --------- VLS --------- //
+
+        // Only scans that read through a VLS snapshot have anything to report
+        void appendVLSStats(uint64_t docsFromRemset, uint64_t docsSkipped,
+                            uint64_t bitWaitMillis, TypeExplain* res) {
+            if (docsFromRemset == 0 && docsSkipped == 0 && bitWaitMillis == 0) {
+                return;
+            }
+
+            BSONObjBuilder bob;
+            bob.appendNumber("docsFromRemset", static_cast<long long>(docsFromRemset));
+            bob.appendNumber("docsSkipped", static_cast<long long>(docsSkipped));
+            bob.appendNumber("bitWaitMillis", static_cast<long long>(bitWaitMillis));
+            res->setVLS(bob.obj());
+        }
+
+        // --------- VLS --------- //
+
     }
 
     Status explainPlan(const PlanStageStats& stats, TypeExplain** explain, bool fullDetails) {
@@ -151,6 +169,8 @@ namespace mongo {
             res->setNScanned(csStats->docsTested);
             res->setNScannedObjects(csStats->docsTested);
             res->setIndexOnly(false);
+            appendVLSStats(csStats->docsFromRemset, csStats->docsSkipped,
+                           csStats->bitWaitMillis, res.get());
         }
         else if (leaf->stageType == STAGE_GEO_NEAR_2DSPHERE) {
             // TODO: This is kind of a lie for STAGE_GEO_NEAR_2DSPHERE.
@@ -193,6 +213,8 @@ namespace mongo {
             res->setIndexBounds(indexStats->indexBounds);
             res->setIsMultiKey(indexStats->isMultiKey);
             res->setIndexOnly(covered);
+            appendVLSStats(indexStats->docsFromRemset, indexStats->docsSkipped,
+                           indexStats->bitWaitMillis, res.get());
         }
         else {
             return Status(ErrorCodes::InternalError, "cannot interpret execution plan");
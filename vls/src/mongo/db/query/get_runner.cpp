@@ -102,6 +102,37 @@ namespace mongo {
         return false;
     }
 
+    // --------- VLS --------- //
+
+    // Adds the top-level fields that 'expr' reads to 'fields'; returns false if it
+    // may read any field of the document.
+    static bool addQueryFields(const MatchExpression* expr, BSONObjBuilder* fields) {
+        if (MatchExpression::WHERE == expr->matchType() ||
+            MatchExpression::TEXT == expr->matchType()) {
+            return false;
+        }
+
+        StringData path = expr->path();
+        if (!path.empty()) {
+            size_t dot = path.find('.');
+            fields->append(dot == string::npos ? path : path.substr(0, dot), true);
+        }
+
+        for (size_t i = 0; i < expr->numChildren(); ++i) {
+            if (!addQueryFields(expr->getChild(i), fields)) { return false; }
+        }
+        return true;
+    }
+
+    BSONObj vlsScanFields(const BSONObj& vlsFields, const MatchExpression* root) {
+        BSONObjBuilder fields;
+        fields.appendElements(vlsFields);
+        if (!addQueryFields(root, &fields)) { return BSONObj(); }
+        return fields.obj();
+    }
+
+    // --------- VLS --------- //
+
     static bool canUseIDHack(const CanonicalQuery& query) {
         return !query.getParsed().isExplain()
             && !query.getParsed().showDiskLoc()
@@ -114,7 +145,8 @@ namespace mongo {
      * CachedQueryRunner, or a MultiPlanRunner, depending on the cache/query solver/etc.
      */
     Status getRunner(CanonicalQuery* rawCanonicalQuery,
-                     Runner** out, size_t plannerOptions, bool use_chronos) {
+                     Runner** out, size_t plannerOptions, bool use_chronos,
+                     const BSONObj& vlsFields) {
         verify(rawCanonicalQuery);
         Database* db = cc().database();
         verify(db);
@@ -122,7 +154,8 @@ namespace mongo {
                          rawCanonicalQuery,
                          out,
                          plannerOptions,
-                         use_chronos);
+                         use_chronos,
+                         vlsFields);
     }
 
     /**
@@ -130,7 +163,8 @@ namespace mongo {
      * CachedQueryRunner, or a MultiPlanRunner, depending on the cache/query solver/etc.
      */
     Status getRunner(Collection* collection, CanonicalQuery* rawCanonicalQuery,
-                     Runner** out, size_t plannerOptions, bool use_chronos) {
+                     Runner** out, size_t plannerOptions, bool use_chronos,
+                     const BSONObj& vlsFields) {
 
         verify(rawCanonicalQuery);
         auto_ptr<CanonicalQuery> canonicalQuery(rawCanonicalQuery);
@@ -178,6 +212,15 @@ namespace mongo {
             }
         }
 
+        // --------- VLS --------- //
+        
+        // the scans also read the fields of the query
+        BSONObj scanFields;
+        if (use_chronos && !vlsFields.isEmpty())
+            scanFields = vlsScanFields(vlsFields, canonicalQuery->root());
+        
+        // --------- VLS --------- //
+
         // Process the planning options.
         plannerParams.options = plannerOptions;
         if (storageGlobalParams.noTableScan) {
@@ -223,7 +266,7 @@ namespace mongo {
             if (status.isOK()) {
                 WorkingSet* ws;
                 PlanStage* root;
-                verify(StageBuilder::build(*qs, &root, &ws, use_chronos));
+                verify(StageBuilder::build(*qs, &root, &ws, use_chronos, scanFields));
                 *out = new CachedPlanRunner(canonicalQuery.release(), qs, root, ws);
                 return Status::OK();
             }
@@ -256,7 +299,7 @@ namespace mongo {
             // Only one possible plan.  Run it.  Build the stages from the solution.
             WorkingSet* ws;
             PlanStage* root;
-            verify(StageBuilder::build(*solutions[0], &root, &ws, use_chronos));
+            verify(StageBuilder::build(*solutions[0], &root, &ws, use_chronos, scanFields));
 
             // And, run the plan.
             *out = new SingleSolutionRunner(canonicalQuery.release(), solutions[0], root, ws);
@@ -268,7 +311,7 @@ namespace mongo {
             for (size_t i = 0; i < solutions.size(); ++i) {
                 WorkingSet* ws;
                 PlanStage* root;
-                verify(StageBuilder::build(*solutions[i], &root, &ws, use_chronos));
+                verify(StageBuilder::build(*solutions[i], &root, &ws, use_chronos, scanFields));
                 // Takes ownership of all arguments.
                 mpr->addPlan(solutions[i], root, ws);
             }
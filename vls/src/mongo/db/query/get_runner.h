@@ -70,11 +70,17 @@ namespace mongo {
      * If the query cannot be executed, returns a Status indicating why.  Deletes
      * rawCanonicalQuery.
      * 
-     * 'use_chronos' means that the query comes from an aggregate, and that
-     * it should use the Chronos algorithm if possible
+     * 'use_chronos' means that the query comes from an aggregate, or from a
+     * find, count, distinct or mapReduce that asked for {snapshot: "vls"}, and
+     * that it should use the Chronos algorithm if possible
+     *
+     * 'vlsFields', if not empty, holds the top-level fields ({field: true})
+     * that the caller reads from each document; the VLS scans then only
+     * need updates to preserve these fields and the ones of the query.
      */
     Status getRunner(CanonicalQuery* rawCanonicalQuery, Runner** out,
-                     size_t plannerOptions = 0, bool use_chronos = false);
+                     size_t plannerOptions = 0, bool use_chronos = false,
+                     const BSONObj& vlsFields = BSONObj());
 
     /**
      * Get a runner for a query.  Takes ownership of rawCanonicalQuery.
@@ -84,7 +90,19 @@ namespace mongo {
      * argument may be NULL.
      */
     Status getRunner(Collection* collection, CanonicalQuery* rawCanonicalQuery,
-                     Runner** out, size_t plannerOptions = 0, bool use_chronos = false);
+                     Runner** out, size_t plannerOptions = 0, bool use_chronos = false,
+                     const BSONObj& vlsFields = BSONObj());
+
+    // --------- VLS --------- //
+
+    /**
+     * The top-level fields ({field: true}) that a VLS scan filtered by 'root' reads:
+     * 'vlsFields' and the fields of the query, or an empty object if the query may
+     * read any field.
+     */
+    BSONObj vlsScanFields(const BSONObj& vlsFields, const MatchExpression* root);
+
+    // --------- VLS --------- //
 
     /**
      * RAII approach to ensuring that runners are deregistered in newRunQuery.
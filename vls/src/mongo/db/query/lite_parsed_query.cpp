@@ -26,6 +26,9 @@ namespace mongo {
     const string LiteParsedQuery::cmdOptionMaxTimeMS("maxTimeMS");
     const string LiteParsedQuery::queryOptionMaxTimeMS("$maxTimeMS");
 
+    const string LiteParsedQuery::cmdOptionSnapshot("snapshot");
+    const string LiteParsedQuery::snapshotVLS("vls");
+
     const string LiteParsedQuery::metaTextScore("textScore");
     const string LiteParsedQuery::metaGeoNearDistance("geoNearDistance");
     const string LiteParsedQuery::metaGeoNearPoint("geoNearPoint");
@@ -71,6 +74,21 @@ namespace mongo {
         return parseMaxTimeMS(queryObj[queryOptionMaxTimeMS]);
     }
 
+    // static
+    StatusWith<bool> LiteParsedQuery::parseVLSSnapshotCommand(const BSONObj& cmdObj) {
+        BSONElement snapshotElt = cmdObj[cmdOptionSnapshot];
+        if (snapshotElt.eoo()) {
+            return StatusWith<bool>(false);
+        }
+        if (snapshotElt.type() != mongo::String || snapshotVLS != snapshotElt.valuestr()) {
+            return StatusWith<bool>(ErrorCodes::BadValue,
+                                    (StringBuilder()
+                                        << cmdOptionSnapshot << " must be \""
+                                        << snapshotVLS << "\"").str());
+        }
+        return StatusWith<bool>(true);
+    }
+
     // static
     StatusWith<int> LiteParsedQuery::parseMaxTimeMS(const BSONElement& maxTimeMSElt) {
         if (!maxTimeMSElt.eoo() && !maxTimeMSElt.isNumber()) {
@@ -189,6 +207,7 @@ namespace mongo {
     }
 
     LiteParsedQuery::LiteParsedQuery() : _wantMore(true), _explain(false), _snapshot(false),
+                                         _vlsSnapshot(false),
                                          _returnKey(false), _showDiskLoc(false), _maxScan(0),
                                          _maxTimeMS(0) { }
 
@@ -303,7 +322,12 @@ namespace mongo {
                 }
                 else if (str::equals("snapshot", name)) {
                     // Won't throw.
-                    _snapshot = e.trueValue();
+                    if (e.type() == mongo::String && snapshotVLS == e.valuestr()) {
+                        _vlsSnapshot = true;
+                    }
+                    else {
+                        _snapshot = e.trueValue();
+                    }
                 }
                 else if (str::equals("min", name)) {
                     if (!e.isABSONObj()) {
@@ -65,6 +65,13 @@ namespace mongo {
          */
         static StatusWith<int> parseMaxTimeMSQuery(const BSONObj& queryObj);
 
+        /**
+         * Helper function to parse the read option of a command that asks for a VLS
+         * snapshot, i.e. {snapshot: "vls"}.  Returns whether the command asked for one, or
+         * an error if the option has any other value.
+         */
+        static StatusWith<bool> parseVLSSnapshotCommand(const BSONObj& cmdObj);
+
         /**
          * Helper function to identify text search sort key
          * Example: {a: {$meta: "textScore"}}
@@ -99,6 +106,10 @@ namespace mongo {
         static const string cmdOptionMaxTimeMS;
         static const string queryOptionMaxTimeMS;
 
+        // Name of the snapshot command option, and its value for VLS snapshots.
+        static const string cmdOptionSnapshot;
+        static const string snapshotVLS;
+
         // Names of the $meta projection values.
         static const string metaTextScore;
         static const string metaGeoNearDistance;
@@ -123,6 +134,7 @@ namespace mongo {
 
         bool isExplain() const { return _explain; }
         bool isSnapshot() const { return _snapshot; }
+        bool isVLSSnapshot() const { return _vlsSnapshot; }
         bool returnKey() const { return _returnKey; }
         bool showDiskLoc() const { return _showDiskLoc; }
 
@@ -151,6 +163,8 @@ namespace mongo {
         bool _wantMore;
         bool _explain;
         bool _snapshot;
+        // {$snapshot: "vls"}: read through a VLS snapshot rather than the _id index
+        bool _vlsSnapshot;
         bool _returnKey;
         bool _showDiskLoc;
         bool _hasReadPref;
@@ -192,4 +192,21 @@ namespace {
         testSortOrder(false, "{a: 1}", "{a: {$meta: \"textScore\", b: 1}}");
     }
 
+    TEST(LiteParsedQueryTest, ParseVLSSnapshotCommand) {
+        StatusWith<bool> result = LiteParsedQuery::parseVLSSnapshotCommand(
+            fromjson("{count: 'c', query: {a: 1}}"));
+        ASSERT_OK(result.getStatus());
+        ASSERT_FALSE(result.getValue());
+
+        result = LiteParsedQuery::parseVLSSnapshotCommand(
+            fromjson("{count: 'c', query: {a: 1}, snapshot: 'vls'}"));
+        ASSERT_OK(result.getStatus());
+        ASSERT_TRUE(result.getValue());
+
+        ASSERT_NOT_OK(LiteParsedQuery::parseVLSSnapshotCommand(
+            fromjson("{count: 'c', snapshot: true}")).getStatus());
+        ASSERT_NOT_OK(LiteParsedQuery::parseVLSSnapshotCommand(
+            fromjson("{count: 'c', snapshot: 'mvcc'}")).getStatus());
+    }
+
 }  // namespace
@@ -424,7 +424,8 @@ namespace mongo {
             if (shardingState.needCollectionMetadata(pq.ns())) {
                 options |= QueryPlannerParams::INCLUDE_SHARD_FILTER;
             }
-            status = getRunner(cq, &rawRunner, options);
+            // {$snapshot: "vls"} reads through a VLS snapshot
+            status = getRunner(cq, &rawRunner, options, pq.isVLSSnapshot());
         }
 
         if (!status.isOK()) {
@@ -78,7 +78,8 @@
 
 namespace mongo {
 
-    PlanStage* buildStages(const QuerySolution& qsol, const QuerySolutionNode* root, WorkingSet* ws, bool use_chronos = false) {
+    PlanStage* buildStages(const QuerySolution& qsol, const QuerySolutionNode* root, WorkingSet* ws, bool use_chronos = false,
+                           const BSONObj& vlsFields = BSONObj()) {
         if (STAGE_COLLSCAN == root->getType()) {
             const CollectionScanNode* csn = static_cast<const CollectionScanNode*>(root);
             CollectionScanParams params;
@@ -87,7 +88,7 @@ namespace mongo {
             params.direction = (csn->direction == 1) ? CollectionScanParams::FORWARD
                                                      : CollectionScanParams::BACKWARD;
             params.maxScan = csn->maxScan;
-            return new CollectionScan(params, ws, csn->filter.get(), use_chronos);
+            return new CollectionScan(params, ws, csn->filter.get(), use_chronos, vlsFields);
         }
         else if (STAGE_IXSCAN == root->getType()) {
             const IndexScanNode* ixn = static_cast<const IndexScanNode*>(root);
@@ -119,7 +120,7 @@ namespace mongo {
             params.maxScan = ixn->maxScan;
             params.addKeyMetadata = ixn->addKeyMetadata;
             params.ns = qsol.ns;
-            return new IndexScan(params, ws, ixn->filter.get(), use_chronos);
+            return new IndexScan(params, ws, ixn->filter.get(), use_chronos, vlsFields);
         }
         else if (STAGE_FETCH == root->getType()) {
             const FetchNode* fn = static_cast<const FetchNode*>(root);
@@ -291,12 +292,13 @@ namespace mongo {
 
     // static
     bool StageBuilder::build(const QuerySolution& solution, PlanStage** rootOut,
-                             WorkingSet** wsOut, bool use_chronos) {
+                             WorkingSet** wsOut, bool use_chronos,
+                             const BSONObj& vlsFields) {
         QuerySolutionNode* root = solution.root.get();
         if (NULL == root) { return false; }
 
         auto_ptr<WorkingSet> ws(new WorkingSet());
-        PlanStage* stageRoot = buildStages(solution, root, ws.get(), use_chronos);
+        PlanStage* stageRoot = buildStages(solution, root, ws.get(), use_chronos, vlsFields);
 
         if (NULL != stageRoot) {
             *rootOut = stageRoot;
@@ -76,7 +76,8 @@ namespace mongo {
          * Returns false otherwise.  *rootOut and *wsOut are invalid.
          */
         static bool build(const QuerySolution& solution, PlanStage** rootOut, 
-                          WorkingSet** wsOut, bool use_chronos = false);
+                          WorkingSet** wsOut, bool use_chronos = false,
+                          const BSONObj& vlsFields = BSONObj());
     };
 
 }  // namespace mongo
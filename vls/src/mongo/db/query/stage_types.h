@@ -46,6 +46,9 @@ namespace mongo {
         STAGE_GEO_NEAR_2D,
         STAGE_GEO_NEAR_2DSPHERE,
 
+        // A $group over the documents of its child (see GroupScanStage).
+        STAGE_GROUP_SCAN,
+
         STAGE_IXSCAN,
         STAGE_LIMIT,
         STAGE_OR,
@@ -49,6 +49,7 @@ namespace mongo {
     const BSONField<long long> TypeExplain::nChunkSkips("nChunkSkips");
     const BSONField<long long> TypeExplain::millis("millis");
     const BSONField<BSONObj> TypeExplain::indexBounds("indexBounds");
+    const BSONField<BSONObj> TypeExplain::vls("vls");
     const BSONField<std::vector<TypeExplain*> > TypeExplain::allPlans("allPlans");
     const BSONField<TypeExplain*> TypeExplain::oldPlan("oldPlan");
     const BSONField<std::string> TypeExplain::server("server");
@@ -143,6 +144,8 @@ namespace mongo {
 
         if (_isIndexBoundsSet) builder.append(indexBounds(), _indexBounds);
 
+        if (_isVLSSet) builder.append(vls(), _vls);
+
         if (_allPlans.get()) {
             BSONArrayBuilder allPlansBuilder(builder.subarrayStart(allPlans()));
             for (std::vector<TypeExplain*>::const_iterator it = _allPlans->begin();
@@ -229,6 +232,10 @@ namespace mongo {
         if (fieldState == FieldParser::FIELD_INVALID) return false;
         _isIndexBoundsSet = fieldState == FieldParser::FIELD_SET;
 
+        fieldState = FieldParser::extract(source, vls, &_vls, errMsg);
+        if (fieldState == FieldParser::FIELD_INVALID) return false;
+        _isVLSSet = fieldState == FieldParser::FIELD_SET;
+
         std::vector<TypeExplain*>* bareAllPlans = NULL;
         fieldState = FieldParser::extract(source, allPlans, &bareAllPlans, errMsg);
         if (fieldState == FieldParser::FIELD_INVALID) return false;
@@ -288,6 +295,9 @@ namespace mongo {
         _indexBounds = BSONObj();
         _isIndexBoundsSet = false;
 
+        _vls = BSONObj();
+        _isVLSSet = false;
+
         unsetAllPlans();
 
         unsetOldPlan();
@@ -350,6 +360,9 @@ namespace mongo {
         other->_indexBounds = _indexBounds;
         other->_isIndexBoundsSet = _isIndexBoundsSet;
 
+        other->_vls = _vls;
+        other->_isVLSSet = _isVLSSet;
+
         other->unsetAllPlans();
         if (_allPlans.get()) {
             for(std::vector<TypeExplain*>::const_iterator it = _allPlans->begin();
@@ -659,6 +672,24 @@ namespace mongo {
         return _indexBounds;
     }
 
+    void TypeExplain::setVLS(const BSONObj& vls) {
+        _vls = vls.getOwned();
+        _isVLSSet = true;
+    }
+
+    void TypeExplain::unsetVLS() {
+         _isVLSSet = false;
+     }
+
+    bool TypeExplain::isVLSSet() const {
+         return _isVLSSet;
+    }
+
+    const BSONObj& TypeExplain::getVLS() const {
+        verify(_isVLSSet);
+        return _vls;
+    }
+
     void TypeExplain::setAllPlans(const std::vector<TypeExplain*>& allPlans) {
         unsetAllPlans();
         for (std::vector<TypeExplain*>::const_iterator it = allPlans.begin();
@@ -61,6 +61,7 @@ namespace mongo {
         static const BSONField<long long> nChunkSkips;
         static const BSONField<long long> millis;
         static const BSONField<BSONObj> indexBounds;
+        static const BSONField<BSONObj> vls;
         static const BSONField<std::vector<TypeExplain*> > allPlans;
         static const BSONField<TypeExplain*> oldPlan;
         static const BSONField<std::string> server;
@@ -162,6 +163,11 @@ namespace mongo {
         bool isIndexBoundsSet() const;
         const BSONObj& getIndexBounds() const;
 
+        void setVLS(const BSONObj& vls);
+        void unsetVLS();
+        bool isVLSSet() const;
+        const BSONObj& getVLS() const;
+
         void setAllPlans(const std::vector<TypeExplain*>& allPlans);
         void addToAllPlans(TypeExplain* allPlans);
         void unsetAllPlans();
@@ -238,6 +244,11 @@ namespace mongo {
         BSONObj _indexBounds;
         bool _isIndexBoundsSet;
 
+        // (O)  documents read from the VLS document set or skipped by
+        //      their status masks, and time spent waiting for a scan bit
+        BSONObj _vls;
+        bool _isVLSSet;
+
         // (O)  alternative plans considered
         boost::scoped_ptr<std::vector<TypeExplain*> > _allPlans;
 
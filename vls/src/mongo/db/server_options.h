@@ -53,7 +53,7 @@ namespace mongo {
 
         ServerGlobalParams() :
             port(DefaultDBPort), rest(false), jsonp(false), indexBuildRetry(true), quiet(false),
-            chronosIndex(false), configsvr(false), cpu(false), objcheck(true), defaultProfile(0),
+            configsvr(false), cpu(false), objcheck(true), defaultProfile(0),
             slowMS(100), defaultLocalThresholdMillis(15), moveParanoia(true),
             noUnixSocket(false), doFork(0), socket("/tmp"), maxConns(DEFAULT_MAX_CONN),
             logAppend(false), logWithSyslog(false), isHttpInterfaceEnabled(false)
@@ -79,8 +79,6 @@ namespace mongo {
         bool indexBuildRetry;  // --noIndexBuildRetry
 
         bool quiet;            // --quiet
-        
-        bool chronosIndex;     // --index
 
         bool configsvr;        // --configsvr
 
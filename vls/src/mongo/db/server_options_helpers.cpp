@@ -187,7 +187,8 @@ namespace {
 
         options->addOptionChaining("net.port", "port", moe::Int, portInfoBuilder.str().c_str());
         
-        options->addOptionChaining("chronos.index", "index", moe::Bool, "enable Chronos for index scans");
+        options->addOptionChaining("chronos.index", "index", moe::Bool,
+                "deprecated and ignored: VLS collection and index scans run in the same server");
 
         options->addOptionChaining("net.bindIp", "bind_ip", moe::String,
                 "comma separated list of ip addresses to listen on - all local ips by default");
@@ -456,7 +457,8 @@ namespace {
         }
         
         if (params.count("chronos.index")) {
-            serverGlobalParams.chronosIndex = params["chronos.index"].as<bool>();
+            log() << "warning: --index is deprecated and ignored: aggregates use VLS "
+                  << "collection and index scans in the same server" << endl;
         }
 
         // Handle the JSON config file verbosity setting first so that it gets overriden by the
@@ -66,25 +66,231 @@
 #include "mongo/db/commands/server_status.h"
 #include "mongo/db/curop.h"
 #include "mongo/db/database.h"
+#include "mongo/db/database_holder.h"
+#include "mongo/db/db.h"
 #include "mongo/db/index/index_access_method.h"
 #include "mongo/db/namespace_details.h"
 #include "mongo/db/repl/rs.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/db/storage/extent.h"
 #include "mongo/db/storage/extent_manager.h"
+#include "mongo/db/storage_options.h"
 #include "mongo/db/structure/collection_iterator.h"
+#include "mongo/util/timer.h"
 
 #include "mongo/db/pdfile.h" // XXX-ERH
 #include "mongo/db/auth/user_document_parser.h" // XXX-ANDY
 
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
 namespace mongo {
 
+    // ---- VLS ---- //
+
+    /* Databases ("db") or namespaces ("db.coll") whose collections use VLS even
+       without the 'vls' collection option, e.g. --setParameter vlsNamespaces=testdb */
+    MONGO_EXPORT_STARTUP_SERVER_PARAMETER( vlsNamespaces, std::vector<std::string>,
+                                           std::vector<std::string>() );
+
+    /* Bytes of preserved versions kept in memory by the document sets of all
+       collections; past it, preserved versions are spilled to a file under
+       the dbpath (0 means no limit), e.g. --setParameter vlsRemsetMemoryBytes=1073741824 */
+    MONGO_EXPORT_SERVER_PARAMETER( vlsRemsetMemoryBytes, long long, 0 );
+
+    /* Keeps the versions preserved by updates as the fields that differ from
+       the new version, when that is much smaller than the whole document,
+       e.g. --setParameter vlsDeltaPreImages=true */
+    MONGO_EXPORT_SERVER_PARAMETER( vlsDeltaPreImages, bool, false );
+
+    /* Starts forward VLS collection scans at the extent another running scan
+       is reading, wrapping around to the first extent, so that concurrent
+       scans share one pass over the collection; natural order is not kept,
+       e.g. --setParameter vlsSharedScans=true */
+    MONGO_EXPORT_SERVER_PARAMETER( vlsSharedScans, bool, false );
+
+    namespace {
+
+        /* Width of the VLS masks, i.e., the maximum number of concurrent VLS scans
+           per database, e.g. --setParameter vlsMaskBits=128 */
+        int vlsMaskBits = 64;
+
+        class ExportedVLSMaskBitsParameter : public ExportedServerParameter<int> {
+        public:
+            ExportedVLSMaskBitsParameter() :
+                ExportedServerParameter<int>( ServerParameterSet::getGlobal(),
+                                              "vlsMaskBits",
+                                              &vlsMaskBits,
+                                              true,
+                                              false ) {}
+
+            virtual Status validate( const int& potentialNewValue ) {
+                if ( potentialNewValue != 64 && potentialNewValue != 128 &&
+                     potentialNewValue != 256 ) {
+                    return Status( ErrorCodes::BadValue,
+                                   "vlsMaskBits must be 64, 128 or 256" );
+                }
+                return Status::OK();
+            }
+        } exportedVLSMaskBitsParam;
+
+        /* Same value and field name, or both missing */
+        bool _sameElement( const BSONElement& a, const BSONElement& b ) {
+            return a.size() == b.size() && memcmp( a.rawdata(), b.rawdata(), a.size() ) == 0;
+        }
+
+        bool _vlsRequested( const NamespaceString& ns, const NamespaceDetails* details ) {
+            if ( ns.isSystem() )
+                return false;
+
+            if ( details->isUserFlagSet( NamespaceDetails::Flag_VLS ) )
+                return true;
+
+            for ( std::vector<std::string>::const_iterator it = vlsNamespaces.begin();
+                  it != vlsNamespaces.end(); ++it ) {
+                if ( ns.db() == *it || ns.ns() == *it )
+                    return true;
+            }
+
+            return false;
+        }
+
+        /* Sets the initial status mask of a range of slots of a status mask map */
+        class StatusMaskFill {
+        public:
+            StatusMaskFill( st_mask_map* statusMaskMap, uint64_t mask )
+                : _statusMaskMap( statusMaskMap ), _mask( mask ) { }
+
+            void operator()( const tbb::blocked_range<size_t>& r ) const {
+                for ( size_t id = r.begin(); id != r.end(); ++id )
+                    (*_statusMaskMap)[id] = _mask;
+            }
+
+        private:
+            st_mask_map* _statusMaskMap;
+            uint64_t _mask;
+        };
+
+        /* Number of slots filled by each task when initializing a status mask map */
+        const size_t statusMaskFillGrainSize = 64 * 1024;
+
+        /* Collects the offsets of the records of a range of extents */
+        class ExtentRecordCollector {
+        public:
+            ExtentRecordCollector( ExtentManager* em, const std::vector<DiskLoc>* extents,
+                                   std::vector< std::vector<int> >* records )
+                : _em( em ), _extents( extents ), _records( records ) { }
+
+            void operator()( const tbb::blocked_range<size_t>& r ) const {
+                for ( size_t i = r.begin(); i != r.end(); ++i ) {
+                    Extent* e = _em->getExtent( (*_extents)[i] );
+                    std::vector<int>& records = (*_records)[i];
+                    if ( e->firstRecord.isNull() )
+                        continue;
+                    for ( int ofs = e->firstRecord.getOfs(); ofs != DiskLoc::NullOfs;
+                          ofs = _em->recordFor( DiskLoc( e->myLoc.a(), ofs ) )->np()->nextOfs )
+                        records.push_back( ofs );
+                }
+            }
+
+        private:
+            ExtentManager* _em;
+            const std::vector<DiskLoc>* _extents;
+            std::vector< std::vector<int> >* _records;
+        };
+
+        /* True if an index key is within the bounds of an index scan */
+        bool _keyWithinBounds( const index_scan_info& info, const BSONObj& key ) {
+            const IndexBounds& bounds = info.bounds;
+            if ( !bounds.isSimpleRange ) {
+                IndexBoundsChecker checker( &bounds, info.keyPattern, info.direction );
+                return checker.isValidKey( key );
+            }
+
+            // "normal" start -> end scans, as in IndexScan::checkEnd()
+            if ( !bounds.startKey.isEmpty() &&
+                 key.woCompare( bounds.startKey, info.keyPattern ) * info.direction < 0 )
+                return false;
+            if ( bounds.endKey.isEmpty() )
+                return true;
+            int cmp = bounds.endKey.woCompare( key, info.keyPattern ) * info.direction;
+            return cmp > 0 || ( cmp == 0 && bounds.endKeyInclusive );
+        }
+
+    }
+
+    int vlsMaskWords() {
+        return vlsMaskBits / 64;
+    }
+
+    Counter64 documentSetEntriesCounter;
+    Counter64 documentSetBytesCounter;
+    Counter64 documentSetSegmentsCounter;
+    Counter64 documentSetSpilledBytesCounter;
+    ServerStatusMetricField<Counter64> documentSetEntriesDisplay( "vls.documentSet.entries",
+                                                                  &documentSetEntriesCounter );
+    ServerStatusMetricField<Counter64> documentSetBytesDisplay( "vls.documentSet.bytes",
+                                                                &documentSetBytesCounter );
+    ServerStatusMetricField<Counter64> documentSetSegmentsDisplay( "vls.documentSet.segments",
+                                                                   &documentSetSegmentsCounter );
+    ServerStatusMetricField<Counter64> documentSetSpilledBytesDisplay( "vls.documentSet.spilledBytes",
+                                                                       &documentSetSpilledBytesCounter );
+    AtomicUInt64 documentSetSpillFiles;
+
+    // running totals, from which the rates of the remset can be derived
+    Counter64 documentSetInsertedCounter;
+    Counter64 documentSetReclaimedCounter;
+
+    Counter64 sharedScanCounter;
+
+    AtomicUInt64 collectionInstanceIds;
+
+    Counter64 flipPhaseCounter;
+    Counter64 flipPhaseMillisCounter;
+    AtomicUInt64 flipPhaseLastMillis;
+
+    class VLSServerStatusSection : public ServerStatusSection {
+    public:
+        VLSServerStatusSection() : ServerStatusSection( "vls" ){}
+        virtual bool includeByDefault() const { return true; }
+
+        BSONObj generateSection(const BSONElement& configElement) const {
+            BSONObjBuilder b;
+            b.append( "maskBits", vlsMaskBits );
+            b.append( "activeScans", ScanBitAllocator::totalHeld() );
+            b.append( "waitingScans", ScanBitAllocator::totalWaiters() );
+
+            BSONObjBuilder ds( b.subobjStart( "documentSet" ) );
+            ds.appendNumber( "entries", (long long)documentSetEntriesCounter.get() );
+            ds.appendNumber( "bytes", (long long)documentSetBytesCounter.get() );
+            ds.appendNumber( "segments", (long long)documentSetSegmentsCounter.get() );
+            ds.appendNumber( "spilledBytes", (long long)documentSetSpilledBytesCounter.get() );
+            ds.appendNumber( "inserted", (long long)documentSetInsertedCounter.get() );
+            ds.appendNumber( "reclaimed", (long long)documentSetReclaimedCounter.get() );
+            ds.done();
+
+            BSONObjBuilder fp( b.subobjStart( "flipPhase" ) );
+            fp.appendNumber( "count", (long long)flipPhaseCounter.get() );
+            fp.appendNumber( "totalMillis", (long long)flipPhaseMillisCounter.get() );
+            fp.appendNumber( "lastMillis", (long long)flipPhaseLastMillis.load() );
+            fp.done();
+
+            b.appendNumber( "sharedScans", (long long)sharedScanCounter.get() );
+
+            return b.obj();
+        }
+    } vlsServerStatusSection;
+
+    // ---- VLS ---- //
+
     Collection::Collection( const StringData& fullNS,
                             NamespaceDetails* details,
                             Database* database )
         : _ns( fullNS ),
           _recordStore( _ns.ns() ),
           _infoCache( this ),
-          _indexCatalog( this, details ) {
+          _indexCatalog( this, details ),
+          _recordVersions( this ) {
         _details = details;
         _database = database;
         _recordStore.init( _details,
@@ -92,151 +298,262 @@ namespace mongo {
                            _ns.coll() == "system.indexes" );
         _magic = 1357924;
         
-        stableMask = 0x0; // vector of 0's
-        localActiveMask = 0xFFFFFFFFFFFFFFFF; // vector of 1's
-        localIndexActiveMask = 0xFFFFFFFFFFFFFFFF; // vector of 1's
+        instanceId = collectionInstanceIds.addAndFetch( 1 );
+        stableMask = vls_mask( 0x0 ); // vector of 0's
+        localActiveMask = vls_mask( 0xFFFFFFFFFFFFFFFF ); // vector of 1's
+        localIndexActiveMask = vls_mask( 0xFFFFFFFFFFFFFFFF ); // vector of 1's
         statusMaskMapInit = false;
-        documentSetKey = 0;
+        documentSet = NULL;
         documentSetSize = 0;
+        documentSetBytes = 0;
+        documentSetSegments = 0;
+        documentSetSpilledBytes = 0;
+        scanEpoch = 0;
         indexScanId = 0;
         
         //worstQueueSize = 0;
         //noReclamationQueueSize = 0;
         
-        log() << "Init for collection " << _ns.ns() << endl;
         /*log() << "NumRecords:" << numRecords() << endl;*/
         
-        //isUserCollection = ( _ns.coll().find( "system." ) == string::npos ) && ( _ns.db() != "local" );
-        //isUserCollection = ( _ns.db() == "testdb_100m" );
-        isUserCollection = ( _ns.db() == "testdb_1m" ) || ( _ns.db() == "testdb_10m" );
-        //isUserCollection = ( _ns.coll().find("test") != string::npos );
-        //isUserCollection = false;
-        
-        statusMaskMapVector.reserve(20);
-        //indexScanMap = boost::unordered_map< int, index_scan_info >();
-        
-        documentSet = doc_set( 6000000 );
+        vlsEnabled = false;
+        if ( _vlsRequested( _ns, _details ) ) {
+            if ( _details->isCapped() )
+                warning() << "VLS is not supported on capped collections, ignoring for "
+                          << _ns.ns() << endl;
+            else
+                _initVLS();
+        }
     }
 
     Collection::~Collection() {
         // garbage collection of in-memory structures
-        statusMaskMapVector.clear();
-        documentSet.clear();
-        
-        log() << "Exit for collection " << _ns.ns() << endl;
+        if ( vlsEnabled )
+            _clearVLS();
         
         verify( ok() );
         _magic = 0;
     }
     
+    void Collection::_initVLS() {
+        log() << "VLS enabled for collection " << _ns.ns() << endl;
+        
+        // one plane of status masks per 64-bit word of the masks
+        statusMaskPlanes.resize( vlsMaskWords() );
+        for (int w = 0; w < (int)statusMaskPlanes.size(); w++)
+            statusMaskPlanes[w].reserve(20);
+        
+        // state of the scans, one per bit of the masks
+        scanFields.resize( vlsMaskBits );
+        activeScanEpochs.assign( vlsMaskBits, 0 );
+        scanExtentWatermarks.resize( vlsMaskBits );
+        scanPositions.resize( vlsMaskBits );
+        for (int n = 0; n < vlsMaskBits; n++) {
+            scanExtentWatermarks[n] = 0;
+            scanPositions[n] = 0;
+        }
+        //indexScanMap = boost::unordered_map< int, index_scan_info >();
+        
+        // status masks are only materialized by the first VLS scan
+        // (see initializeStatusMaskMap())
+        vlsEnabled = true;
+    }
+    
+    void Collection::_clearVLS() {
+        vlsEnabled = false;
+        statusMaskMapInit = false;
+        
+        statusMaskPlanes.clear();
+        slotTableVector.clear();
+        idOfsMap.clear();
+        releasedSlots.clear();
+        extentOrdinals.clear();
+        scanFields.clear();
+        activeScanEpochs.clear();
+        scanExtentWatermarks.clear();
+        scanPositions.clear();
+        lastOrdinalExtent = DiskLoc();
+        
+        DocumentSet* set = documentSet.fetch_and_store( NULL );
+        if ( set != NULL ) {
+            documentSetEntriesCounter.decrement( set->size() );
+            documentSetBytesCounter.decrement( documentSetBytes );
+            documentSetSegmentsCounter.decrement( documentSetSegments );
+            documentSetSpilledBytesCounter.decrement( documentSetSpilledBytes );
+            delete set;
+        }
+        documentSetSize = 0;
+        documentSetBytes = 0;
+        documentSetSegments = 0;
+        documentSetSpilledBytes = 0;
+        
+        _indexCatalog.clearIndexMaskMap();
+    }
+    
+    Status Collection::setVLSEnabled(bool enabled) {
+        Lock::assertWriteLocked( _ns.ns() );
+        
+        if ( enabled == vlsEnabled )
+            return Status::OK();
+        
+        if ( enabled ) {
+            if ( _details->isCapped() )
+                return Status( ErrorCodes::BadValue,
+                               "VLS is not supported on capped collections" );
+            if ( _ns.isSystem() )
+                return Status( ErrorCodes::BadValue,
+                               "VLS is not supported on system collections" );
+            
+            _initVLS();
+            return Status::OK();
+        }
+        
+        {
+            // scans may still be using the status masks and the document set;
+            // FlipPhase only releases the database bits once it is done
+            if ( !_database->activeMask.allFree() )
+                return Status( ErrorCodes::IllegalOperation,
+                               "cannot disable VLS while VLS scans are running" );
+        }
+        
+        // FlipPhases may give the bits back before they unindex
+        _indexCatalog.unindexSkippedEntries();
+        _clearVLS();
+        log() << "VLS disabled for collection " << _ns.ns() << endl;
+        return Status::OK();
+    }
+    
     Database* Collection::getDatabase()
     {
         return _database;
     }
     
-    ID Collection::insertValue(const DiskLoc& loc, uint64_t mask)
+    ID Collection::insertValue(const DiskLoc& loc, const vls_mask& mask)
     {
         int a = loc.a();
         int ofs = loc.getOfs();
         
-        tbb::atomic<uint64_t> init_atomic_mask;
-        init_atomic_mask = 0x0;
-        
-        if ( a == (int)statusMaskMapVector.size() )
+        while ( a >= (int)slotTableVector.size() )
         {
-            statusMaskMapVector.push_back( st_mask_map( ) );
-            ofsMap.push_back(ofs);
-            max_id.push_back(0);
+            for (int w = 0; w < (int)statusMaskPlanes.size(); w++)
+                statusMaskPlanes[w].push_back( st_mask_map( ) );
+            slotTableVector.push_back( RecordSlotTable( ) );
             idOfsMap.push_back( ofs_map( ) );
-            
-            statusMaskMapVector[a].reserve( 800000 );
-            idOfsMap[a].reserve( 800000 );
-        }
-        else if ( a > (int)statusMaskMapVector.size() )
-        {
-            while ( a >= (int)statusMaskMapVector.size() )
-            {
-                statusMaskMapVector.push_back( st_mask_map( ) );
-                ofsMap.push_back(ofs);
-                max_id.push_back(0);
-                idOfsMap.push_back( ofs_map( ) );
-            }
-            statusMaskMapVector[a].reserve( 800000 );
-            idOfsMap[a].reserve( 800000 );
         }
         
-        ID id = loc.id(ofsMap[a]);
-        tbb::atomic<uint64_t> atomic_mask;
-        atomic_mask = mask;
-        st_mask_map* _statusMaskMap = &statusMaskMapVector[a];
+        ID id = slotTableVector[a].insert(ofs);
         
-        while (id >= _statusMaskMap->size()) {
-            _statusMaskMap->push_back( init_atomic_mask );
-            idOfsMap[a].push_back(0);
+        if ( id == idOfsMap[a].size() ) {
+            tbb::atomic<uint64_t> atomic_mask;
+            for (int w = 0; w < (int)statusMaskPlanes.size(); w++) {
+                atomic_mask = mask.words[w];
+                statusMaskPlanes[w][a].push_back( atomic_mask );
+            }
+            idOfsMap[a].push_back( ofs );
+        }
+        else {
+            // a record written where a deleted record was gets its ID back
+            storeStatusMask(a, id, mask);
+            idOfsMap[a][id] = ofs;
         }
-        
-        //log() << "Size: " << _statusMaskMap->size() << endl;
-        
-        _statusMaskMap->at(id) = atomic_mask;
-        idOfsMap[a][id] = ofs;
-        
-        if (id > max_id[a])
-            max_id[a] = id;
         
         return id;
     }
     
+    vls_mask Collection::loadStatusMask(int a, ID id) const
+    {
+        dassert( id < statusMaskPlanes[0][a].size() );
+        vls_mask mask;
+        for (int w = 0; w < (int)statusMaskPlanes.size(); w++)
+            mask.words[w] = statusMaskPlanes[w][a][id];
+        return mask;
+    }
+    
+    void Collection::storeStatusMask(int a, ID id, const vls_mask& mask)
+    {
+        dassert( id < statusMaskPlanes[0][a].size() );
+        for (int w = 0; w < (int)statusMaskPlanes.size(); w++)
+            statusMaskPlanes[w][a][id] = mask.words[w];
+    }
+    
     void Collection::initializeStatusMaskMap() {
         
-        /* Initializing the status mask of each document in the collection. */
-        if (isUserCollection) {
-            
-            //statusMaskMapWriteLock w_lock(SMMLock);
-            
-            if (!statusMaskMapInit) {
+        /* Initializing the status mask of each document in the collection.
+           This is done by the first VLS scan over the collection: until then,
+           no scan is active and every document has the status mask computed
+           from the stable mask, so writes do not need to maintain the map and
+           opening a collection does not read any document. */
+        if (!vlsEnabled || statusMaskMapInit)
+            return;
         
-                CollectionScanParams params;
-                params.ns = _ns.ns();
-                params.direction = CollectionScanParams::FORWARD;
-                params.tailable = false;
-                params.start = DiskLoc();
+        statusMaskMapLock::scoped_lock smm_lock(SMMLock);
         
-                // Create an executor to handle the scan.
-                WorkingSet* ws = new WorkingSet();
-                PlanStage* ps = new CollectionScan(params, ws, NULL);
-                PlanExecutor runner(ws, ps);
+        if (statusMaskMapInit)
+            return;
         
-                // TODO: catch should be more specific
-                try {
-                    DiskLoc obj;
-                    while (Runner::RUNNER_ADVANCED == runner.getNext(NULL, &obj)) {
-                        //log() << obj.getOfs() << endl;
-                        insertValue(obj, computeStatusMask());
-                    }
-                    
-                    // allocating more memory for status mask
-                    for (int a = 0; a < (int)statusMaskMapVector.size(); a++)
-                    {
-                        statusMaskMapVector[a].reserve( statusMaskMapVector[a].size()*3 );
-                        idOfsMap[a].reserve( idOfsMap[a].size()*3 );
-                    }
-                    
-                    log() << "Status Mask Map initialized for " << _ns.ns() << endl;
-                    
-                    _indexCatalog.initializeIndexMaskMap();
+        try {
+            ExtentManager* em = &_database->getExtentManager();
+            
+            std::vector<DiskLoc> extents;
+            for ( DiskLoc extLoc = _details->firstExtent(); !extLoc.isNull(); ) {
+                extents.push_back( extLoc );
+                extLoc = em->getExtent( extLoc )->xnext;
+            }
+            
+            // collecting the offsets of the records of each extent, in parallel
+            std::vector< std::vector<int> > records( extents.size() );
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, extents.size() ),
+                               ExtentRecordCollector( em, &extents, &records ) );
+            
+            // assigning dense IDs, in extent order, for each DiskLoc Volume
+            for ( size_t i = 0; i < extents.size(); i++ ) {
+                int a = extents[i].a();
+                while ( a >= (int)slotTableVector.size() ) {
+                    for (int w = 0; w < (int)statusMaskPlanes.size(); w++)
+                        statusMaskPlanes[w].push_back( st_mask_map( ) );
+                    slotTableVector.push_back( RecordSlotTable( ) );
+                    idOfsMap.push_back( ofs_map( ) );
+                }
+                for ( size_t j = 0; j < records[i].size(); j++ ) {
+                    slotTableVector[a].insert( records[i][j] );
+                    idOfsMap[a].push_back( records[i][j] );
+                }
+            }
+            
+            vls_mask initMask = computeStatusMask();
+            
+            for (int w = 0; w < (int)statusMaskPlanes.size(); w++)
+            {
+                for (int a = 0; a < (int)slotTableVector.size(); a++)
+                {
+                    size_t size = slotTableVector[a].numSlots();
+                    st_mask_map* statusMaskMap = &statusMaskPlanes[w][a];
                     
-                    statusMaskMapInit = true;
-                } catch (...) {
-                    statusMaskMapVector.clear();
-                    log() << "Status Mask Map not initialized for " << _ns.ns() << endl;
-                    statusMaskMapInit = false;
+                    // each volume is split in ranges of slots that are filled in
+                    // parallel, so that large maps are written by all cores
+                    statusMaskMap->reserve( size + size/2 );
+                    statusMaskMap->resize( size );
+                    tbb::parallel_for( tbb::blocked_range<size_t>( 0, size, statusMaskFillGrainSize ),
+                                       StatusMaskFill( statusMaskMap, initMask.words[w] ) );
                 }
-
             }
             
-            log() << "StatusMaskMap Size: " << statusMaskMapVector.size() << endl;
-            printStatusMaskMap();
+            _indexCatalog.initializeIndexMaskMap();
+            
+            log() << "Status Mask Map initialized for " << _ns.ns()
+                  << " (" << slotTableVector.size() << " volumes, "
+                  << statusMaskPlanes.size() * 64 << "-bit masks)" << endl;
             
+            statusMaskMapInit = true;
+        } catch (...) {
+            // failures in the parallel sections are not always DBExceptions
+            for (int w = 0; w < (int)statusMaskPlanes.size(); w++)
+                statusMaskPlanes[w].clear();
+            slotTableVector.clear();
+            idOfsMap.clear();
+            _indexCatalog.clearIndexMaskMap();
+            log() << "Status Mask Map not initialized for " << _ns.ns() << endl;
+            throw;
         }
 
     }
@@ -245,9 +562,9 @@ namespace mongo {
             
         log() << "Printing Status Mask Map..." << endl;
         
-        for (int i = 0; i < (int)statusMaskMapVector.size(); i++)
+        for (int i = 0; i < (int)slotTableVector.size(); i++)
         {
-            st_mask_map* statusMaskMap = &statusMaskMapVector[i];
+            st_mask_map* statusMaskMap = &statusMaskPlanes[0][i];
             st_mask_map::iterator it;
             
             log() << "Size: " << statusMaskMap->size() << endl;
@@ -259,27 +576,442 @@ namespace mongo {
         }
     }
     
+    DocumentSet* Collection::getDocumentSet() {
+        DocumentSet* set = documentSet;
+        if ( set != NULL )
+            return set;
+        
+        // first VLS scan over the collection: allocate an empty log,
+        // which only grows as updates preserve stable versions
+        documentSetWriteLock dsw_lock(DSLock);
+        set = documentSet;
+        if ( set == NULL ) {
+            set = new DocumentSet();
+            set->setCurrentVersions( &_recordVersions );
+            documentSetSegments = set->numSegments();
+            documentSetSegmentsCounter.increment( documentSetSegments );
+            documentSet = set;
+        }
+        return set;
+    }
+    
+    BSONObj Collection::RecordVersions::current( int _a, ID id ) const {
+        return _collection->docFor( DiskLoc( _a, _collection->idOfsMap[_a][id] ) );
+    }
+    
+    void Collection::_releaseSlot( const DiskLoc& loc ) {
+        releasedSlots.push_back( loc );
+        
+        // a running scan may still read the slots in the status masks, the
+        // scan sets and the document set, and the bits of FlipPhase too;
+        // no scan can start while the write lock is held
+        if ( !_database->activeMask.allFree() )
+            return;
+        
+        size_t kept = 0;
+        for ( size_t i = 0; i < releasedSlots.size(); i++ ) {
+            const DiskLoc& released = releasedSlots[i];
+            int a = released.a();
+            ID id = recordId( released );
+            
+            // freed already, or the offset was written again and the slot
+            // belongs to the new record
+            if ( id == RecordSlotTable::NoSlot || idOfsMap[a][id] != 0 )
+                continue;
+            
+            // removed index entries keep their slot until they are unindexed
+            if ( _indexCatalog.hasIndexDeltas( a, id ) ) {
+                releasedSlots[kept++] = released;
+                continue;
+            }
+            
+            slotTableVector[a].release( released.getOfs() );
+        }
+        releasedSlots.resize( kept );
+    }
+    
+    void Collection::_materializeDelta( int _a, ID id, const BSONObj& current ) {
+        DocumentSet* set = documentSet;
+        if ( set == NULL )
+            return;
+        
+        uint64_t added = set->materialize( _a, id, current );
+        if ( added > 0 ) {
+            documentSetBytes += added;
+            documentSetBytesCounter.increment( added );
+        }
+    }
+    
+    void Collection::addToDocumentSet(const BSONObj& doc, ID id, int _a, const vls_mask& queueStatusMask,
+                                      const BSONObj* current) {
+        DocumentSet* set = getDocumentSet();
+        
+        // scans that start from now on do not need this version, so it
+        // belongs to the epoch of the latest scan that started
+        queue_document entry( doc, id, _a, queueStatusMask, scanEpoch );
+        uint64_t segments = set->numSegments();
+        
+        // an update that only touches a few fields only preserves them
+        BSONObj delta;
+        if ( current != NULL && vlsDeltaPreImages &&
+             DocumentSet::makeDelta( doc, *current, &delta ) ) {
+            entry.document = delta;
+            entry.delta = true;
+        }
+        int size = entry.document.objsize();
+        
+        // past the memory budget, preserved versions go to a spill file
+        long long budget = vlsRemsetMemoryBytes;
+        bool spill = !entry.delta && budget > 0 &&
+            documentSetBytesCounter.get() + size > (unsigned long long)budget;
+        if ( spill && !set->spilling() ) {
+            std::string path = str::stream() << storageGlobalParams.dbpath
+                                             << "/_tmp/vls_remset." << _ns.ns() << "."
+                                             << documentSetSpillFiles.fetchAndAdd( 1 );
+            if ( !set->spillTo( path ) ) {
+                warning() << "could not create VLS spill file " << path
+                          << ", keeping preserved documents of " << _ns.ns()
+                          << " in memory" << endl;
+            }
+        }
+        
+        bool spilled = false;
+        set->append( entry, spill, &spilled );
+        documentSetSize += 1;
+        documentSetEntriesCounter.increment();
+        documentSetInsertedCounter.increment();
+        
+        if ( spilled ) {
+            documentSetSpilledBytes += size;
+            documentSetSpilledBytesCounter.increment( size );
+        }
+        else {
+            documentSetBytes += size;
+            documentSetBytesCounter.increment( size );
+        }
+        
+        if ( set->numSegments() != segments ) {
+            documentSetSegments += 1;
+            documentSetSegmentsCounter.increment();
+        }
+    }
+    
+    void Collection::setScanFields(int n, const BSONObj& fields, const BSONObj& keyPattern) {
+        if ( fields.isEmpty() || keyPattern.isEmpty() ) {
+            scanFields[n] = fields.getOwned();
+            return;
+        }
+        
+        BSONObjBuilder b;
+        b.appendElements( fields );
+        BSONObjIterator it( keyPattern );
+        while ( it.more() ) {
+            StringData name = it.next().fieldNameStringData();
+            size_t dot = name.find( '.' );
+            b.append( dot == string::npos ? name : name.substr( 0, dot ), true );
+        }
+        scanFields[n] = b.obj();
+    }
+    
+    bool Collection::preservedVersion(const BSONObj& doc, const BSONObj* current,
+                                      const vls_mask& queueStatusMask, BSONObj* preserved) {
+        // fields read by the scans that still need the stable version; scans
+        // only start under a read lock, so writers see them all
+        std::vector<const BSONObj*> fields;
+        vls_mask needing = ~queueStatusMask;
+        int n;
+        while ( ( n = needing.findFirstSet( vlsMaskBits ) ) >= 0 ) {
+            needing.reset( n );
+            if ( scanFields[n].isEmpty() ) {
+                *preserved = doc;
+                return true;
+            }
+            fields.push_back( &scanFields[n] );
+        }
+        
+        bool touched = current == NULL;
+        for ( size_t i = 0; i < fields.size() && !touched; i++ ) {
+            BSONObjIterator it( *fields[i] );
+            while ( it.more() && !touched ) {
+                const char* name = it.next().fieldName();
+                touched = !_sameElement( doc.getField( name ), current->getField( name ) );
+            }
+        }
+        
+        BSONObjBuilder b;
+        BSONObjIterator it( doc );
+        while ( it.more() ) {
+            BSONElement e = it.next();
+            bool read = strcmp( e.fieldName(), "_id" ) == 0;
+            for ( size_t i = 0; i < fields.size() && !read; i++ )
+                read = fields[i]->hasField( e.fieldName() );
+            if ( read )
+                b.append( e );
+        }
+        *preserved = b.obj();
+        return touched;
+    }
+    
+    void Collection::reclaimDocumentSet(uint64_t oldestEpoch) {
+        DocumentSet* set = documentSet;
+        if ( set == NULL )
+            return;
+        
+        uint64_t entries;
+        uint64_t bytes;
+        uint64_t spilledBytes;
+        set->reclaim( oldestEpoch, &entries, &bytes, &spilledBytes );
+        if ( entries == 0 )
+            return;
+        
+        uint64_t segments = entries / DocumentSet::SegmentSize;
+        documentSetSize -= (int)entries;
+        documentSetBytes -= bytes;
+        documentSetSegments -= segments;
+        documentSetEntriesCounter.decrement( entries );
+        documentSetReclaimedCounter.increment( entries );
+        documentSetBytesCounter.decrement( bytes );
+        documentSetSegmentsCounter.decrement( segments );
+        documentSetSpilledBytes -= spilledBytes;
+        documentSetSpilledBytesCounter.decrement( spilledBytes );
+    }
+    
+    uint64_t Collection::beginScanEpoch(int n) {
+        uint64_t epoch = ++scanEpoch;
+        activeScanEpochs[n] = epoch;
+        scanExtentWatermarks[n] = 0;
+        scanPositions[n] = 0;
+        return epoch;
+    }
+    
+    uint64_t Collection::endScanEpoch(int n) {
+        activeScanEpochs[n] = 0;
+        scanExtentWatermarks[n] = 0;
+        scanPositions[n] = 0;
+        
+        // with no scan running, every generation preserved so far can go
+        uint64_t oldestEpoch = scanEpoch + 1;
+        for (int i = 0; i < (int)activeScanEpochs.size(); i++)
+            if ( activeScanEpochs[i] != 0 && activeScanEpochs[i] < oldestEpoch )
+                oldestEpoch = activeScanEpochs[i];
+        return oldestEpoch;
+    }
+
+    bool Collection::claimRecordForScan(const DiskLoc& loc, int word,
+                                        uint64_t scanStableMask, uint64_t scanMask) {
+        st_mask_map& statusMaskMap = statusMaskPlanes[word][loc.a()];
+        tbb::atomic<uint64_t>& statusMask = statusMaskMap.at( recordId( loc ) );
+        
+        while ( true ) {
+            uint64_t current = statusMask;
+            
+            // if OR(Status) is not 0, the scan already read the record or
+            // will read its version in the document set
+            if ( ( ( scanStableMask ^ current ) & scanMask ) != 0x0 )
+                return false;
+            
+            // flipping the bit of the scan; retried if a writer changed
+            // the mask in between
+            if ( statusMask.compare_and_swap( ~( ( ~current ) ^ scanMask ), current ) == current )
+                return true;
+        }
+    }
+
+    DiskLoc Collection::extentOf(const DiskLoc& loc) {
+        return DiskLoc( loc.a(), getExtentManager()->recordFor( loc )->extentOfs() );
+    }
+    
+    void Collection::advanceScanWatermark(int n, const DiskLoc& extentLoc) {
+        // an extent that writers did not number yet comes after all the
+        // numbered ones
+        boost::unordered_map<uint64_t, uint64_t>::const_iterator it =
+            extentOrdinals.find( extentKey( extentLoc ) );
+        uint64_t watermark = it != extentOrdinals.end() ? it->second : extentOrdinals.size();
+        if ( watermark > scanExtentWatermarks[n] )
+            scanExtentWatermarks[n] = watermark;
+    }
+    
+    void Collection::setScanPosition(int n, const DiskLoc& extentLoc) {
+        scanPositions[n] = extentKey( extentLoc );
+    }
+    
+    DiskLoc Collection::sharedScanStart(int n) {
+        if ( !vlsSharedScans )
+            return DiskLoc();
+        
+        // joining the scan that started last, which has the most extents to go
+        uint64_t key = 0;
+        uint64_t latestEpoch = 0;
+        for ( int i = 0; i < (int)scanPositions.size(); i++ ) {
+            if ( i != n && scanPositions[i] != 0 && activeScanEpochs[i] > latestEpoch ) {
+                latestEpoch = activeScanEpochs[i];
+                key = scanPositions[i];
+            }
+        }
+        if ( key == 0 )
+            return DiskLoc();
+        
+        // the position may be stale: only an extent of the collection will do
+        DiskLoc position( static_cast<int>( key >> 32 ), static_cast<int>( key & 0xFFFFFFFF ) );
+        ExtentManager* em = getExtentManager();
+        for ( DiskLoc extLoc = _details->firstExtent(); !extLoc.isNull();
+              extLoc = em->getExtent( extLoc )->xnext ) {
+            if ( extLoc == position ) {
+                if ( extLoc == _details->firstExtent() )
+                    return DiskLoc();
+                sharedScanCounter.increment();
+                return position;
+            }
+        }
+        return DiskLoc();
+    }
+    
+    bool Collection::scansNeedVersionAt(const DiskLoc& loc) {
+        // O(1) when no scan is running
+        vls_mask running = ~localActiveMask;
+        int n = running.findFirstSet( vlsMaskBits );
+        if ( n < 0 )
+            return false;
+        
+        uint64_t key = extentKey( extentOf( loc ) );
+        boost::unordered_map<uint64_t, uint64_t>::const_iterator it = extentOrdinals.find( key );
+        if ( it == extentOrdinals.end() ) {
+            // numbering the extents added to the chain since the last time
+            ExtentManager* em = getExtentManager();
+            DiskLoc extLoc = lastOrdinalExtent.isNull() ? _details->firstExtent()
+                                                        : em->getExtent( lastOrdinalExtent )->xnext;
+            for ( ; !extLoc.isNull(); extLoc = em->getExtent( extLoc )->xnext ) {
+                uint64_t ordinal = extentOrdinals.size();
+                extentOrdinals[extentKey( extLoc )] = ordinal;
+                lastOrdinalExtent = extLoc;
+            }
+            
+            it = extentOrdinals.find( key );
+            if ( it == extentOrdinals.end() )
+                return true;
+        }
+        
+        for ( ; n >= 0; n = running.findFirstSet( vlsMaskBits ) ) {
+            if ( scanExtentWatermarks[n] <= it->second )
+                return true;
+            running.reset( n );
+        }
+        return false;
+    }
+    
+    int Collection::acquireScanBit(const StringData& ns, Database** db, Collection** collection) {
+        uint64_t collectionId = (*collection)->instanceId;
+        while ( true ) {
+            uint64_t releases = ScanBitAllocator::numReleases();
+            int n = (*db)->activeMask.tryAcquire();
+            if ( n >= 0 )
+                return n;
+            
+            // a nested lock can not be given up while waiting
+            uassert( 17335, "every VLS scan bit is taken, and the lock cannot be "
+                     "released to wait for one", !Lock::isLocked() || !Lock::nested() );
+            {
+                dbtempreleasecond unlock;
+                ScanBitAllocator::waitForRelease( releases );
+            }
+            
+            // the context of the caller looked the database up again
+            *db = cc().database();
+            *collection = *db == NULL ? NULL : (*db)->getCollection( ns );
+            if ( *collection == NULL || (*collection)->instanceId != collectionId ||
+                 !(*collection)->vlsEnabled )
+                return -1;
+        }
+    }
+    
+    void Collection::endVLSScan(int n, bool active) {
+        uint64_t oldestEpoch;
+        {
+            stableMaskWriteLock smw_lock(SMLock);
+
+            // same as a scan that read everything: updates stop preserving
+            // documents for bit n, which now reads as "not read yet"
+            if ( active ) {
+                localActiveMask.set( n );
+                localIndexActiveMask.set( n );
+                stableMask.flip( n );
+            }
+            oldestEpoch = endScanEpoch( n );
+        }
+        reclaimDocumentSet( oldestEpoch );
+    }
+
+    void Collection::abandonVLSScan(Database* db, int n, uint64_t scanStableMask, bool active) {
+        endVLSScan( n, active );
+
+        // only part of the records had bit n flipped by the scan
+        FlipPhase* flip = new FlipPhase( db, this, scanStableMask, n );
+        flip->go();
+    }
+
+    void Collection::abandonVLSScan(const StringData& ns, uint64_t databaseId,
+                                    uint64_t collectionId, int n, uint64_t scanStableMask,
+                                    bool active, int indexScanId) {
+        // the caller may hold a lock on another database, or the write lock
+        // of the drop that is freeing the collection: nothing is read here
+        FlipPhase* flip = new FlipPhase( ns, databaseId, collectionId, scanStableMask,
+                                         n, active, indexScanId );
+        flip->go();
+    }
+
+    int Collection::registerIndexScan(const index_scan_info& indexScanInfo) {
+        indexScanMapLock::scoped_lock ism_lock(ISMLock);
+        int scanId = indexScanId++;
+        indexScanMap.insert( std::make_pair( scanId, indexScanInfo ) );
+        return scanId;
+    }
+    
+    void Collection::unregisterIndexScan(int scanId) {
+        indexScanMapLock::scoped_lock ism_lock(ISMLock);
+        indexScanMap.erase( scanId );
+    }
+    
+    void Collection::addRemovedIndexKey(int idxNumber, const DiskLoc& loc, const BSONObj& key) {
+        indexScanMapLock::scoped_lock ism_lock(ISMLock);
+        if ( indexScanMap.empty() )
+            return;
+        
+        // scan sets are only written under the database lock, which
+        // writers hold exclusively
+        int _a = loc.a();
+        ID id = recordId(loc);
+        boost::unordered_map< int, index_scan_info >::iterator it;
+        for (it = indexScanMap.begin(); it != indexScanMap.end(); it++) {
+            if ( (it->second).idxNumber != idxNumber )
+                continue;
+            if ( _keyWithinBounds( it->second, key ) )
+                (it->second).scanSet->add( _a, id );
+        }
+    }
+
     void Collection::printDocumentSet() {
             
         log() << "Printing Document Set..." << endl;
         
-        doc_set::iterator it;
-        uint64_t key;
-        queue_document value;
+        DocumentSet* set = documentSet;
+        if ( set == NULL )
+            return;
+        
+        uint64_t key = set->begin();
+        DocumentSet::Cursor cursor = set->cursor( key, set->end() );
         
-        for( it = documentSet.begin(); it != documentSet.end(); it++) {
-            key = it->first;
-            value = it->second;
+        while ( cursor.more() ) {
+            const queue_document& value = cursor.next();
             
-            log() << "Key: " << key << " | Value: " << value.document.toString() << " & " << value.queueStatusMask << endl;
+            log() << "Key: " << key++ << " | Value: " << value.document.toString() << " & " << value.queueStatusMask.toString() << " @ " << value.epoch << endl;
         }
     }
     
-    uint64_t Collection::computeStatusMask() {
+    vls_mask Collection::computeStatusMask() {
         return ~ ( stableMask ^ localActiveMask );
     }
                 
-    uint64_t Collection::computeQueueStatusMask(uint64_t statusMask) {
+    vls_mask Collection::computeQueueStatusMask(const vls_mask& statusMask) {
         return ( (stableMask ^ statusMask) | localActiveMask );
     }
 
@@ -315,12 +1047,15 @@ namespace mongo {
                                                  const CollectionScanParams::Direction& dir,
                                                  bool use_chronos,
                                                  uint64_t scanMask,
-                                                 uint64_t scanStableMask) {
+                                                 uint64_t scanStableMask,
+                                                 int scanWord,
+                                                 const DiskLoc& startExtent) {
         
         verify( ok() );
         if ( _details->isCapped() )
-            return new CappedIterator( this, start, tailable, dir, use_chronos, scanMask, scanStableMask );
-        return new FlatIterator( this, start, dir, use_chronos, scanMask, scanStableMask );
+            return new CappedIterator( this, start, tailable, dir, use_chronos, scanMask, scanStableMask, scanWord );
+        return new FlatIterator( this, start, dir, use_chronos, scanMask, scanStableMask, scanWord,
+                                 startExtent );
     }
 
     BSONObj Collection::docFor( const DiskLoc& loc ) {
@@ -384,7 +1119,7 @@ namespace mongo {
         // ---- VLS ---- //
                         
         // inserting status mask
-        if (isUserCollection)
+        if (statusMaskMapInit)
             insertValue(loc.getValue(), computeStatusMask());
         
         // ---- VLS ---- //
@@ -432,36 +1167,52 @@ namespace mongo {
         
         // ---- VLS ---- //
         
-        if (isUserCollection) {
+        if (statusMaskMapInit) {
             
             // before deleting the document, check if we need to copy it to
             // the shared queue (documentSet)
         	int _a = loc.a();
-        	ID id = loc.id(ofsMap[_a]);
-        	uint64_t queueStatusMask;
+        	ID id = recordId(loc);
+        	vls_mask queueStatusMask;
             
-        	st_mask_map* _statusMaskMap = &statusMaskMapVector[_a];
+            // a delta against this version cannot be rebuilt once it is gone
+            _materializeDelta( _a, id, doc );
                     
-			// computing Queue Status Mask
-			queueStatusMask = computeQueueStatusMask( _statusMaskMap->at(id) );
+			// computing Queue Status Mask, unless no scan can still read the document
+			if ( scansNeedVersionAt(loc) )
+			    queueStatusMask = computeQueueStatusMask( loadStatusMask(_a, id) );
+			else
+			    queueStatusMask = vls_mask( 0xFFFFFFFFFFFFFFFF );
                     
 			// if AND(Queue Status Mask) is 0, document must be copied to queue first
-            if ( queueStatusMask != 0xFFFFFFFFFFFFFFFF ) {
+            if ( !queueStatusMask.all() ) {
                 
-                // adding document to shared document set
-                documentSet.insert( std::make_pair( documentSetKey++, queue_document(doc, id, _a, queueStatusMask) ) );
-                documentSetSize += 1;
+                // adding the fields the scans read to shared document set
+                BSONObj preserved;
+                preservedVersion( doc, NULL, queueStatusMask, &preserved );
+                addToDocumentSet( preserved, id, _a, queueStatusMask );
             }
             
             // removing status mask from the map
-            _statusMaskMap->at(id) = 0x0;
+            storeStatusMask(_a, id, vls_mask( 0x0 ));
+            idOfsMap[_a][id] = 0;
         }
         
         // ---- VLS ---- //
         
-        _indexCatalog.unindexRecord( doc, loc, noWarn);
+        // the entries of a deleted record cannot wait for running index
+        // scans to finish, since its location may be reused: they are
+        // removed now and handed to the scans (see addRemovedIndexKey())
+        _indexCatalog.unindexDeletedRecord( doc, loc, noWarn );
 
         _recordStore.deleteRecord( loc );
+        
+        // ---- VLS ---- //
+        
+        if (statusMaskMapInit)
+            _releaseSlot( loc );
+        
+        // ---- VLS ---- //
 
         _infoCache.notifyOfWriteOp();
     }
@@ -540,59 +1291,70 @@ namespace mongo {
             }
 
             StatusWith<DiskLoc> loc = _insertDocument( objNew, enforceQuota );
-            
-            ID id;
-            int _a;
 
             if ( loc.isOK() ) {
                 // insert successful, now lets deallocate the old location
                 // remember its already unindexed
                 _recordStore.deleteRecord( oldLocation );
-                
-                // removing oldLocation from map
-                ID old_id = oldLocation.id(ofsMap[oldLocation.a()]);
-                st_mask_map* _statusMaskMap = &statusMaskMapVector[oldLocation.a()];
-                uint64_t statusMask = _statusMaskMap->at(old_id);
-                _statusMaskMap->at(old_id) = 0x0;
-                idOfsMap[oldLocation.a()][old_id] = 0;
-                
-                // adding new location to map
-                _a = loc.getValue().a();
-                id = insertValue(loc.getValue(), statusMask);
             }
             else {
                 // new doc insert failed, so lets re-index the old document and location
                 _indexCatalog.indexRecord( objOld, oldLocation );
-                
-                _a = oldLocation.a();
-                id = oldLocation.id(ofsMap[_a]);
             }
             
             // ---- VLS ---- //
                             
-            if (isUserCollection) {
+            if (statusMaskMapInit) {
+                
+                ID id;
+                int _a;
+                
+                // a delta against the old version cannot be rebuilt once it moves
+                _materializeDelta( oldLocation.a(), recordId(oldLocation), objOld );
+                
+                if ( loc.isOK() ) {
+                    // removing oldLocation from map
+                    ID old_id = recordId(oldLocation);
+                    vls_mask statusMask = loadStatusMask(oldLocation.a(), old_id);
+                    storeStatusMask(oldLocation.a(), old_id, vls_mask( 0x0 ));
+                    idOfsMap[oldLocation.a()][old_id] = 0;
+                    
+                    // adding new location to map
+                    _a = loc.getValue().a();
+                    id = insertValue(loc.getValue(), statusMask);
+                }
+                else {
+                    _a = oldLocation.a();
+                    id = recordId(oldLocation);
+                }
                         
                 // before updating the document, check if we need to copy it to
                 // the shared queue (documentSet)
-                //st_mask_map* _statusMaskMap = &statusMaskMapVector[_a];
-                
-                uint64_t queueStatusMask;
+                vls_mask queueStatusMask;
                         
                 // computing Queue Status Mask
-                queueStatusMask = computeQueueStatusMask( (&statusMaskMapVector[_a])->at(id) );
+                queueStatusMask = computeQueueStatusMask( loadStatusMask(_a, id) );
                 
                 //log() << "[Update] Status mask from document a=" << id.first << ", ofs=" << id.second << " is " << statusMask << endl;
                 
                 // if AND(Queue Status Mask) is 0, document must be copied to queue first
-                if ( queueStatusMask != 0xFFFFFFFFFFFFFFFF ) {
+                if ( !queueStatusMask.all() ) {
                     
                     // updating status mask in the map
-                    (&statusMaskMapVector[_a])->at(id) = computeStatusMask();
+                    storeStatusMask(_a, id, computeStatusMask());
                     
-                    // adding document to shared document set
-                    documentSet.insert( std::make_pair( documentSetKey++, queue_document(objOld, id, _a, queueStatusMask) ) );
-                    documentSetSize += 1;
+                    // adding the fields the scans read to shared document set;
+                    // a moved document is preserved even if they did not change,
+                    // since the scans may see it at neither location
+                    BSONObj preserved;
+                    preservedVersion( objOld, &objNew, queueStatusMask, &preserved );
+                    bool full = preserved.objdata() == objOld.objdata();
+                    addToDocumentSet( preserved, id, _a, queueStatusMask,
+                                      loc.isOK() && full ? &objNew : NULL );
                 }
+                
+                if ( loc.isOK() )
+                    _releaseSlot( oldLocation );
             }
             
             // ---- VLS ---- //
@@ -602,27 +1364,37 @@ namespace mongo {
         
         // ---- VLS ---- //
                 
-        if (isUserCollection) {
+        if (statusMaskMapInit) {
                     
             // before updating the document, check if we need to copy it to
             // the shared queue (documentSet)
             int _a = oldLocation.a();
-            ID id = oldLocation.id(ofsMap[_a]);
-            uint64_t queueStatusMask;
+            ID id = recordId(oldLocation);
+            vls_mask queueStatusMask;
+            
+            // a delta against this version cannot be rebuilt once it changes
+            _materializeDelta( _a, id, objOld );
                     
-            // computing Queue Status Mask
-            queueStatusMask = computeQueueStatusMask( (&statusMaskMapVector[_a])->at(id) );
+            // computing Queue Status Mask, unless no scan can still read the document
+            if ( scansNeedVersionAt(oldLocation) )
+                queueStatusMask = computeQueueStatusMask( loadStatusMask(_a, id) );
+            else
+                queueStatusMask = vls_mask( 0xFFFFFFFFFFFFFFFF );
             
             //log() << "[Update] Status mask from document a=" << id.first << ", ofs=" << id.second << " is " << statusMask << endl;
             
-            // if AND(Queue Status Mask) is 0, document must be copied to queue first
-            if ( queueStatusMask != 0xFFFFFFFFFFFFFFFF ) {
+            // if AND(Queue Status Mask) is 0, document must be copied to queue
+            // first, unless the scans that need it read none of the fields that
+            // change: they can still read them from the record
+            BSONObj preserved;
+            if ( !queueStatusMask.all() &&
+                 preservedVersion( objOld, &objNew, queueStatusMask, &preserved ) ) {
                 
                 // experimental purpose
-                //uint64_t statusMask = (&statusMaskMapVector[_a])->at(id); 
+                //vls_mask statusMask = loadStatusMask(_a, id);
                 
                 // updating status mask in the map
-                (&statusMaskMapVector[_a])->at(id) = computeStatusMask();
+                storeStatusMask(_a, id, computeStatusMask());
                 
                 // experimental purpose
                 /*uint64_t debugMask = statusMask ^ computeStatusMask();
@@ -633,14 +1405,14 @@ namespace mongo {
                 }
                 noReclamationQueueSize += 1;*/
                 
-                // adding document to shared document set
-                documentSet.insert( std::make_pair( documentSetKey++, queue_document(objOld, id, _a, queueStatusMask) ) );
-                documentSetSize += 1;
+                // adding the fields the scans read to shared document set
+                bool full = preserved.objdata() == objOld.objdata();
+                addToDocumentSet( preserved, id, _a, queueStatusMask, full ? &objNew : NULL );
                 
                 // experimental purpose
                 /*struct timeval tp;
                 gettimeofday(&tp, NULL);
-                debug_str << "Queue Size: " << documentSet.size() << "/" << worstQueueSize.fetch_and_add(0) << "/" << noReclamationQueueSize.fetch_and_add(0) << "/" << (tp.tv_sec * 1000000000 + tp.tv_usec * 1000) << endl;*/
+                debug_str << "Queue Size: " << documentSet->size() << "/" << worstQueueSize.fetch_and_add(0) << "/" << noReclamationQueueSize.fetch_and_add(0) << "/" << (tp.tv_sec * 1000000000 + tp.tv_usec * 1000) << endl;*/
             }
         }
         
@@ -659,8 +1431,15 @@ namespace mongo {
             int64_t updatedKeys;
             iam->setCollection(this);
             Status ret = iam->update(*updateTickets.vector()[i], &updatedKeys);
-            if ( !ret.isOK() )
+            if ( !ret.isOK() ) {
+                // ---- VLS ---- //
+                // the record keeps the old version, which a delta against
+                // objNew cannot be rebuilt from
+                if ( statusMaskMapInit )
+                    _materializeDelta( oldLocation.a(), recordId(oldLocation), objNew );
+                // ---- VLS ---- //
                 return StatusWith<DiskLoc>( ret );
+            }
             if ( debug )
                 debug->keyUpdates += updatedKeys;
         }
@@ -741,58 +1520,168 @@ namespace mongo {
         return _details->dataSize();
     }
     
-    // Fillping bits as a background job
+    // Flipping bits as a background job
     
-    FlipPhase::FlipPhase() {}
+    namespace {
+        
+        /* Number of status masks flipped per acquisition of the database lock:
+           large enough to amortize the lock, small enough not to hold off writes */
+        const size_t FlipBatchSize = 8192;
+        
+        /* Sets (or clears) the bits of 'bits' in 'word' with a compare-and-swap,
+           so that bits flipped concurrently by other scans are kept */
+        inline void flipStatusBits( tbb::atomic<uint64_t>& word, uint64_t bits, bool set ) {
+            uint64_t old = word;
+            for ( ;; ) {
+                uint64_t flipped = set ? ( old | bits ) : ( old & ~bits );
+                if ( flipped == old )
+                    return; // already flipped; do not dirty the cache line
+                uint64_t seen = word.compare_and_swap( flipped, old );
+                if ( seen == old )
+                    return;
+                old = seen;
+            }
+        }
+        
+    }
+    
+    FlipPhase::FlipPhase() : BackgroundJob( true ) {}
     
     FlipPhase::FlipPhase(Database* db, Collection* collection,
-            uint64_t scanStableMask, uint64_t scanMask)
-    : _db(db),
-      _collection(collection),
+            uint64_t scanStableMask, int scanBit)
+    : BackgroundJob( true ),
+      _ns(collection->ns().ns()),
+      _databaseId(db->activeMask.instanceId()),
+      _collectionId(collection->instanceId),
       _scanStableMask(scanStableMask),
-      _scanMask(scanMask) {}
+      _scanBit(scanBit),
+      _endScan(false),
+      _active(false),
+      _indexScanId(-1) {}
+    
+    FlipPhase::FlipPhase(const StringData& ns, uint64_t databaseId, uint64_t collectionId,
+            uint64_t scanStableMask, int scanBit, bool active, int indexScanId)
+    : BackgroundJob( true ),
+      _ns(ns.toString()),
+      _databaseId(databaseId),
+      _collectionId(collectionId),
+      _scanStableMask(scanStableMask),
+      _scanBit(scanBit),
+      _endScan(true),
+      _active(active),
+      _indexScanId(indexScanId) {}
     
     FlipPhase::~FlipPhase() {}
     
+    Collection* FlipPhase::_lookUp(Database** db) const {
+        // the collection (or its database) may have been dropped, and even
+        // recreated, while no lock was held
+        *db = dbHolder().get( _ns, storageGlobalParams.dbpath );
+        if ( *db == NULL || (*db)->activeMask.instanceId() != _databaseId ) {
+            *db = NULL;
+            return NULL;
+        }
+        Collection* collection = (*db)->getCollection( _ns );
+        if ( collection == NULL || collection->instanceId != _collectionId )
+            return NULL;
+        return collection;
+    }
+    
     void FlipPhase::run()
     {
         Client::initThread( "flipping-bits" );
+        Timer t;
+        
+        // a scan that stopped before it was done is ended here, under a lock
+        // of its own database, rather than by the thread that abandoned it
+        if ( _endScan ) {
+            Lock::DBRead lk( _ns );
+            Database* db;
+            Collection* collection = _lookUp( &db );
+            if ( collection != NULL ) {
+                if ( _indexScanId != -1 )
+                    collection->unregisterIndexScan( _indexScanId );
+                collection->endVLSScan( _scanBit, _active );
+            }
+        }
         
         bool stableIsZero = (_scanStableMask == 0x0) ? true : false;
         
-        for (int i = 0; i < (int)_collection->statusMaskMapVector.size(); i++)
+        // only the plane that holds the bit of the scan needs to be flipped
+        size_t plane = vls_mask::wordOf(_scanBit);
+        uint64_t scanMask = vls_mask::bitOf(_scanBit);
+        
+        // the bit stays taken (quarantined) until every record has been flipped,
+        // but other scans keep running meanwhile; the database lock is only held
+        // for one batch at a time, since writes in between may grow the maps,
+        // and the collection is looked up again each time, since it may have
+        // been dropped in between (its status masks are then gone)
+        bool dropped = false;
+        int numVolumes = 1;
+        for (int i = 0; i < numVolumes && !dropped; i++)
         {
-            st_mask_map* statusMaskMap = &(_collection->statusMaskMapVector[i]);
-            for( st_mask_map::iterator it = statusMaskMap->begin();
-                    it != statusMaskMap->end(); it++)
+            for (size_t id = 0; ; )
             {
-                Lock::DBRead lk( _db->name() );
+                Lock::DBRead lk( _ns );
                 
-                if ( stableIsZero )
-                    (it)->fetch_and_store( _scanMask | (*it) );
-                else
-                    (it)->fetch_and_store( ~_scanMask & (*it) );
+                Database* db;
+                Collection* collection = _lookUp( &db );
+                if ( collection == NULL ) {
+                    dropped = true;
+                    break;
+                }
+                st_mask_map_vector* statusMaskMapVector =
+                    &(collection->statusMaskPlanes[plane]);
+                
+                numVolumes = (int)statusMaskMapVector->size();
+                if ( i >= numVolumes )
+                    break;
+                
+                st_mask_map* statusMaskMap = &(*statusMaskMapVector)[i];
+                size_t end = std::min( id + FlipBatchSize, statusMaskMap->size() );
+                for (; id < end; id++)
+                    flipStatusBits( (*statusMaskMap)[id], scanMask, stableIsZero );
                 
+                if ( id >= statusMaskMap->size() )
+                    break;
             }
         }
         
-        // updating Active Mask and Stable Mask
-        // note that Stable Mask can be updated before scanning the queue
+        bool skipped = false;
         {
-            activeMaskWriteLock amw_lock(_db->AMLock);
-                          
-            _db->activeMask |= _scanMask;
-            _db->indexActiveMask |= _scanMask;
+            Lock::DBRead lk( _ns );
             
-            //log() << "Active Mask (2): " << std::hex << _db->activeMask << endl;
-            //log() << "Stable Mask (2): " << std::hex << _collection->stableMask << endl;
+            Database* db;
+            Collection* collection = _lookUp( &db );
             
-            // allow an awaiting scan to start
-            _db->activeMaskFull = false;   
+            // index entries changed while the scan ran no longer need its bit
+            if ( collection != NULL )
+                skipped = collection->getIndexCatalog()->resetIndexDeltas( _scanBit );
             
-        } // releasing active mask lock
+            uint64_t millis = t.millis();
+            flipPhaseCounter.increment();
+            flipPhaseMillisCounter.increment( millis );
+            flipPhaseLastMillis.store( millis );
+            
+            // releasing the scan's bit; the Stable Mask was already updated
+            // when the scan finished, and an awaiting scan may now start.
+            // A dropped database took its bits along.
+            if ( db != NULL )
+                db->activeMask.release( _scanBit );
+        }
         
-        _db->activeMaskCondition.notify_one();
+        // removed index entries no scan reads anymore leave the index; the
+        // write lock is only taken once the bit is back, so that scans
+        // waiting for a bit never wait for the writers queued ahead of it
+        // (until then, every scan skips the entries)
+        if ( skipped ) {
+            Lock::DBWrite lk( _ns );
+            
+            Database* db;
+            Collection* collection = _lookUp( &db );
+            if ( collection != NULL )
+                collection->getIndexCatalog()->unindexSkippedEntries();
+        }
 
     }
 
@@ -70,6 +70,10 @@
 #include "mongo/db/diskloc.h"
 #include "mongo/db/exec/collection_scan_common.h"
 #include "mongo/db/namespace_string.h"
+#include "mongo/db/structure/document_set.h"
+#include "mongo/db/structure/record_slot_table.h"
+#include "mongo/db/structure/scan_set.h"
+#include "mongo/db/structure/vls_mask.h"
 #include "mongo/db/structure/record_store.h"
 #include "mongo/db/structure/collection_info_cache.h"
 #include "mongo/db/query/index_bounds.h"
@@ -81,7 +85,6 @@
 
 #include "mongo/util/background.h"
 
-#include "tbb/concurrent_hash_map.h"
 #include "tbb/atomic.h"
 
 #include <iostream>
@@ -116,41 +119,6 @@ namespace mongo {
     
     // ---- VLS ---- //
     
-    /* Identifies a Disk Loc (_a, ofs)*/
-    typedef uint32_t ID;
-    
-    /**
-     * Used to represent a document in the shared queue (document set).
-     */
-    struct queue_document {
-        BSONObj document;
-        ID id;
-        int _a;
-        uint64_t queueStatusMask;
-        
-        queue_document()
-                : queueStatusMask( 0x0 ) { }
-        
-        queue_document(BSONObj doc, ID id, int _a, uint64_t queueStatusMask)
-                : document( doc.copy() ),
-                  id( id ),
-                  _a( _a ),
-                  queueStatusMask( queueStatusMask ) { }
-        
-        queue_document(const queue_document& queueDocument) {
-            document = queueDocument.document;
-            id = queueDocument.id;
-            _a = queueDocument._a;
-            queueStatusMask = queueDocument.queueStatusMask;
-        }
-    };
-    
-    /* Scan Set */
-    typedef std::vector< uint8_t > scan_set;
-    
-    /* Vector of Scan Set */
-    typedef std::vector<scan_set> scan_set_vector;
-    
     /**
      * Used to pass information about each index scan to the collection.
      * For index update purposes.
@@ -159,23 +127,18 @@ namespace mongo {
         const IndexBounds bounds;
         const BSONObj keyPattern;
         int direction;
-        scan_set_vector* scanSetVector;
+        int idxNumber;
+        ScanSet* scanSet;
         
         index_scan_info() { }
         
         index_scan_info(const IndexBounds _bounds, const BSONObj _keyPattern,
-                int _direction, scan_set_vector* _scanSetVector)
+                int _direction, int _idxNumber, ScanSet* _scanSet)
                     :  bounds(_bounds),
                        keyPattern(_keyPattern),
                        direction(_direction),
-                       scanSetVector(_scanSetVector) { }
-        
-        /*index_scan_info(const index_scan_info& indexScanInfo) {
-            bounds = indexScanInfo.bounds;
-            keyPattern = indexScanInfo.keyPattern;
-            direction = indexScanInfo.direction;
-            scanSetVector = indexScanInfo.scanSetVector;
-        }*/
+                       idxNumber(_idxNumber),
+                       scanSet(_scanSet) { }
     };
     
     /* Status Mask Map */
@@ -184,10 +147,10 @@ namespace mongo {
     /* Vector of Status Mask Map -- one per DiskLoc Volume */
     typedef std::vector<st_mask_map> st_mask_map_vector;
     
-    /* Document Set */
-    typedef tbb::concurrent_hash_map<uint64_t, queue_document> doc_set;
+    /* Vector of Status Mask Map Vectors -- one per 64-bit word of the status masks */
+    typedef std::vector<st_mask_map_vector> st_mask_plane_vector;
     
-    /* Map between DiskLoc Volume and its initial Offset */
+    /* Map between ID and ofs value of the records of a DiskLoc Volume */
     typedef std::vector<int> ofs_map;
     
     /* Stable Mask locks */
@@ -195,13 +158,27 @@ namespace mongo {
     typedef boost::unique_lock< stableMaskLock > stableMaskWriteLock;
     typedef boost::shared_lock< stableMaskLock > stableMaskReadLock;
     
+    /* Status Mask Map lock */
+    typedef boost::mutex statusMaskMapLock;
+    
     /* Document Set locks */
     typedef boost::shared_mutex documentSetLock;
     typedef boost::unique_lock< documentSetLock > documentSetWriteLock;
     
-    /* Locks for Resetting Index Status Masks */
+    /* Index Delta locks (see IndexCatalog::indexDeltas) */
     typedef boost::shared_mutex indexMaskLock;
     typedef boost::unique_lock< indexMaskLock > indexMaskWriteLock;
+    typedef boost::shared_lock< indexMaskLock > indexMaskReadLock;
+    
+    /* Index Scan Map lock */
+    typedef boost::mutex indexScanMapLock;
+    
+    /* Width of the VLS masks in 64-bit words, i.e., the 'vlsMaskBits'
+       server parameter (64, 128 or 256) divided by 64 */
+    int vlsMaskWords();
+    
+    /* 'vlsSharedScans' server parameter (see Collection::sharedScanStart()) */
+    extern bool vlsSharedScans;
     
     // ---- VLS ---- //
 
@@ -232,85 +209,281 @@ namespace mongo {
         
         // ---- VLS ---- //
         
-        /* Indicates if the collection was created by the user */
-        bool isUserCollection;
+        /* Indicates if VLS is enabled for the collection, i.e., if the collection
+           keeps status masks and a document set for VLS scans. Collections opt in
+           through the 'vls' collection option (collMod) or the 'vlsNamespaces'
+           server parameter; all other collections skip the VLS bookkeeping. */
+        bool vlsEnabled;
+        
+        /* Enables or disables VLS for the collection, allocating or releasing
+           the VLS in-memory structures. Requires a write lock on the database. */
+        Status setVLSEnabled(bool enabled);
         
         /* stableMask controls the value of the bit that represents a stable
            version for each vector of bits in the collection */
-        uint64_t stableMask;
+        vls_mask stableMask;
         
         /* Local active mask */
-        uint64_t localActiveMask;
+        vls_mask localActiveMask;
         
         /* Local index active mask */
-        uint64_t localIndexActiveMask;
+        vls_mask localIndexActiveMask;
         
         /* Stable Mask lock */
         stableMaskLock SMLock;
         
-        /* In-memory set for storing stable version of documents.
-           This is what we used to call queue. */
-        doc_set documentSet;
-        
-        /* Key for DocumentSet */
-        uint64_t documentSetKey;
+        /* Top-level fields ({field: true}) read by the scan holding each bit,
+           or an empty object if it reads whole documents. Set under SMLock
+           when the scan starts, and read by writers (see preservedVersion()).
+           Like the other per-bit state below, one per bit of the masks
+           (vlsMaskBits) once VLS is enabled, and empty otherwise. */
+        std::vector<BSONObj> scanFields;
+        
+        /* Sets the fields read by the scan holding bit n, adding the fields
+           of keyPattern if fields is not empty. Requires a write lock on SMLock. */
+        void setScanFields(int n, const BSONObj& fields, const BSONObj& keyPattern = BSONObj());
+        
+        /* Sets preserved to the version of doc, replaced by current (NULL for
+           a delete), that the scans still needing it (0 bits of
+           queueStatusMask) read: only the fields they read, and _id. Returns
+           false if current does not change any of these fields. */
+        bool preservedVersion(const BSONObj& doc, const BSONObj* current,
+                              const vls_mask& queueStatusMask, BSONObj* preserved);
+        
+        /* In-memory log for storing stable version of documents.
+           This is what we used to call queue. It is only allocated by the
+           first VLS scan over the collection (see getDocumentSet()) and
+           grows by one segment at a time with the preserved versions. */
+        tbb::atomic<DocumentSet*> documentSet;
         
         /* Size of DocumentSet */
         tbb::atomic<int> documentSetSize;
         
-        /* Document Set lock */
+        /* Bytes of preserved document versions in memory, number of segments,
+           and bytes of spilled versions of DocumentSet, as reported in
+           serverStatus (metrics.vls.documentSet) */
+        tbb::atomic<uint64_t> documentSetBytes;
+        tbb::atomic<uint64_t> documentSetSegments;
+        tbb::atomic<uint64_t> documentSetSpilledBytes;
+        
+        /* Returns the document set, allocating it on first use. */
+        DocumentSet* getDocumentSet();
+        
+        /* Copies a stable version of a document into the document set,
+           tagged with the current scan epoch. With current, the version that
+           replaces doc, doc may be kept as a delta against it (see
+           vlsDeltaPreImages). Requires a write lock on the collection. */
+        void addToDocumentSet(const BSONObj& doc, ID id, int _a, const vls_mask& queueStatusMask,
+                              const BSONObj* current = NULL);
+        
+        /* Frees, in bulk, the segments of the document set preserved
+           before oldestEpoch. */
+        void reclaimDocumentSet(uint64_t oldestEpoch);
+        
+        /* Document Set lock -- serializes its allocation */
         documentSetLock DSLock;
         
+        /* Scan epoch: incremented every time a VLS scan starts over the
+           collection. A document preserved in epoch e is only needed by the
+           scans that started in epoch e or before. */
+        tbb::atomic<uint64_t> scanEpoch;
+        
+        /* Epoch in which the scan holding each bit started, or 0 once that
+           scan is done with the document set. Guarded by SMLock. */
+        std::vector<uint64_t> activeScanEpochs;
+        
+        /* Starts a new scan epoch for the scan holding bit n and returns it.
+           Requires a write lock on SMLock. */
+        uint64_t beginScanEpoch(int n);
+        
+        /* Marks the scan holding bit n as done with the document set and
+           returns the oldest epoch still needed by a running scan, to be
+           passed to reclaimDocumentSet(). Requires a write lock on SMLock. */
+        uint64_t endScanEpoch(int n);
+        
+        /* Ordinal of each extent in the extent chain of the collection, keyed
+           by its location (see extentKey()), and the last extent numbered.
+           Only extended by writers (see scansNeedVersionAt()). */
+        boost::unordered_map<uint64_t, uint64_t> extentOrdinals;
+        DiskLoc lastOrdinalExtent;
+        
+        static uint64_t extentKey(const DiskLoc& extentLoc) {
+            return ( static_cast<uint64_t>( extentLoc.a() ) << 32 ) |
+                static_cast<uint32_t>( extentLoc.getOfs() );
+        }
+        
+        /* Watermark of the forward collection scan holding each bit: the
+           scan has read every record of the extents with a lower ordinal,
+           flipping their bits. 0 for other scans. */
+        std::vector< tbb::atomic<uint64_t> > scanExtentWatermarks;
+        
+        /* Location of the extent holding the record at loc */
+        DiskLoc extentOf(const DiskLoc& loc);
+        
+        /* Moves the watermark of the scan holding bit n to the extent at
+           extentLoc, which the scan just entered. Requires a read lock on
+           the collection. */
+        void advanceScanWatermark(int n, const DiskLoc& extentLoc);
+        
+        /* Extent the forward collection scan holding each bit is reading
+           (see extentKey()), or 0 */
+        std::vector< tbb::atomic<uint64_t> > scanPositions;
+        
+        /* Records that the scan holding bit n entered the extent at extentLoc */
+        void setScanPosition(int n, const DiskLoc& extentLoc);
+        
+        /* Extent where the forward collection scan holding bit n starts if
+           'vlsSharedScans' is set: the one read by the running collection
+           scan that started last, so that both scans read the next extents
+           together, the new one wrapping around to the first extent at the
+           end. The null DiskLoc to start at the first extent. Requires a
+           write lock on SMLock and a read lock on the collection. */
+        DiskLoc sharedScanStart(int n);
+        
+        /* False if no running scan may read the record at loc anymore, i.e.,
+           no scan is running or every one of them is past its extent; then
+           its status mask does not need to be read before the record changes.
+           Requires a write lock on the collection. */
+        bool scansNeedVersionAt(const DiskLoc& loc);
+
+        /* Takes a bit of the active mask of *db for a new VLS scan over ns,
+           for which the caller holds a read lock through a Client::Context.
+           While every bit is taken, the lock is released to wait for one,
+           since the scans holding the bits (and their FlipPhases) may need
+           it to give them back; *db and *collection are then looked up
+           again. Returns -1 if ns no longer names the same collection, with
+           VLS enabled, then. */
+        static int acquireScanBit(const StringData& ns, Database** db, Collection** collection);
+        
+        /* Unique for the life of the server, unlike the address of the
+           collection, which a collection created after a drop may reuse */
+        uint64_t instanceId;
+        
+        /* Ends a VLS scan (collection or index scan) holding bit n of db
+           that stops before it is done, e.g., a losing candidate plan or
+           a killed cursor. The scan is marked inactive if it still was
+           (active), its document set generations are reclaimed, and the
+           bit goes back to db once the status masks of the bit, which may
+           be half flipped, are reset in the background by FlipPhase.
+           Requires a read lock on the database. */
+        void abandonVLSScan(Database* db, int n, uint64_t scanStableMask, bool active);
+        
+        /* Same, for a scan that may outlive the collection and may run without
+           a lock (e.g., the destructor of a cursor erased after a drop): the
+           scan is ended by FlipPhase, which looks ns up again under its own
+           lock. Collection-side state is only reset if ns still names the
+           collection (collectionId) of the database (databaseId) the scan
+           started on; the bit still goes back to that database if the
+           collection alone was dropped. indexScanId is the registration of
+           an index scan (see registerIndexScan()), or -1. */
+        static void abandonVLSScan(const StringData& ns, uint64_t databaseId,
+                                   uint64_t collectionId, int n, uint64_t scanStableMask,
+                                   bool active, int indexScanId);
+        
+        /* Marks bit n inactive if it still was (active) and ends its scan
+           epoch, reclaiming the document set generations no scan needs.
+           Requires a read lock on the database. */
+        void endVLSScan(int n, bool active);
+
         /* Index Mask lock */
         indexMaskLock IMLock;
         
-        /* Vector of Status Mask Maps, one per DiskLoc Volume.
+        /* Vectors of Status Mask Maps, one per DiskLoc Volume.
            A Status Mask Map is a in-memory map
            that keeps tracks of the Status Mask
-           of each document in the collection, based on the _id.
-           The key is the _id field (int value), and the value is
-           the status mask. */
-        st_mask_map_vector statusMaskMapVector;
-        
-        /* Offset Map */
-        ofs_map ofsMap;
+           of each document in the collection, based on its ID.
+           The key is the ID (see recordId()), and the value is
+           the status mask.
+           Status masks are split in planes, one per 64-bit word (see
+           vlsMaskWords()): statusMaskPlanes[w][a][id] is word w of the
+           status mask of record id of volume a. A scan only reads and
+           flips the plane that holds its bit. */
+        st_mask_plane_vector statusMaskPlanes;
+        
+        /* Reads the status mask of a record from every plane */
+        vls_mask loadStatusMask(int a, ID id) const;
+        
+        /* Writes the status mask of a record into every plane */
+        void storeStatusMask(int a, ID id, const vls_mask& mask);
+        
+        /* Vector of Slot Tables, one per DiskLoc Volume, giving the
+           dense ID of each record of the volume */
+        slot_table_vector slotTableVector;
+        
+        /* Returns the ID of a record, i.e., its index in the Status Mask Maps
+           of its DiskLoc Volume. The status mask map must be initialized. */
+        ID recordId(const DiskLoc& loc) const {
+            return slotTableVector[loc.a()].find(loc.getOfs());
+        }
         
-        /* Stores the maximum id for each DiskLoc */
-        std::vector< ID > max_id;
+        /* Claims the record at loc for the collection scan holding scanMask
+           in word 'word' of the status masks: returns true, after flipping
+           the bit of the scan in the status mask of the record, if the scan
+           has to read it, and false if the scan reads its version in the
+           document set instead. Does not use the Client of the thread, so
+           that the workers of a parallel scan can claim records. */
+        bool claimRecordForScan(const DiskLoc& loc, int word,
+                                uint64_t scanStableMask, uint64_t scanMask);
         
         /* ID for Index Scans */
         int indexScanId;
         
-        /* Map that contains all active scan sets */
-        //boost::unordered_map< int, index_scan_info > indexScanMap;
+        /* Map that contains the scan sets of the running index scans, by
+           scan ID, until they start reading the document set.
+           Guarded by ISMLock. */
+        boost::unordered_map< int, index_scan_info > indexScanMap;
+        
+        /* Index Scan Map lock */
+        indexScanMapLock ISMLock;
+        
+        /* Adds a running index scan to indexScanMap and returns its ID */
+        int registerIndexScan(const index_scan_info& indexScanInfo);
+        
+        /* Removes an index scan from indexScanMap */
+        void unregisterIndexScan(int scanId);
         
-        /* Mapping between ID and ofs value */
+        /* Called when key of the record at loc is removed from index
+           idxNumber (delete or update): the record is added to the scan
+           sets of the running scans over that index whose bounds contain
+           key, so that they read the version preserved in the document set
+           (as for REMOVED entries) instead of missing it. */
+        void addRemovedIndexKey(int idxNumber, const DiskLoc& loc, const BSONObj& key);
+        
+        /* Mapping between ID and ofs value; 0 for the IDs of deleted and
+           moved records */
         std::vector< ofs_map > idOfsMap;
         
-        /* Status Mask Map lock */
-        //statusMaskMapLock SMMLock;
+        /* Locations of the records deleted or moved whose slots were not
+           given back to the slot tables yet (see _releaseSlot()) */
+        std::vector<DiskLoc> releasedSlots;
+        
+        /* Status Mask Map lock -- serializes its initialization */
+        statusMaskMapLock SMMLock;
         
         /* For experimental purpose */
         //tbb::atomic<int> worstQueueSize;
         //tbb::atomic<int> noReclamationQueueSize;
         //std::stringstream debug_str;
         
-        /* Initialize status mask for each document of the collection. */
+        /* Initialize status mask for each document of the collection,
+           assigning an ID to each record. Called by every VLS scan before
+           it starts; only the first one does the work. */
         void initializeStatusMaskMap();
         
         /* Inserts a mask into status mask map. */
-        ID insertValue(const DiskLoc& loc, uint64_t mask);
+        ID insertValue(const DiskLoc& loc, const vls_mask& mask);
         
-        /* Indicates if the status mask map was initialized. */
-        bool statusMaskMapInit;
+        /* Indicates if the status mask map was initialized. Until then,
+           writes do not maintain status masks nor the document set. */
+        tbb::atomic<bool> statusMaskMapInit;
         
         /* Method used to compute a status mask for a document.
            Warning: This method does not take care of locking! */
-        uint64_t computeStatusMask();
+        vls_mask computeStatusMask();
             
         /* Method used to compute a queue status mask for a document in the document set.
            Warning: This method does not take care of locking! */
-        uint64_t computeQueueStatusMask(uint64_t statusMask);
+        vls_mask computeQueueStatusMask(const vls_mask& statusMask);
         
         /* Method to return the database object */
         Database* getDatabase();
@@ -333,7 +506,9 @@ namespace mongo {
                                          const CollectionScanParams::Direction& dir,
                                          bool use_chronos = false,
                                          uint64_t scanMask = 0x0,
-                                         uint64_t scanStableMask = 0x0);
+                                         uint64_t scanStableMask = 0x0,
+                                         int scanWord = 0,
+                                         const DiskLoc& startExtent = DiskLoc());
 
         void deleteDocument( const DiskLoc& loc,
                              bool cappedOK = false,
@@ -397,6 +572,38 @@ namespace mongo {
         // @return 0 for inf., otherwise a number of files
         int largestFileNumberInQuota() const;
 
+        // ---- VLS ---- //
+
+        /* Allocates the in-memory structures used by VLS */
+        void _initVLS();
+
+        /* Releases the in-memory structures used by VLS */
+        void _clearVLS();
+
+        /* Gives the document sets the current version of a record, against
+           which delta-encoded versions are rebuilt */
+        class RecordVersions : public DocumentSet::CurrentVersions {
+        public:
+            explicit RecordVersions( Collection* collection ) : _collection( collection ) { }
+            virtual BSONObj current( int _a, ID id ) const;
+        private:
+            Collection* _collection;
+        };
+
+        /* Replaces the delta-encoded version of a record in the document set,
+           if any, by its full version, before current changes. */
+        void _materializeDelta( int _a, ID id, const BSONObj& current );
+
+        /* Called once the record at loc is deleted or moved away: its slot
+           goes back to the slot table of its volume, for the next record
+           written there, once no scan may still refer to it through its
+           status mask, its index deltas or a scan set. Until then, its
+           location waits in releasedSlots. Requires a write lock on the
+           database. */
+        void _releaseSlot( const DiskLoc& loc );
+
+        // ---- VLS ---- //
+
         ExtentManager* getExtentManager();
         const ExtentManager* getExtentManager() const;
 
@@ -408,6 +615,7 @@ namespace mongo {
         RecordStore _recordStore;
         CollectionInfoCache _infoCache;
         IndexCatalog _indexCatalog;
+        RecordVersions _recordVersions; // VLS
 
         friend class Database;
         friend class FlatIterator;
@@ -420,7 +628,11 @@ namespace mongo {
         FlipPhase();
         
         FlipPhase(Database* db, Collection* collection,
-                uint64_t scanStableMask, uint64_t scanMask);
+                uint64_t scanStableMask, int scanBit);
+        
+        /* Ends the scan first (see Collection::endVLSScan()) */
+        FlipPhase(const StringData& ns, uint64_t databaseId, uint64_t collectionId,
+                uint64_t scanStableMask, int scanBit, bool active, int indexScanId);
         
         virtual ~FlipPhase();
         
@@ -429,10 +641,19 @@ namespace mongo {
         virtual string name() const { return "FlipPhase"; }
         
     private:
-        Database* _db;
-        Collection* _collection;
+        /* The collection being flipped, or NULL if it was dropped; *db is set
+           to its database, or NULL if the database was dropped too. Requires
+           a read lock on the database. */
+        Collection* _lookUp(Database** db) const;
+        
+        string _ns;
+        uint64_t _databaseId;
+        uint64_t _collectionId;
         uint64_t _scanStableMask;
-        uint64_t _scanMask;
+        int _scanBit;
+        bool _endScan;
+        bool _active;
+        int _indexScanId;
         
     };
 
@@ -72,10 +72,13 @@ namespace mongo {
                                const CollectionScanParams::Direction& dir,
                                bool use_chronos,
                                uint64_t scanMask,
-                               uint64_t scanStableMask)
+                               uint64_t scanStableMask,
+                               int scanWord,
+                               const DiskLoc& startExtent)
         : _curr(start), _collection(collection), _direction(dir),
           _use_chronos(use_chronos),
-          _scanMask(scanMask), _scanStableMask(scanStableMask) {
+          _scanMask(scanMask), _scanStableMask(scanStableMask), _scanWord(scanWord),
+          _wrapped(false) {
 
         if (_curr.isNull()) {
 
@@ -88,7 +91,8 @@ namespace mongo {
             else if (CollectionScanParams::FORWARD == _direction) {
 
                 // Find a non-empty extent and start with the first record in it.
-                Extent* e = em->getExtent( _collection->_details->firstExtent() );
+                Extent* e = em->getExtent( startExtent.isNull() ? _collection->_details->firstExtent()
+                                                                : startExtent );
 
                 while (e->firstRecord.isNull() && !e->xnext.isNull()) {
                     e = em->getNextExtent( e );
@@ -97,6 +101,17 @@ namespace mongo {
                 // _curr may be set to DiskLoc() here if e->lastRecord isNull but there is no
                 // valid e->xnext
                 _curr = e->firstRecord;
+
+                // --------- VLS --------- //
+
+                // a shared scan ends where it started, after wrapping around
+                if ( !startExtent.isNull() ) {
+                    _startExtent = _curr.isNull() ? startExtent : e->myLoc;
+                    if ( _curr.isNull() )
+                        advance();
+                }
+
+                // --------- VLS --------- //
             }
             else {
                 // Walk backwards, skipping empty extents, and use the last record in the first
@@ -122,29 +137,9 @@ namespace mongo {
     
     bool FlatIterator::chronosNextObj(BSONObj &obj) {
 
-        uint64_t statusMask = 0x0;
-        int _a = _curr.a();
-        ID id = _curr.id(_collection->ofsMap[_a]);
-        bool success = false;
-        bool read_document = true;
-        
-        while ( !success )
-        {
-            statusMask = (&(_collection->statusMaskMapVector[_a]))->at(id);
-            
-            // if OR(Status) is 0, read document
-            if ( ( ( _scanStableMask ^ statusMask ) & _scanMask ) == 0x0 )
-            {   
-                // update status mask
-                success = ( ((&(_collection->statusMaskMapVector[_a]))->at(id)).compare_and_swap( ~( ( ~statusMask ) ^ _scanMask ), statusMask ) == statusMask ) ? true : false;
-                read_document = true;
-            }
-            else
-            {
-                success = true;
-                read_document = false;
-            }
-        }
+        // if OR(Status) is 0, read document
+        bool read_document = _collection->claimRecordForScan( _curr, _scanWord,
+                                                              _scanStableMask, _scanMask );
         
         if ( read_document )
             obj = _curr.obj();
@@ -165,17 +160,11 @@ namespace mongo {
             else
                 obj = ret.obj();
             
-            if (CollectionScanParams::FORWARD == _direction) {
-                _curr = _collection->getExtentManager()->getNextRecord( _curr );
-            }
-            else {
-                _curr = _collection->getExtentManager()->getPrevRecord( _curr );
-            }
-
+            advance();
         }
 
         if (!chronosReadDocument)
-            return *(new DiskLoc(-3, 0)); //invalid
+            ret.setChronosInvalid();
         
         return ret;
     }
@@ -192,21 +181,46 @@ namespace mongo {
             if ( _use_chronos )
                 chronosReadDocument = chronosNextObj(obj);
             
-            if (CollectionScanParams::FORWARD == _direction) {
-                _curr = _collection->getExtentManager()->getNextRecord( _curr );
-            }
-            else {
-                _curr = _collection->getExtentManager()->getPrevRecord( _curr );
-            }
-
+            advance();
         }
 
         if (!chronosReadDocument)
-            return *(new DiskLoc(-3, 0)); //invalid     
+            ret.setChronosInvalid();
         
         return ret;
     }
 
+    void FlatIterator::advance() {
+        if (CollectionScanParams::FORWARD == _direction) {
+            if ( !_curr.isNull() )
+                _curr = _collection->getExtentManager()->getNextRecord( _curr );
+        }
+        else {
+            _curr = _collection->getExtentManager()->getPrevRecord( _curr );
+        }
+
+        // --------- VLS --------- //
+
+        if ( _startExtent.isNull() )
+            return;
+
+        if ( _curr.isNull() && !_wrapped ) {
+            // past the last extent: going on from the first record
+            _wrapped = true;
+            const ExtentManager* em = _collection->getExtentManager();
+            Extent* e = em->getExtent( _collection->_details->firstExtent() );
+            while (e->firstRecord.isNull() && !e->xnext.isNull()) {
+                e = em->getNextExtent( e );
+            }
+            _curr = e->firstRecord;
+        }
+
+        if ( _wrapped && !_curr.isNull() && _collection->extentOf( _curr ) == _startExtent )
+            _curr = DiskLoc();
+
+        // --------- VLS --------- //
+    }
+
     void FlatIterator::invalidate(const DiskLoc& dl) {
         verify( _collection->ok() );
 
@@ -240,7 +254,8 @@ namespace mongo {
                                    const CollectionScanParams::Direction& dir,
                                    bool use_chronos,
                                    uint64_t scanMask,
-                                   uint64_t scanStableMask)
+                                   uint64_t scanStableMask,
+                                   int scanWord)
         : _collection(collection), _curr(start), _tailable(tailable),
           _direction(dir), _killedByInvalidate(false), _use_chronos(use_chronos) {
 
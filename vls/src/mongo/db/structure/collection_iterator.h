@@ -96,6 +96,10 @@ namespace mongo {
 
         // Returns true if collection still exists, false otherwise.
         virtual bool recoverFromYield() = 0;
+
+        // VLS: true once a scan that started mid-way went past the last extent
+        // and started over from the first one (see Collection::sharedScanStart())
+        virtual bool wrappedAround() const { return false; }
     };
 
     /**
@@ -103,6 +107,9 @@ namespace mongo {
      * The collection must exist when the constructor is called.
      *
      * If start is not DiskLoc(), the iteration begins at that DiskLoc.
+     *
+     * If startExtent is not DiskLoc(), a forward iteration begins at that extent
+     * and wraps around to the first extent, ending where it began.
      */
     class FlatIterator : public CollectionIterator {
     public:
@@ -110,7 +117,9 @@ namespace mongo {
                      const CollectionScanParams::Direction& dir,
                      bool use_chronos = false,
                      uint64_t scanMask = 0x0,
-                     uint64_t scanStableMask = 0x0);
+                     uint64_t scanStableMask = 0x0,
+                     int scanWord = 0,
+                     const DiskLoc& startExtent = DiskLoc());
         
         virtual ~FlatIterator() { }
 
@@ -124,7 +133,12 @@ namespace mongo {
         virtual void prepareToYield();
         virtual bool recoverFromYield();
 
+        virtual bool wrappedAround() const { return _wrapped; }
+
     private:
+        // Moves _curr to the next record, wrapping around if needed.
+        void advance();
+
         // The result returned on the next call to getNext().
         DiskLoc _curr;
 
@@ -136,6 +150,13 @@ namespace mongo {
                 
         uint64_t _scanMask;
         uint64_t _scanStableMask;
+        
+        // word of the status masks that holds the bit of the scan
+        int _scanWord;
+
+        // extent of the first record of a wrapping iteration, where it ends
+        DiskLoc _startExtent;
+        bool _wrapped;
     };
 
     /**
@@ -153,7 +174,8 @@ namespace mongo {
                        const CollectionScanParams::Direction& dir,
                        bool use_chronos = false,
                        uint64_t scanMask = 0x0,
-                       uint64_t scanStableMask = 0x0);
+                       uint64_t scanStableMask = 0x0,
+                       int scanWord = 0);
         
         virtual ~CappedIterator() { }
 
@@ -0,0 +1,378 @@
+// document_set.cpp
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/db/structure/document_set.h"
+
+#include <cstring>
+#include <vector>
+
+#include <boost/filesystem/operations.hpp>
+
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+#include "mongo/util/scopeguard.h"
+
+namespace mongo {
+
+    namespace {
+
+        bool _sameElement( const BSONElement& a, const BSONElement& b ) {
+            return a.size() == b.size() && memcmp( a.rawdata(), b.rawdata(), a.size() ) == 0;
+        }
+
+        bool _hasName( const BSONObj& names, const char* name ) {
+            BSONObjIterator it( names );
+            while ( it.more() ) {
+                if ( strcmp( it.next().valuestr(), name ) == 0 )
+                    return true;
+            }
+            return false;
+        }
+
+    }
+
+    DocumentSet::Segment::Segment( uint64_t firstKey )
+        : firstKey( firstKey ),
+          lastEpoch( 0 ),
+          bytes( 0 ),
+          spilledBytes( 0 ) {
+        next = NULL;
+    }
+
+    const queue_document& DocumentSet::Cursor::next() {
+        verify( more() );
+        
+        // next segments are linked before their documents are published
+        if ( _key - _segment->firstKey == SegmentSize )
+            _segment = _segment->next;
+        
+        _current = &_segment->docs[_key++ - _segment->firstKey];
+        return *_current;
+    }
+
+    BSONObj DocumentSet::Cursor::document() const {
+        verify( _current != NULL );
+        return _set->_load( *_current );
+    }
+
+    DocumentSet::DocumentSet()
+        : _spillEnd( 0 ),
+          _spillLive( 0 ),
+          _versions( NULL ),
+          _hasDeltas( false ) {
+        _head = _tail = new Segment( 0 );
+        _end = 0;
+        _begin = 0;
+        _numSegments = 1;
+    }
+
+    DocumentSet::~DocumentSet() {
+        while ( _head != NULL ) {
+            Segment* next = _head->next;
+            delete _head;
+            _head = next;
+        }
+        
+        if ( !_spillPath.empty() ) {
+            boost::system::error_code ec;
+            boost::filesystem::remove( _spillPath, ec );
+        }
+    }
+
+    bool DocumentSet::spillTo( const std::string& path ) {
+        if ( _spillFile.is_open() )
+            return spilling();
+        
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(
+                boost::filesystem::path( path ).parent_path(), ec );
+        _spillFile.open( path.c_str() );
+        if ( !_spillFile.is_open() )
+            return false;
+        
+        _spillPath = path;
+        _spillFile.truncate( 0 );
+        return spilling();
+    }
+
+    uint64_t DocumentSet::append( const queue_document& doc, bool spill, bool* spilled ) {
+        uint64_t key = _end;
+        size_t slot = key - _tail->firstKey;
+        
+        _tail->docs[slot] = doc;
+        _tail->lastEpoch = doc.epoch;
+        
+        int size = doc.document.objsize();
+        bool toFile = false;
+        if ( doc.delta ) {
+            // deltas are small and rewritten in place, so they stay in memory
+            verify( _versions != NULL );
+            boost::mutex::scoped_lock lk( _segmentsMutex );
+            _deltaKeys[_recordKey( doc._a, doc.id )] = key;
+            _hasDeltas = true;
+        }
+        else if ( spill && spilling() ) {
+            boost::mutex::scoped_lock lk( _spillMutex );
+            _spillFile.write( _spillEnd, doc.document.objdata(), size );
+            
+            // a failed write leaves the document in memory, and the
+            // file is not used anymore
+            if ( !_spillFile.bad() ) {
+                queue_document& entry = _tail->docs[slot];
+                entry.document = BSONObj();
+                entry.spillOffset = _spillEnd;
+                entry.spillSize = size;
+                _spillEnd += size;
+                _spillLive += size;
+                toFile = true;
+            }
+            else
+                warning() << "could not spill to " << _spillPath
+                          << ", keeping preserved documents in memory" << endl;
+        }
+        
+        if ( toFile )
+            _tail->spilledBytes += size;
+        else
+            _tail->bytes += size;
+        if ( spilled != NULL )
+            *spilled = toFile;
+        
+        // a full segment is linked to the next one right away, so that it
+        // can be freed without waiting for the next document
+        if ( slot + 1 == SegmentSize ) {
+            Segment* segment = new Segment( key + 1 );
+            _tail->next = segment;
+            _tail = segment;
+            _numSegments++;
+        }
+        
+        // publishing the document to the scans
+        _end = key + 1;
+        return key;
+    }
+
+    const DocumentSet::Segment* DocumentSet::_findSegment( uint64_t key ) const {
+        const Segment* segment = _head;
+        while ( key - segment->firstKey >= SegmentSize )
+            segment = segment->next;
+        return segment;
+    }
+
+    DocumentSet::Cursor DocumentSet::cursor( uint64_t from, uint64_t to ) const {
+        Cursor cursor;
+        cursor._set = this;
+        
+        boost::mutex::scoped_lock lk( _segmentsMutex );
+        if ( from < _begin )
+            from = _begin;
+        if ( from >= to )
+            return cursor;
+        
+        cursor._segment = _findSegment( from );
+        cursor._key = from;
+        cursor._end = to;
+        return cursor;
+    }
+
+    bool DocumentSet::find( uint64_t key, queue_document* doc ) const {
+        boost::mutex::scoped_lock lk( _segmentsMutex );
+        if ( key < _begin || key >= _end )
+            return false;
+        
+        const Segment* segment = _findSegment( key );
+        *doc = segment->docs[key - segment->firstKey];
+        doc->document = _load( *doc );
+        doc->spillOffset = -1;
+        doc->delta = false;
+        return true;
+    }
+
+    BSONObj DocumentSet::_load( const queue_document& doc ) const {
+        if ( doc.spilled() )
+            return _readSpilled( doc );
+        if ( doc.delta )
+            return applyDelta( _versions->current( doc._a, doc.id ), doc.document );
+        return doc.document;
+    }
+
+    uint64_t DocumentSet::materialize( int _a, ID id, const BSONObj& current ) {
+        // only written by writers, which hold the collection lock
+        if ( !_hasDeltas )
+            return 0;
+        
+        boost::mutex::scoped_lock lk( _segmentsMutex );
+        boost::unordered_map<uint64_t, uint64_t>::iterator it =
+            _deltaKeys.find( _recordKey( _a, id ) );
+        if ( it == _deltaKeys.end() )
+            return 0;
+        
+        uint64_t key = it->second;
+        _deltaKeys.erase( it );
+        if ( key < _begin )
+            return 0;
+        
+        // scans only read the log under a read lock on the collection, so
+        // the entry can be rewritten in place
+        Segment* segment = const_cast<Segment*>( _findSegment( key ) );
+        queue_document& doc = segment->docs[key - segment->firstKey];
+        BSONObj full = applyDelta( current, doc.document );
+        uint64_t added = full.objsize() - doc.document.objsize();
+        
+        doc.document = full;
+        doc.delta = false;
+        segment->bytes += added;
+        return added;
+    }
+
+    bool DocumentSet::makeDelta( const BSONObj& pre, const BSONObj& post, BSONObj* delta ) {
+        BSONObjBuilder changed;
+        BSONObjIterator preIt( pre );
+        while ( preIt.more() ) {
+            BSONElement e = preIt.next();
+            BSONElement p = post.getField( e.fieldName() );
+            if ( p.eoo() || !_sameElement( e, p ) )
+                changed.append( e );
+        }
+        
+        BSONArrayBuilder added;
+        BSONObjIterator postIt( post );
+        while ( postIt.more() ) {
+            BSONElement e = postIt.next();
+            if ( pre.getField( e.fieldName() ).eoo() )
+                added.append( e.fieldName() );
+        }
+        
+        BSONObjBuilder b;
+        b.append( "s", changed.obj() );
+        b.append( "u", added.arr() );
+        BSONObj result = b.obj();
+        
+        // not worth rebuilding on every read otherwise
+        if ( result.objsize() * 2 > pre.objsize() )
+            return false;
+        
+        // fields that moved, or that post does not have, may not come back
+        // in the same order
+        if ( !applyDelta( post, result ).binaryEqual( pre ) )
+            return false;
+        
+        *delta = result;
+        return true;
+    }
+
+    BSONObj DocumentSet::applyDelta( const BSONObj& base, const BSONObj& delta ) {
+        BSONObj changed = delta["s"].Obj();
+        BSONObj added = delta["u"].Obj();
+        
+        BSONObjBuilder b( base.objsize() );
+        BSONObjIterator baseIt( base );
+        while ( baseIt.more() ) {
+            BSONElement e = baseIt.next();
+            if ( _hasName( added, e.fieldName() ) )
+                continue;
+            BSONElement c = changed.getField( e.fieldName() );
+            b.append( c.eoo() ? e : c );
+        }
+        
+        // fields removed from base go last
+        BSONObjIterator changedIt( changed );
+        while ( changedIt.more() ) {
+            BSONElement c = changedIt.next();
+            if ( base.getField( c.fieldName() ).eoo() )
+                b.append( c );
+        }
+        return b.obj();
+    }
+
+    BSONObj DocumentSet::_readSpilled( const queue_document& doc ) const {
+        // same layout as BSONObj::copy()
+        BSONObj::Holder* h = static_cast<BSONObj::Holder*>(
+                malloc( doc.spillSize + sizeof(unsigned) ) );
+        h->zero();
+        
+        // the buffer is only handed to the BSONObj once it holds the document
+        ScopeGuard freeHolder = MakeGuard( free, h );
+        _spillFile.read( doc.spillOffset, h->data, doc.spillSize );
+        uassert( 17334, "could not read a VLS preserved version back from the spill file",
+                 !_spillFile.bad() );
+        freeHolder.Dismiss();
+        return BSONObj( h );
+    }
+
+    void DocumentSet::reclaim( uint64_t oldestEpoch, uint64_t* entries, uint64_t* bytes,
+                               uint64_t* spilledBytes ) {
+        std::vector<Segment*> freed;
+        
+        {
+            boost::mutex::scoped_lock lk( _segmentsMutex );
+            
+            // epochs never decrease along the log, so the last document
+            // of a full segment tells whether the whole segment can go
+            while ( _head->next != NULL && _head->lastEpoch < oldestEpoch ) {
+                freed.push_back( _head );
+                _head = _head->next;
+            }
+            _begin = _head->firstKey;
+            _numSegments -= freed.size();
+            
+            if ( !freed.empty() ) {
+                boost::unordered_map<uint64_t, uint64_t>::iterator it = _deltaKeys.begin();
+                while ( it != _deltaKeys.end() ) {
+                    if ( it->second < _begin )
+                        it = _deltaKeys.erase( it );
+                    else
+                        ++it;
+                }
+            }
+        }
+        
+        *entries = 0;
+        *bytes = 0;
+        *spilledBytes = 0;
+        for ( size_t i = 0; i < freed.size(); i++ ) {
+            *entries += SegmentSize;
+            *bytes += freed[i]->bytes;
+            *spilledBytes += freed[i]->spilledBytes;
+            delete freed[i];
+        }
+        
+        // once no document left is spilled, the file starts over
+        if ( *spilledBytes > 0 ) {
+            boost::mutex::scoped_lock lk( _spillMutex );
+            _spillLive -= *spilledBytes;
+            if ( _spillLive == 0 ) {
+                _spillFile.truncate( 0 );
+                _spillEnd = 0;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,296 @@
+// document_set.h
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#pragma once
+
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/db/structure/vls_mask.h"
+#include "mongo/platform/cstdint.h"
+#include "mongo/util/file.h"
+
+#include "tbb/atomic.h"
+
+namespace mongo {
+
+    /* Identifies a Disk Loc (_a, ofs)*/
+    typedef uint32_t ID;
+    
+    /**
+     * Used to represent a document in the shared queue (document set).
+     * Entries are not modified once added (but see delta below): a scan reads an entry if its bit
+     * is 0 in the queue status mask and the entry was preserved in the scan's
+     * epoch or later (see Collection::scanEpoch).
+     * A spilled document is kept in the spill file of the document set at
+     * spillOffset, and only read back by cursors (see DocumentSet::spillTo()).
+     * A delta-encoded document only keeps the fields that differ from the
+     * current version of the record (see DocumentSet::makeDelta()); it is
+     * replaced by the full document before the record changes again.
+     */
+    struct queue_document {
+        BSONObj document;
+        ID id;
+        int _a;
+        vls_mask queueStatusMask;
+        uint64_t epoch;
+        int64_t spillOffset; // -1 if the document is in memory
+        int spillSize;
+        bool delta;
+        
+        queue_document()
+                : queueStatusMask( 0x0 ),
+                  epoch( 0 ),
+                  spillOffset( -1 ),
+                  spillSize( 0 ),
+                  delta( false ) { }
+        
+        queue_document(BSONObj doc, ID id, int _a, const vls_mask& queueStatusMask,
+                uint64_t epoch)
+                : document( doc.copy() ),
+                  id( id ),
+                  _a( _a ),
+                  queueStatusMask( queueStatusMask ),
+                  epoch( epoch ),
+                  spillOffset( -1 ),
+                  spillSize( 0 ),
+                  delta( false ) { }
+        
+        queue_document(const queue_document& queueDocument) {
+            document = queueDocument.document;
+            id = queueDocument.id;
+            _a = queueDocument._a;
+            queueStatusMask = queueDocument.queueStatusMask;
+            epoch = queueDocument.epoch;
+            spillOffset = queueDocument.spillOffset;
+            spillSize = queueDocument.spillSize;
+            delta = queueDocument.delta;
+        }
+        
+        bool spilled() const { return spillOffset >= 0; }
+    };
+    
+    /**
+     * The document set (what we used to call queue): the stable versions of
+     * documents preserved for VLS scans, kept as a log of fixed-size segments
+     * in the order they were added. The key of a document is its position
+     * in the log.
+     *
+     * There is a single writer (updates hold the collection write lock).
+     * A scan remembers the end of the log when it starts and when it reaches
+     * the document set, and reads the documents in between without locking.
+     * Segments are freed from the head of the log once every document in
+     * them was preserved before the oldest running scan started.
+     *
+     * Documents may be spilled to an append-only file instead of being kept
+     * in memory (see spillTo()); cursors read them back transparently. The
+     * file is emptied whenever no document left in the log is spilled.
+     *
+     * Delta-encoded documents are rebuilt from the current version of their
+     * record (see CurrentVersions) when they are read.
+     */
+    class DocumentSet {
+        MONGO_DISALLOW_COPYING(DocumentSet);
+        
+        struct Segment;
+        
+    public:
+        /* Documents per segment */
+        static const size_t SegmentSize = 1024;
+        
+        /**
+         * Reads the documents of a range of keys in order. The range must only
+         * hold documents some running scan needs, so that they are not freed
+         * while the cursor is in use (see reclaim()).
+         */
+        class Cursor {
+        public:
+            Cursor() : _set( NULL ), _segment( NULL ), _current( NULL ), _key( 0 ), _end( 0 ) { }
+            
+            bool more() const { return _key < _end; }
+            
+            /* Returns the entry at the current key and moves to the next one.
+               The document of a spilled or delta-encoded entry is not loaded
+               (see document()). */
+            const queue_document& next();
+            
+            /* Full document of the entry last returned by next() */
+            BSONObj document() const;
+            
+        private:
+            friend class DocumentSet;
+            const DocumentSet* _set;
+            const Segment* _segment;
+            const queue_document* _current;
+            uint64_t _key;
+            uint64_t _end;
+        };
+        
+        /**
+         * Gives the current version of a record, against which delta-encoded
+         * documents are rebuilt. Called by readers, which hold a read lock
+         * on the collection.
+         */
+        class CurrentVersions {
+        public:
+            virtual ~CurrentVersions() { }
+            virtual BSONObj current( int _a, ID id ) const = 0;
+        };
+        
+        DocumentSet();
+        ~DocumentSet();
+        
+        /* Appends a document to the log and returns its key. With spill, the
+           document goes to the spill file, if there is one that can be written,
+           and spilled is set accordingly. Requires a write lock on the
+           collection. */
+        uint64_t append( const queue_document& doc, bool spill = false,
+                         bool* spilled = NULL );
+        
+        /* Opens the append-only file at path where spilled documents go; it
+           is removed with the document set. Returns false if it cannot be
+           created. Requires a write lock on the collection. */
+        bool spillTo( const std::string& path );
+        
+        /* True if appended documents can be spilled */
+        bool spilling() const { return _spillFile.is_open() && !_spillFile.bad(); }
+        
+        /* Sets where delta-encoded documents find the current version of their
+           records; must be set before the first delta is appended. */
+        void setCurrentVersions( const CurrentVersions* versions ) { _versions = versions; }
+        
+        /* Replaces the delta-encoded document of the record, if any, by its full
+           document, using current as the version it was encoded against. To be
+           called before the record is updated or deleted. Returns the bytes
+           added to the log. Requires a write lock on the collection. */
+        uint64_t materialize( int _a, ID id, const BSONObj& current );
+        
+        /* Encodes pre as the fields that differ from post, or that post does
+           not have. Returns false if the delta is not much smaller than pre, or
+           if the field order of pre cannot be rebuilt from post. */
+        static bool makeDelta( const BSONObj& pre, const BSONObj& post, BSONObj* delta );
+        
+        /* Rebuilds the document encoded by makeDelta() against base */
+        static BSONObj applyDelta( const BSONObj& base, const BSONObj& delta );
+        
+        /* Key of the next document to be appended, i.e., the high-water mark */
+        uint64_t end() const { return _end; }
+        
+        /* Key of the oldest document that was not freed */
+        uint64_t begin() const { return _begin; }
+        
+        /* Number of documents in the log */
+        uint64_t size() const { return _end - _begin; }
+        
+        /* Number of segments in the log */
+        uint64_t numSegments() const { return _numSegments; }
+        
+        /* Cursor over the documents with keys in [from, to), where to <= end() */
+        Cursor cursor( uint64_t from, uint64_t to ) const;
+        
+        /* Copies the document with the given key, if it was not freed; spilled
+           and delta-encoded documents are loaded */
+        bool find( uint64_t key, queue_document* doc ) const;
+        
+        /* Frees the segments at the head of the log whose documents were all
+           preserved before oldestEpoch, returning the number of documents
+           and bytes freed, in memory and in the spill file. The segment being
+           appended to is never freed. */
+        void reclaim( uint64_t oldestEpoch, uint64_t* entries, uint64_t* bytes,
+                      uint64_t* spilledBytes );
+        
+    private:
+        struct Segment {
+            uint64_t firstKey;
+            queue_document docs[SegmentSize];
+            
+            /* Epoch of the last document appended, and bytes of all documents
+               in memory and spilled */
+            uint64_t lastEpoch;
+            uint64_t bytes;
+            uint64_t spilledBytes;
+            
+            /* Set by the writer once the segment is full */
+            tbb::atomic<Segment*> next;
+            
+            explicit Segment( uint64_t firstKey );
+        };
+        
+        /* Segment holding key, searched from the head; requires _segmentsMutex */
+        const Segment* _findSegment( uint64_t key ) const;
+        
+        /* Reads a spilled document back from the spill file */
+        BSONObj _readSpilled( const queue_document& doc ) const;
+        
+        /* Full document of an entry, loading spilled and delta-encoded ones */
+        BSONObj _load( const queue_document& doc ) const;
+        
+        static uint64_t _recordKey( int _a, ID id ) {
+            return ( static_cast<uint64_t>( _a ) << 32 ) | id;
+        }
+        
+        Segment* _head;
+        Segment* _tail;
+        
+        /* Published by the writer after the document is in place */
+        tbb::atomic<uint64_t> _end;
+        tbb::atomic<uint64_t> _begin;
+        tbb::atomic<uint64_t> _numSegments;
+        
+        /* Guards _head against reclaim() while a cursor is positioned;
+           never taken to read through a cursor, nor to append a document
+           that is not delta-encoded */
+        mutable boost::mutex _segmentsMutex;
+        
+        /* Spill file; documents are only appended to it, and read with
+           positional reads that need no lock */
+        std::string _spillPath;
+        mutable File _spillFile;
+        
+        /* End of the spill file, and bytes of the documents of the log that
+           are in it; guarded by _spillMutex */
+        uint64_t _spillEnd;
+        uint64_t _spillLive;
+        boost::mutex _spillMutex;
+        
+        const CurrentVersions* _versions;
+        
+        /* Key of the delta-encoded document of each record (see _recordKey()),
+           if it is still in the log; guarded by _segmentsMutex. Writers only
+           look it up once a delta was appended. */
+        boost::unordered_map<uint64_t, uint64_t> _deltaKeys;
+        bool _hasDeltas;
+    };
+
+}
@@ -0,0 +1,226 @@
+// document_set_test.cpp
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/unittest/temp_dir.h"
+#include "mongo/unittest/unittest.h"
+
+#include "mongo/db/structure/document_set.h"
+
+namespace mongo {
+
+    namespace {
+
+        queue_document doc( int i, uint64_t epoch ) {
+            return queue_document( BSON( "_id" << i ), i, 0, vls_mask( 0x0 ), epoch );
+        }
+
+        const uint64_t N = DocumentSet::SegmentSize;
+
+        /* Current versions of records with a single extent */
+        class Versions : public DocumentSet::CurrentVersions {
+        public:
+            virtual BSONObj current( int _a, ID id ) const { return records[id]; }
+            std::vector<BSONObj> records;
+        };
+
+        const std::string val( 100, 'x' );
+
+    }
+
+    TEST( DocumentSetTest, Empty ) {
+        DocumentSet set;
+        ASSERT_EQUALS( 0U, set.begin() );
+        ASSERT_EQUALS( 0U, set.end() );
+        ASSERT_EQUALS( 0U, set.size() );
+        ASSERT_EQUALS( 1U, set.numSegments() );
+        ASSERT_FALSE( set.cursor( 0, set.end() ).more() );
+    }
+
+    TEST( DocumentSetTest, KeysFollowAppendOrder ) {
+        DocumentSet set;
+        for ( uint64_t i = 0; i < 3 * N; i++ )
+            ASSERT_EQUALS( i, set.append( doc( i, 1 ) ) );
+        ASSERT_EQUALS( 3 * N, set.size() );
+        ASSERT_EQUALS( 4U, set.numSegments() );
+
+        queue_document d;
+        ASSERT( set.find( N + 5, &d ) );
+        ASSERT_EQUALS( static_cast<int>( N + 5 ), d.document["_id"].numberInt() );
+        ASSERT_FALSE( set.find( 3 * N, &d ) );
+    }
+
+    TEST( DocumentSetTest, CursorCrossesSegments ) {
+        DocumentSet set;
+        for ( uint64_t i = 0; i < 2 * N; i++ )
+            set.append( doc( i, 1 ) );
+
+        // documents appended after the high-water mark are not seen
+        uint64_t highWater = set.end();
+        set.append( doc( 2 * N, 2 ) );
+
+        DocumentSet::Cursor cursor = set.cursor( N - 10, highWater );
+        for ( uint64_t i = N - 10; i < highWater; i++ ) {
+            ASSERT( cursor.more() );
+            ASSERT_EQUALS( static_cast<int>( i ), cursor.next().document["_id"].numberInt() );
+        }
+        ASSERT_FALSE( cursor.more() );
+    }
+
+    TEST( DocumentSetTest, ReclaimFreesOldSegments ) {
+        DocumentSet set;
+        for ( uint64_t i = 0; i < N; i++ )
+            set.append( doc( i, 1 ) );
+        for ( uint64_t i = N; i < 2 * N + 10; i++ )
+            set.append( doc( i, 2 ) );
+
+        uint64_t entries;
+        uint64_t bytes;
+        uint64_t spilledBytes;
+
+        // the first segment is still needed by a scan of epoch 1
+        set.reclaim( 1, &entries, &bytes, &spilledBytes );
+        ASSERT_EQUALS( 0U, entries );
+        ASSERT_EQUALS( 0U, set.begin() );
+
+        set.reclaim( 2, &entries, &bytes, &spilledBytes );
+        ASSERT_EQUALS( N, entries );
+        ASSERT_EQUALS( N * BSON( "_id" << 0 ).objsize(), bytes );
+        ASSERT_EQUALS( N, set.begin() );
+        ASSERT_EQUALS( N + 10, set.size() );
+
+        queue_document d;
+        ASSERT_FALSE( set.find( 0, &d ) );
+        ASSERT( set.find( N, &d ) );
+
+        // the segment being appended to stays, even if no scan needs it
+        set.reclaim( 3, &entries, &bytes, &spilledBytes );
+        ASSERT_EQUALS( N, entries );
+        ASSERT_EQUALS( 2 * N, set.begin() );
+        ASSERT_EQUALS( 10U, set.size() );
+        ASSERT_EQUALS( 1U, set.numSegments() );
+
+        // cursors never start before the oldest document left
+        DocumentSet::Cursor cursor = set.cursor( 0, set.end() );
+        ASSERT_EQUALS( static_cast<int>( 2 * N ), cursor.next().document["_id"].numberInt() );
+    }
+
+    TEST( DocumentSetTest, SpilledDocumentsAreReadBack ) {
+        unittest::TempDir dir( "document_set_test" );
+        DocumentSet set;
+
+        // nothing is spilled until there is a spill file
+        bool spilled = true;
+        set.append( doc( 0, 1 ), true, &spilled );
+        ASSERT_FALSE( spilled );
+
+        ASSERT( set.spillTo( dir.path() + "/spill" ) );
+        for ( uint64_t i = 1; i < N + 10; i++ ) {
+            set.append( doc( i, i < N ? 1 : 2 ), i % 2 == 1, &spilled );
+            ASSERT_EQUALS( i % 2 == 1, spilled );
+        }
+
+        queue_document d;
+        ASSERT( set.find( 7, &d ) );
+        ASSERT_EQUALS( 7, d.document["_id"].numberInt() );
+
+        DocumentSet::Cursor cursor = set.cursor( 0, set.end() );
+        for ( uint64_t i = 0; i < N + 10; i++ ) {
+            ASSERT( cursor.more() );
+            ASSERT_EQUALS( i % 2 == 1, cursor.next().spilled() );
+            ASSERT_EQUALS( static_cast<int>( i ), cursor.document()["_id"].numberInt() );
+        }
+
+        uint64_t entries;
+        uint64_t bytes;
+        uint64_t spilledBytes;
+        set.reclaim( 2, &entries, &bytes, &spilledBytes );
+        ASSERT_EQUALS( N, entries );
+        ASSERT_EQUALS( N / 2 * BSON( "_id" << 0 ).objsize(), spilledBytes );
+        ASSERT_EQUALS( N / 2 * BSON( "_id" << 0 ).objsize(), bytes );
+
+        ASSERT( set.find( N + 1, &d ) );
+        ASSERT_EQUALS( static_cast<int>( N + 1 ), d.document["_id"].numberInt() );
+    }
+
+    TEST( DocumentSetTest, DeltaRebuildsChangedAndRemovedFields ) {
+        BSONObj pre = BSON( "_id" << 1 << "a" << val << "b" << 2 << "c" << 1 );
+        BSONObj post = BSON( "_id" << 1 << "a" << val << "b" << 3 << "d" << 4 );
+
+        BSONObj delta;
+        ASSERT( DocumentSet::makeDelta( pre, post, &delta ) );
+        ASSERT_LESS_THAN( delta.objsize() * 2, pre.objsize() );
+        ASSERT( DocumentSet::applyDelta( post, delta ).binaryEqual( pre ) );
+    }
+
+    TEST( DocumentSetTest, NoDeltaIfFieldOrderChanges ) {
+        BSONObj pre = BSON( "_id" << 1 << "a" << 1 << "b" << val );
+        BSONObj post = BSON( "_id" << 1 << "b" << val );
+
+        // "a" would be rebuilt after "b"
+        BSONObj delta;
+        ASSERT_FALSE( DocumentSet::makeDelta( pre, post, &delta ) );
+
+        // nor if the whole document changed
+        ASSERT_FALSE( DocumentSet::makeDelta( post, BSON( "_id" << 2 ), &delta ) );
+    }
+
+    TEST( DocumentSetTest, DeltaIsMaterializedBeforeTheRecordChanges ) {
+        Versions versions;
+        DocumentSet set;
+        set.setCurrentVersions( &versions );
+
+        BSONObj v1 = BSON( "_id" << 0 << "val" << val << "n" << 1 );
+        BSONObj v2 = BSON( "_id" << 0 << "val" << val << "n" << 2 );
+        BSONObj v3 = BSON( "_id" << 0 << "val" << val << "n" << 3 );
+        versions.records.push_back( v2 );
+
+        BSONObj delta;
+        ASSERT( DocumentSet::makeDelta( v1, v2, &delta ) );
+        queue_document entry( delta, 0, 0, vls_mask( 0x0 ), 1 );
+        entry.delta = true;
+        set.append( entry );
+
+        DocumentSet::Cursor cursor = set.cursor( 0, set.end() );
+        ASSERT( cursor.next().delta );
+        ASSERT( cursor.document().binaryEqual( v1 ) );
+
+        ASSERT_EQUALS( static_cast<uint64_t>( v1.objsize() - delta.objsize() ),
+                       set.materialize( 0, 0, v2 ) );
+        versions.records[0] = v3;
+
+        queue_document d;
+        ASSERT( set.find( 0, &d ) );
+        ASSERT( d.document.binaryEqual( v1 ) );
+
+        // only once
+        ASSERT_EQUALS( 0U, set.materialize( 0, 0, v3 ) );
+    }
+
+}
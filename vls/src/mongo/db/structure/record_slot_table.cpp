@@ -0,0 +1,138 @@
+// record_slot_table.cpp
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/db/structure/record_slot_table.h"
+
+namespace mongo {
+
+    namespace {
+        /* Tables are grown once they are half full */
+        const size_t MinTableSize = 16;
+    }
+
+    RecordSlotTable::RecordSlotTable()
+        : _numSlots( 0 ) {
+    }
+
+    size_t RecordSlotTable::_bucket( int ofs ) const {
+        // records are at least 4-byte aligned; Fibonacci hashing spreads
+        // consecutive offsets over the whole table
+        uint32_t h = static_cast<uint32_t>( ofs ) * 2654435761U;
+        return ( h ^ ( h >> 16 ) ) & ( _entries.size() - 1 );
+    }
+
+    uint32_t RecordSlotTable::find( int ofs ) const {
+        if ( _entries.empty() )
+            return NoSlot;
+
+        for ( size_t i = _bucket( ofs ); ; i = ( i + 1 ) & ( _entries.size() - 1 ) ) {
+            const Entry& e = _entries[i];
+            if ( e.ofs == ofs )
+                return e.slot;
+            if ( e.ofs == -1 )
+                return NoSlot;
+        }
+    }
+
+    uint32_t RecordSlotTable::insert( int ofs ) {
+        if ( ( _numSlots - _freeSlots.size() + 1 ) * 2 > _entries.size() )
+            _grow();
+
+        for ( size_t i = _bucket( ofs ); ; i = ( i + 1 ) & ( _entries.size() - 1 ) ) {
+            Entry& e = _entries[i];
+            if ( e.ofs == ofs )
+                return e.slot;
+            if ( e.ofs == -1 ) {
+                e.ofs = ofs;
+                if ( _freeSlots.empty() ) {
+                    e.slot = _numSlots++;
+                }
+                else {
+                    e.slot = _freeSlots.back();
+                    _freeSlots.pop_back();
+                }
+                return e.slot;
+            }
+        }
+    }
+
+    void RecordSlotTable::release( int ofs ) {
+        if ( _entries.empty() )
+            return;
+
+        const size_t mask = _entries.size() - 1;
+        size_t i = _bucket( ofs );
+        while ( _entries[i].ofs != ofs ) {
+            if ( _entries[i].ofs == -1 )
+                return;
+            i = ( i + 1 ) & mask;
+        }
+        _freeSlots.push_back( _entries[i].slot );
+
+        // backward shift deletion: the entries of the probe run after the
+        // hole move into it unless their bucket lies between the hole and
+        // them, so that lookups never stop early and no tombstone is left
+        for ( size_t j = ( i + 1 ) & mask; _entries[j].ofs != -1; j = ( j + 1 ) & mask ) {
+            size_t k = _bucket( _entries[j].ofs );
+            if ( ( ( j - k ) & mask ) >= ( ( j - i ) & mask ) ) {
+                _entries[i] = _entries[j];
+                i = j;
+            }
+        }
+        _entries[i].ofs = -1;
+        _entries[i].slot = NoSlot;
+    }
+
+    void RecordSlotTable::_grow() {
+        std::vector<Entry> old;
+        old.swap( _entries );
+
+        Entry empty;
+        empty.ofs = -1;
+        empty.slot = NoSlot;
+        _entries.resize( old.empty() ? MinTableSize : old.size() * 2, empty );
+
+        for ( size_t j = 0; j < old.size(); j++ ) {
+            if ( old[j].ofs == -1 )
+                continue;
+            size_t i = _bucket( old[j].ofs );
+            while ( _entries[i].ofs != -1 )
+                i = ( i + 1 ) & ( _entries.size() - 1 );
+            _entries[i] = old[j];
+        }
+    }
+
+    void RecordSlotTable::clear() {
+        std::vector<Entry>().swap( _entries );
+        std::vector<uint32_t>().swap( _freeSlots );
+        _numSlots = 0;
+    }
+
+}
@@ -0,0 +1,107 @@
+// record_slot_table.h
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "mongo/platform/cstdint.h"
+
+namespace mongo {
+
+    /**
+     * Maps the offset of a record in a DiskLoc Volume to its slot, a dense and
+     * collision-free ID used to index the VLS status and index mask maps.
+     *
+     * New slots are handed out in increasing order, so the slots of a volume are
+     * always within [0, numSlots()). A record that is written at the offset of
+     * a deleted record gets the slot of that record back, and the slots of
+     * released offsets are handed out again before new ones, so that the
+     * tables and the maps indexed by slot stay bounded by the records of the
+     * volume rather than by every offset it ever had.
+     *
+     * The table uses open addressing with linear probing over 8-byte entries.
+     * Lookups may run concurrently with each other, but insertions and
+     * releases must be serialized with respect to every other access (for
+     * VLS, they happen under the database write lock, or before the first
+     * VLS scan).
+     */
+    class RecordSlotTable {
+    public:
+        /* Returned by find() for offsets that do not have a slot. */
+        static const uint32_t NoSlot = 0xFFFFFFFF;
+
+        RecordSlotTable();
+
+        /* Returns the slot of the record at ofs, or NoSlot. */
+        uint32_t find( int ofs ) const;
+
+        /* Returns the slot of the record at ofs, assigning a released slot,
+           or else the next slot of the volume, if the offset has none. */
+        uint32_t insert( int ofs );
+
+        /* Removes the offset from the table, its slot going to the next
+           offset inserted. No-op if the offset has no slot. */
+        void release( int ofs );
+
+        /* Number of slots handed out, i.e., one past the highest slot. */
+        uint32_t numSlots() const { return _numSlots; }
+
+        /* Number of slots released and not handed out again. */
+        uint32_t numFreeSlots() const { return _freeSlots.size(); }
+
+        /* Bytes used by the table itself. */
+        size_t memUsage() const {
+            return _entries.capacity() * sizeof(Entry) +
+                   _freeSlots.capacity() * sizeof(uint32_t);
+        }
+
+        void clear();
+
+    private:
+        struct Entry {
+            int ofs; // -1 if empty
+            uint32_t slot;
+        };
+
+        size_t _bucket( int ofs ) const;
+
+        void _grow();
+
+        std::vector<Entry> _entries; // size is 0 or a power of 2
+        uint32_t _numSlots;
+        std::vector<uint32_t> _freeSlots; // released slots, reused last first
+    };
+
+    /* Slot Tables -- one per DiskLoc Volume */
+    typedef std::vector<RecordSlotTable> slot_table_vector;
+
+}
@@ -0,0 +1,123 @@
+// record_slot_table_test.cpp
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/unittest/unittest.h"
+
+#include "mongo/db/structure/record_slot_table.h"
+
+namespace mongo {
+
+    TEST( RecordSlotTableTest, Empty ) {
+        RecordSlotTable t;
+        ASSERT_EQUALS( 0U, t.numSlots() );
+        ASSERT_EQUALS( RecordSlotTable::NoSlot, t.find( 0 ) );
+        ASSERT_EQUALS( RecordSlotTable::NoSlot, t.find( 8192 ) );
+    }
+
+    TEST( RecordSlotTableTest, DenseSlots ) {
+        RecordSlotTable t;
+        ASSERT_EQUALS( 0U, t.insert( 8192 ) );
+        ASSERT_EQUALS( 1U, t.insert( 12288 ) );
+        ASSERT_EQUALS( 2U, t.insert( 4096 ) );
+        ASSERT_EQUALS( 3U, t.numSlots() );
+
+        ASSERT_EQUALS( 0U, t.find( 8192 ) );
+        ASSERT_EQUALS( 1U, t.find( 12288 ) );
+        ASSERT_EQUALS( 2U, t.find( 4096 ) );
+        ASSERT_EQUALS( RecordSlotTable::NoSlot, t.find( 8196 ) );
+    }
+
+    TEST( RecordSlotTableTest, ReinsertKeepsSlot ) {
+        RecordSlotTable t;
+        t.insert( 100 );
+        t.insert( 200 );
+        ASSERT_EQUALS( 0U, t.insert( 100 ) );
+        ASSERT_EQUALS( 2U, t.numSlots() );
+    }
+
+    TEST( RecordSlotTableTest, SmallRecordsDoNotCollide ) {
+        // records of 16 bytes: the old (ofs - init)/256 mapping gave
+        // 16 of them the same ID
+        RecordSlotTable t;
+        for ( int i = 0; i < 100000; i++ )
+            ASSERT_EQUALS( static_cast<uint32_t>( i ), t.insert( 8192 + i * 16 ) );
+        ASSERT_EQUALS( 100000U, t.numSlots() );
+        for ( int i = 0; i < 100000; i++ )
+            ASSERT_EQUALS( static_cast<uint32_t>( i ), t.find( 8192 + i * 16 ) );
+        ASSERT_EQUALS( RecordSlotTable::NoSlot, t.find( 8192 + 100000 * 16 ) );
+    }
+
+    TEST( RecordSlotTableTest, Clear ) {
+        RecordSlotTable t;
+        t.insert( 100 );
+        t.clear();
+        ASSERT_EQUALS( 0U, t.numSlots() );
+        ASSERT_EQUALS( RecordSlotTable::NoSlot, t.find( 100 ) );
+        ASSERT_EQUALS( 0U, t.insert( 200 ) );
+    }
+
+    TEST( RecordSlotTableTest, ReleasedSlotsAreReused ) {
+        RecordSlotTable t;
+        t.insert( 100 );
+        t.insert( 200 );
+        t.insert( 300 );
+        t.release( 200 );
+        t.release( 400 ); // no slot
+        ASSERT_EQUALS( RecordSlotTable::NoSlot, t.find( 200 ) );
+        ASSERT_EQUALS( 1U, t.numFreeSlots() );
+
+        ASSERT_EQUALS( 1U, t.insert( 500 ) );
+        ASSERT_EQUALS( 3U, t.insert( 200 ) );
+        ASSERT_EQUALS( 4U, t.numSlots() );
+        ASSERT_EQUALS( 0U, t.numFreeSlots() );
+    }
+
+    TEST( RecordSlotTableTest, ReleaseKeepsProbeRuns ) {
+        // churning offsets keep the slots of the live records within bounds,
+        // and every live offset stays reachable
+        RecordSlotTable t;
+        for ( int i = 0; i < 10000; i++ )
+            t.insert( 8192 + i * 16 );
+        for ( int round = 1; round <= 10; round++ ) {
+            for ( int i = 0; i < 10000; i += 2 )
+                t.release( 8192 + ( round - 1 ) * 160000 + i * 16 );
+            for ( int i = 0; i < 10000; i += 2 )
+                t.insert( 8192 + round * 160000 + i * 16 );
+        }
+        ASSERT_EQUALS( 10000U, t.numSlots() );
+        for ( int i = 1; i < 10000; i += 2 )
+            ASSERT_EQUALS( static_cast<uint32_t>( i ), t.find( 8192 + i * 16 ) );
+        for ( int i = 0; i < 10000; i += 2 ) {
+            ASSERT( t.find( 8192 + 10 * 160000 + i * 16 ) < 10000U );
+            ASSERT_EQUALS( RecordSlotTable::NoSlot, t.find( 8192 + 9 * 160000 + i * 16 ) );
+        }
+    }
+
+}
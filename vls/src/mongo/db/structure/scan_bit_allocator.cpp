@@ -0,0 +1,153 @@
+// scan_bit_allocator.cpp
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/db/structure/scan_bit_allocator.h"
+
+#include "mongo/platform/bits.h"
+#include "mongo/util/assert_util.h"
+
+namespace mongo {
+
+    tbb::atomic<int> ScanBitAllocator::_totalHeld;
+    tbb::atomic<int> ScanBitAllocator::_totalWaiters;
+    tbb::atomic<uint64_t> ScanBitAllocator::_lastInstanceId;
+    tbb::atomic<uint64_t> ScanBitAllocator::_releases;
+    tbb::atomic<int> ScanBitAllocator::_releaseWaiters;
+    boost::mutex ScanBitAllocator::_releaseMutex;
+    boost::condition_variable ScanBitAllocator::_anyReleased;
+
+    ScanBitAllocator::ScanBitAllocator( int numBits )
+        : _numBits( numBits ),
+          _numWords( numBits / 64 ),
+          _instanceId( ++_lastInstanceId ),
+          _nextTicket( 0 ),
+          _servedTicket( 0 ) {
+        verify( numBits > 0 && numBits % 64 == 0 && numBits <= vls_mask::MaxBits );
+
+        // words beyond numBits are never handed out, so they stay free
+        for ( int w = 0; w < vls_mask::MaxWords; w++ )
+            _words[w] = 0xFFFFFFFFFFFFFFFFULL;
+        _waiters = 0;
+    }
+
+    int ScanBitAllocator::tryAcquire() {
+        for ( int w = 0; w < _numWords; w++ ) {
+            uint64_t free = _words[w];
+            while ( free != 0x0 ) {
+                // lowest free bit of the word
+                uint64_t bit = free & ( ~free + 1 );
+                uint64_t seen = _words[w].compare_and_swap( free & ~bit, free );
+                if ( seen == free ) {
+                    _totalHeld++;
+                    return w * 64 + firstBitSet( bit ) - 1;
+                }
+                free = seen;
+            }
+        }
+        return -1;
+    }
+
+    int ScanBitAllocator::acquire() {
+        // newcomers only bypass the queue when nobody is waiting
+        if ( _waiters == 0 ) {
+            int n = tryAcquire();
+            if ( n >= 0 )
+                return n;
+        }
+
+        boost::mutex::scoped_lock lk( _mutex );
+        uint64_t ticket = _nextTicket++;
+        _waiters++;
+        _totalWaiters++;
+
+        int n = -1;
+        while ( ticket != _servedTicket || ( n = tryAcquire() ) < 0 )
+            _released.wait( lk );
+
+        _servedTicket++;
+        _waiters--;
+        _totalWaiters--;
+
+        // the next scan in line may find another free bit
+        _released.notify_all();
+        return n;
+    }
+
+    void ScanBitAllocator::release( int n ) {
+        uint64_t bit = vls_mask::bitOf( n );
+        tbb::atomic<uint64_t>& word = _words[vls_mask::wordOf( n )];
+
+        uint64_t old = word;
+        for ( ;; ) {
+            uint64_t seen = word.compare_and_swap( old | bit, old );
+            if ( seen == old )
+                break;
+            old = seen;
+        }
+        _totalHeld--;
+
+        // the compare-and-swap above is a full fence, so either a scan that
+        // queued up sees the bit, or we see that scan
+        if ( _waiters > 0 ) {
+            boost::mutex::scoped_lock lk( _mutex );
+            _released.notify_all();
+        }
+
+        // same for the scans waiting without their database lock
+        _releases++;
+        if ( _releaseWaiters > 0 ) {
+            boost::mutex::scoped_lock lk( _releaseMutex );
+            _anyReleased.notify_all();
+        }
+    }
+
+    void ScanBitAllocator::waitForRelease( uint64_t releases ) {
+        boost::mutex::scoped_lock lk( _releaseMutex );
+        _releaseWaiters++;
+        _totalWaiters++;
+
+        // either release() sees the waiter, or the waiter sees the release;
+        // the timeout lets the caller find out that its database was dropped
+        // (the bits of a dropped database are never returned)
+        while ( _releases == releases )
+            _anyReleased.timed_wait( lk, boost::posix_time::milliseconds( 100 ) );
+
+        _releaseWaiters--;
+        _totalWaiters--;
+    }
+
+    vls_mask ScanBitAllocator::freeBits() const {
+        vls_mask mask;
+        for ( int w = 0; w < vls_mask::MaxWords; w++ )
+            mask.words[w] = _words[w];
+        return mask;
+    }
+
+}
@@ -0,0 +1,132 @@
+// scan_bit_allocator.h
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#pragma once
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/db/structure/vls_mask.h"
+#include "mongo/platform/cstdint.h"
+
+#include "tbb/atomic.h"
+
+namespace mongo {
+
+    /**
+     * Hands out the bits of the VLS masks to scans, i.e., keeps the active mask
+     * of a database: a bit is 1 while it is free and 0 while a scan holds it.
+     *
+     * Taking and returning a bit is a compare-and-swap on the word of the mask
+     * that holds it, so scans do not serialize on a lock. Only when every bit
+     * is taken do scans queue up on a mutex; they are then given bits in the
+     * order they arrived.
+     */
+    class ScanBitAllocator {
+        MONGO_DISALLOW_COPYING(ScanBitAllocator);
+    public:
+        /* numBits is a multiple of 64, up to vls_mask::MaxBits */
+        explicit ScanBitAllocator( int numBits );
+
+        /* Maximum number of scans that can hold a bit at the same time */
+        int numBits() const { return _numBits; }
+
+        /* Unique for the life of the server: a scan that outlives its database
+           (e.g., a cursor of a dropped database) tells by it whether the
+           database it finds under the same name is still the one it scans */
+        uint64_t instanceId() const { return _instanceId; }
+
+        /* Takes the lowest free bit. If every bit is taken, waits until
+           a bit is returned and the scans that came first got theirs.
+           Must not be called with a database lock held: the scans holding
+           the bits may need the lock to return them. */
+        int acquire();
+
+        /* Takes the lowest free bit without waiting; returns -1 if every
+           bit is taken. */
+        int tryAcquire();
+
+        /* Number of bits returned so far, over all the allocators of the
+           server; read before a tryAcquire() that fails, and passed to
+           waitForRelease() */
+        static uint64_t numReleases() { return _releases; }
+
+        /* Waits until a bit of any allocator is returned after numReleases()
+           was 'releases'. Unlike acquire(), it does not touch an allocator,
+           so it can be called after releasing the lock of its database,
+           which may be dropped meanwhile (see Collection::acquireScanBit()). */
+        static void waitForRelease( uint64_t releases );
+
+        /* Returns bit n, waking up the scans waiting for a bit, if any */
+        void release( int n );
+
+        /* Snapshot of the mask: free bits are 1, taken bits are 0. Bits beyond
+           numBits() are always 1. */
+        vls_mask freeBits() const;
+
+        /* True if no scan holds a bit */
+        bool allFree() const { return freeBits().all(); }
+
+        /* Number of scans waiting for a bit */
+        int numWaiters() const { return _waiters; }
+
+        /* Number of bits held and of scans waiting for a bit, over all the
+           allocators of the server (reported by serverStatus) */
+        static int totalHeld() { return _totalHeld; }
+        static int totalWaiters() { return _totalWaiters; }
+
+    private:
+        int _numBits;
+        int _numWords;
+        uint64_t _instanceId;
+        tbb::atomic<uint64_t> _words[vls_mask::MaxWords];
+
+        /* Scans queued in acquire(); read without the mutex by release() */
+        tbb::atomic<int> _waiters;
+
+        /* Wait queue for the saturated case: tickets are served in order */
+        boost::mutex _mutex;
+        boost::condition_variable _released;
+        uint64_t _nextTicket;
+        uint64_t _servedTicket;
+
+        static tbb::atomic<int> _totalHeld;
+        static tbb::atomic<int> _totalWaiters;
+        static tbb::atomic<uint64_t> _lastInstanceId;
+
+        /* Wait queue of waitForRelease(), shared by all the allocators */
+        static tbb::atomic<uint64_t> _releases;
+        static tbb::atomic<int> _releaseWaiters;
+        static boost::mutex _releaseMutex;
+        static boost::condition_variable _anyReleased;
+    };
+
+}
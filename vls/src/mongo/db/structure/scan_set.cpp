@@ -0,0 +1,77 @@
+// scan_set.cpp
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/db/structure/scan_set.h"
+
+#include <cstring>
+
+namespace mongo {
+
+    ScanSet::ScanSet() : _numBlocks( 0 ) { }
+
+    ScanSet::~ScanSet() {
+        for ( size_t a = 0; a < _volumes.size(); a++ )
+            for ( size_t b = 0; b < _volumes[a].size(); b++ )
+                delete[] _volumes[a][b];
+    }
+
+    void ScanSet::add( int a, uint32_t id ) {
+        if ( a >= (int)_volumes.size() )
+            _volumes.resize( a + 1 );
+
+        BlockVector& blocks = _volumes[a];
+        uint32_t b = id / BlockBits;
+        if ( b >= blocks.size() )
+            blocks.resize( b + 1, NULL );
+
+        if ( blocks[b] == NULL ) {
+            blocks[b] = new uint64_t[BlockWords];
+            memset( blocks[b], 0, BlockWords * sizeof(uint64_t) );
+            _numBlocks++;
+        }
+
+        uint32_t bit = id % BlockBits;
+        blocks[b][bit / 64] |= 1ULL << ( bit % 64 );
+    }
+
+    bool ScanSet::contains( int a, uint32_t id ) const {
+        if ( a >= (int)_volumes.size() )
+            return false;
+
+        const BlockVector& blocks = _volumes[a];
+        uint32_t b = id / BlockBits;
+        if ( b >= blocks.size() || blocks[b] == NULL )
+            return false;
+
+        uint32_t bit = id % BlockBits;
+        return ( blocks[b][bit / 64] >> ( bit % 64 ) ) & 1;
+    }
+
+}
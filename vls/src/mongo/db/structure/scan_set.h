@@ -0,0 +1,82 @@
+// scan_set.h
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/platform/cstdint.h"
+
+namespace mongo {
+
+    /**
+     * Scan set of a VLS index scan: the IDs of the records whose stable
+     * version the scan must read from the document set, because they were
+     * updated or removed before the scan reached them.
+     *
+     * Those records are few compared to the collection, so the set is a
+     * bitmap split in blocks of BlockBits IDs per DiskLoc Volume, and a block
+     * is only allocated once one of its records is added. A scan set belongs
+     * to a single scan and is not synchronized.
+     */
+    class ScanSet {
+        MONGO_DISALLOW_COPYING(ScanSet);
+    public:
+        /* IDs per block (1KB of bits) */
+        static const uint32_t BlockBits = 8192;
+
+        ScanSet();
+        ~ScanSet();
+
+        /* Adds record id of DiskLoc Volume a */
+        void add( int a, uint32_t id );
+
+        /* Returns true if record id of DiskLoc Volume a was added */
+        bool contains( int a, uint32_t id ) const;
+
+        /* Number of blocks allocated */
+        size_t numBlocks() const { return _numBlocks; }
+
+        /* Bytes used by the blocks */
+        size_t memUsage() const { return _numBlocks * BlockBits / 8; }
+
+    private:
+        static const uint32_t BlockWords = BlockBits / 64;
+
+        /* Blocks of one DiskLoc Volume; NULL until a record is added */
+        typedef std::vector<uint64_t*> BlockVector;
+
+        std::vector<BlockVector> _volumes;
+        size_t _numBlocks;
+    };
+
+}
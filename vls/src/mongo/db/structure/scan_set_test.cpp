@@ -0,0 +1,75 @@
+// scan_set_test.cpp
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/unittest/unittest.h"
+
+#include "mongo/db/structure/scan_set.h"
+
+namespace mongo {
+
+    TEST( ScanSetTest, Empty ) {
+        ScanSet s;
+        ASSERT_FALSE( s.contains( 0, 0 ) );
+        ASSERT_FALSE( s.contains( 3, 100000 ) );
+        ASSERT_EQUALS( 0U, s.numBlocks() );
+    }
+
+    TEST( ScanSetTest, AddAndContains ) {
+        ScanSet s;
+        s.add( 0, 0 );
+        s.add( 0, 63 );
+        s.add( 0, 64 );
+        s.add( 2, 12345 );
+
+        ASSERT( s.contains( 0, 0 ) );
+        ASSERT( s.contains( 0, 63 ) );
+        ASSERT( s.contains( 0, 64 ) );
+        ASSERT( s.contains( 2, 12345 ) );
+        ASSERT_FALSE( s.contains( 0, 1 ) );
+        ASSERT_FALSE( s.contains( 1, 0 ) );
+        ASSERT_FALSE( s.contains( 2, 12344 ) );
+        ASSERT_FALSE( s.contains( 2, 0 ) );
+    }
+
+    TEST( ScanSetTest, BlocksAreAllocatedLazily ) {
+        // a few records far apart in a volume of 100M records only
+        // take one block each
+        ScanSet s;
+        s.add( 0, 5 );
+        s.add( 0, 50000000 );
+        s.add( 0, 99999999 );
+        s.add( 0, 99999998 );
+        ASSERT_EQUALS( 3U, s.numBlocks() );
+        ASSERT_EQUALS( 3U * ScanSet::BlockBits / 8, s.memUsage() );
+        ASSERT( s.contains( 0, 50000000 ) );
+        ASSERT_FALSE( s.contains( 0, 50000001 ) );
+    }
+
+}
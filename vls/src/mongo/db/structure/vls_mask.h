@@ -0,0 +1,158 @@
+// vls_mask.h
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#pragma once
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "mongo/platform/bits.h"
+#include "mongo/platform/cstdint.h"
+
+namespace mongo {
+
+    /**
+     * A VLS mask: the active, stable and queue status masks keep one bit per
+     * concurrent VLS scan. A mask is up to MaxWords 64-bit words wide; how many
+     * words are actually handed out to scans is selected at startup through the
+     * 'vlsMaskBits' server parameter (see vlsMaskWords()).
+     *
+     * Operations always process all MaxWords words, with constant trip counts,
+     * so that they compile to straight-line (vectorized) code. Bits beyond the
+     * selected width are never assigned to a scan, and therefore keep the value
+     * they have when no scan is active (1 in active masks, 0 in stable masks).
+     */
+    struct vls_mask {
+        /* Maximum width of a mask, in 64-bit words */
+        static const int MaxWords = 4;
+
+        /* Maximum width of a mask, in bits */
+        static const int MaxBits = MaxWords * 64;
+
+        uint64_t words[MaxWords];
+
+        vls_mask() { fill( 0x0 ); }
+
+        /* Mask with every word set to value */
+        explicit vls_mask( uint64_t value ) { fill( value ); }
+
+        /* Word and bit of the mask that belong to scan n */
+        static int wordOf( int n ) { return n >> 6; }
+        static uint64_t bitOf( int n ) { return 0x1ULL << ( n & 63 ); }
+
+        void fill( uint64_t value ) {
+            for ( int i = 0; i < MaxWords; i++ )
+                words[i] = value;
+        }
+
+        bool test( int n ) const { return ( words[wordOf( n )] & bitOf( n ) ) != 0x0; }
+        vls_mask& set( int n ) { words[wordOf( n )] |= bitOf( n ); return *this; }
+        vls_mask& reset( int n ) { words[wordOf( n )] &= ~bitOf( n ); return *this; }
+        vls_mask& flip( int n ) { words[wordOf( n )] ^= bitOf( n ); return *this; }
+
+        /* True if every bit is 1, e.g., an active mask with no active scan,
+           or a queue status mask read by every scan */
+        bool all() const {
+            uint64_t r = 0xFFFFFFFFFFFFFFFFULL;
+            for ( int i = 0; i < MaxWords; i++ )
+                r &= words[i];
+            return r == 0xFFFFFFFFFFFFFFFFULL;
+        }
+
+        /* True if every bit is 0 */
+        bool none() const {
+            uint64_t r = 0x0;
+            for ( int i = 0; i < MaxWords; i++ )
+                r |= words[i];
+            return r == 0x0;
+        }
+
+        /* Returns the lowest bit set among the first nbits bits, or -1 */
+        int findFirstSet( int nbits ) const {
+            for ( int i = 0; i < MaxWords && i * 64 < nbits; i++ ) {
+                if ( words[i] == 0x0 )
+                    continue;
+                int n = i * 64 + firstBitSet( words[i] ) - 1;
+                return n < nbits ? n : -1;
+            }
+            return -1;
+        }
+
+        vls_mask operator~() const {
+            vls_mask r;
+            for ( int i = 0; i < MaxWords; i++ )
+                r.words[i] = ~words[i];
+            return r;
+        }
+
+        vls_mask& operator&=( const vls_mask& m ) {
+            for ( int i = 0; i < MaxWords; i++ )
+                words[i] &= m.words[i];
+            return *this;
+        }
+
+        vls_mask& operator|=( const vls_mask& m ) {
+            for ( int i = 0; i < MaxWords; i++ )
+                words[i] |= m.words[i];
+            return *this;
+        }
+
+        vls_mask& operator^=( const vls_mask& m ) {
+            for ( int i = 0; i < MaxWords; i++ )
+                words[i] ^= m.words[i];
+            return *this;
+        }
+
+        vls_mask operator&( const vls_mask& m ) const { vls_mask r( *this ); return r &= m; }
+        vls_mask operator|( const vls_mask& m ) const { vls_mask r( *this ); return r |= m; }
+        vls_mask operator^( const vls_mask& m ) const { vls_mask r( *this ); return r ^= m; }
+
+        bool operator==( const vls_mask& m ) const {
+            uint64_t r = 0x0;
+            for ( int i = 0; i < MaxWords; i++ )
+                r |= words[i] ^ m.words[i];
+            return r == 0x0;
+        }
+
+        bool operator!=( const vls_mask& m ) const { return !( *this == m ); }
+
+        /* Words of the mask in hex, most significant first */
+        std::string toString() const {
+            std::stringstream ss;
+            ss << std::hex << std::setfill( '0' );
+            for ( int i = MaxWords - 1; i >= 0; i-- )
+                ss << std::setw( 16 ) << words[i];
+            return ss.str();
+        }
+    };
+
+}
@@ -0,0 +1,96 @@
+// vls_mask_test.cpp
+
+/**
+*    Copyright (C) 2016, New York University
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/unittest/unittest.h"
+
+#include "mongo/db/structure/vls_mask.h"
+
+namespace mongo {
+
+    TEST( VLSMaskTest, Fill ) {
+        ASSERT( vls_mask().none() );
+        ASSERT( !vls_mask().all() );
+        ASSERT( vls_mask( 0xFFFFFFFFFFFFFFFFULL ).all() );
+        ASSERT( !vls_mask( 0xFFFFFFFFFFFFFFFFULL ).none() );
+    }
+
+    TEST( VLSMaskTest, BitsAcrossWords ) {
+        vls_mask m;
+        m.set( 0 ).set( 63 ).set( 64 ).set( vls_mask::MaxBits - 1 );
+        ASSERT_EQUALS( 0x8000000000000001ULL, m.words[0] );
+        ASSERT_EQUALS( 0x1ULL, m.words[1] );
+        ASSERT_EQUALS( 0x0ULL, m.words[2] );
+        ASSERT_EQUALS( 0x8000000000000000ULL, m.words[3] );
+        ASSERT( m.test( 64 ) );
+        ASSERT( !m.test( 65 ) );
+
+        m.reset( 64 ).flip( 65 );
+        ASSERT( !m.test( 64 ) );
+        ASSERT( m.test( 65 ) );
+        ASSERT_EQUALS( 1, vls_mask::wordOf( 65 ) );
+        ASSERT_EQUALS( 0x2ULL, vls_mask::bitOf( 65 ) );
+    }
+
+    TEST( VLSMaskTest, FindFirstSet ) {
+        vls_mask m;
+        ASSERT_EQUALS( -1, m.findFirstSet( 64 ) );
+
+        m.set( 70 );
+        ASSERT_EQUALS( -1, m.findFirstSet( 64 ) );
+        ASSERT_EQUALS( -1, m.findFirstSet( 70 ) );
+        ASSERT_EQUALS( 70, m.findFirstSet( 128 ) );
+
+        m.set( 3 );
+        ASSERT_EQUALS( 3, m.findFirstSet( 64 ) );
+    }
+
+    TEST( VLSMaskTest, StatusMasks ) {
+        // a scan on bit 100 has started: the status mask of an untouched
+        // record is the stable mask, and an update preserves the old version
+        vls_mask stableMask;
+        vls_mask localActiveMask( 0xFFFFFFFFFFFFFFFFULL );
+        localActiveMask.reset( 100 );
+
+        vls_mask statusMask = ~( stableMask ^ vls_mask( 0xFFFFFFFFFFFFFFFFULL ) );
+        vls_mask queueStatusMask = ( stableMask ^ statusMask ) | localActiveMask;
+        ASSERT( !queueStatusMask.all() );
+        ASSERT( !queueStatusMask.test( 100 ) );
+
+        // once the scan reads the version, nobody else needs it
+        queueStatusMask.set( 100 );
+        ASSERT( queueStatusMask.all() );
+
+        // after the scan, the stable mask is flipped for its bit
+        stableMask.flip( 100 );
+        localActiveMask.set( 100 );
+        ASSERT( ( ~( stableMask ^ localActiveMask ) ) == stableMask );
+    }
+
+}
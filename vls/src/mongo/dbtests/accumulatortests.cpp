@@ -838,6 +838,109 @@ namespace AccumulatorTests {
         
     } // namespace Sum
 
+    namespace Batch {
+
+        /** Accumulators given NumericBatches return the same values as given each input. */
+        class Base : public AccumulatorTests::Base {
+        public:
+            virtual ~Base() {
+            }
+            void run() {
+                checkInputs(ints());
+                checkInputs(longOverflow());
+                checkInputs(mixed());
+            }
+        protected:
+            virtual intrusive_ptr<Accumulator> create() = 0;
+        private:
+            /** Small ints, in full batches: the vectorized kernels. */
+            vector<Value> ints() {
+                vector<Value> inputs;
+                for (int i = 0; i < 3000; ++i) {
+                    inputs.push_back(Value(i % 2 ? -i : i * 3));
+                }
+                return inputs;
+            }
+            /** Longs whose sum overflows, and whose double total rounds. */
+            vector<Value> longOverflow() {
+                vector<Value> inputs;
+                for (int i = 0; i < 1500; ++i) {
+                    inputs.push_back(Value(numeric_limits<long long>::max() - i));
+                    inputs.push_back(Value(i));
+                }
+                return inputs;
+            }
+            /** Ints, longs, doubles, NaN, and nullish values. */
+            vector<Value> mixed() {
+                vector<Value> inputs;
+                for (int i = 0; i < 3000; ++i) {
+                    switch (i % 6) {
+                    case 0: inputs.push_back(Value(i)); break;
+                    case 1: inputs.push_back(Value(static_cast<long long>(i) << 40)); break;
+                    case 2: inputs.push_back(Value(i / 7.0)); break;
+                    case 3: inputs.push_back(Value(BSONNULL)); break;
+                    case 4: inputs.push_back(Value()); break;
+                    default:
+                        inputs.push_back(i == 2999 ? Value(numeric_limits<double>::quiet_NaN())
+                                                   : Value(static_cast<double>(i)));
+                        break;
+                    }
+                }
+                return inputs;
+            }
+            void checkInputs(const vector<Value>& inputs) {
+                intrusive_ptr<Accumulator> expected = create();
+                intrusive_ptr<Accumulator> batched = create();
+                ASSERT(batched->canProcessBatch());
+
+                NumericBatch batch;
+                for (size_t i = 0; i < inputs.size(); ++i) {
+                    expected->process(inputs[i], false);
+                    ASSERT(batch.append(inputs[i]));
+                    if (batch.full() || i % 1500 == 7) {
+                        batched->processBatch(batch);
+                        batch.clear();
+                    }
+                }
+                batched->processBatch(batch);
+
+                assertBinaryEqual(fromValue(expected->getValue(false)),
+                                  fromValue(batched->getValue(false)));
+                assertBinaryEqual(fromValue(expected->getValue(true)),
+                                  fromValue(batched->getValue(true)));
+            }
+        };
+
+        class Sum : public Base {
+            intrusive_ptr<Accumulator> create() { return AccumulatorSum::create(); }
+        };
+
+        class Avg : public Base {
+            intrusive_ptr<Accumulator> create() { return AccumulatorAvg::create(); }
+        };
+
+        class Min : public Base {
+            intrusive_ptr<Accumulator> create() { return AccumulatorMinMax::createMin(); }
+        };
+
+        class Max : public Base {
+            intrusive_ptr<Accumulator> create() { return AccumulatorMinMax::createMax(); }
+        };
+
+        /** Other types are not batched. */
+        class NonNumeric : public AccumulatorTests::Base {
+        public:
+            void run() {
+                NumericBatch batch;
+                ASSERT(!batch.append(Value("a")));
+                ASSERT(!batch.append(Value(true)));
+                ASSERT(batch.empty());
+                ASSERT(!AccumulatorPush::create()->canProcessBatch());
+            }
+        };
+
+    } // namespace Batch
+
     class All : public Suite {
     public:
         All() : Suite( "accumulator" ) {
@@ -914,6 +1017,12 @@ namespace AccumulatorTests {
             add<Sum::IntNull>();
             add<Sum::IntUndefined>();
             add<Sum::NoOverflowBeforeDouble>();
+
+            add<Batch::Sum>();
+            add<Batch::Avg>();
+            add<Batch::Min>();
+            add<Batch::Max>();
+            add<Batch::NonNumeric>();
         }
     } myall;
 
@@ -35,9 +35,12 @@
 #include "mongo/db/interrupt_status_mongod.h"
 #include "mongo/db/pipeline/document_source.h"
 #include "mongo/db/pipeline/expression_context.h"
+#include "mongo/db/pipeline/pipeline_d.h"
 #include "mongo/db/query/get_runner.h"
 #include "mongo/db/storage_options.h"
+#include "mongo/db/structure/scan_bit_allocator.h"
 #include "mongo/dbtests/dbtests.h"
+#include "mongo/util/fail_point_service.h"
 
 namespace DocumentSourceTests {
 
@@ -1873,6 +1876,163 @@ namespace DocumentSourceTests {
         };
     } // namespace DocumentSourceMatch
 
+    namespace DocumentSourceVLSParallelScan {
+
+        class Base : public CollectionBase {
+        protected:
+            void createCollection() {
+                BSONObj info;
+                ASSERT(client.runCommand("unittests",
+                                         BSON("create" << "documentsourcetests"
+                                              << "vls" << true
+                                              << "$nExtents" << BSON_ARRAY(8192 << 8192 << 8192)),
+                                         info));
+                for (int i = 0; i < 1000; ++i) {
+                    client.insert(ns, BSON("_id" << i << "a" << i % 7 << "b" << i));
+                }
+            }
+            BSONObj aggregate(const BSONObj& pipeline, bool parallel) {
+                vlsParallelScan = parallel;
+                BSONObj result;
+                bool ok = client.runCommand("unittests",
+                                            BSON("aggregate" << "documentsourcetests"
+                                                 << "pipeline" << pipeline),
+                                            result);
+                vlsParallelScan = false;
+                ASSERT(ok);
+                return result["result"].Obj().getOwned();
+            }
+        };
+
+        /** A parallel VLS scan groups the documents of all the extents as a sequential scan. */
+        class MatchesSequentialScan : public Base {
+        public:
+            void run() {
+                createCollection();
+
+                BSONObj pipeline = BSON_ARRAY(
+                    BSON("$match" << BSON("b" << BSON("$gte" << 100)))
+                    << BSON("$project" << BSON("a" << 1 << "b" << 1))
+                    << BSON("$group" << BSON("_id" << "$a"
+                                             << "sum" << BSON("$sum" << "$b")
+                                             << "avg" << BSON("$avg" << "$b")
+                                             << "first" << BSON("$first" << "$b")
+                                             << "last" << BSON("$last" << "$b")))
+                    << BSON("$sort" << BSON("_id" << 1)));
+
+                BSONObj sequential = aggregate(pipeline, false);
+                BSONObj parallel = aggregate(pipeline, true);
+                ASSERT_EQUALS(7, sequential.nFields());
+                ASSERT_EQUALS(sequential, parallel);
+            }
+        };
+
+        /** An update of a field only read by the query does not change what the scan reads. */
+        class PreservesQueryFields : public Base {
+        public:
+            void run() {
+                createCollection();
+
+                // the $group does not read b
+                BSONObj pipeline = BSON_ARRAY(
+                    BSON("$match" << BSON("b" << BSON("$gte" << 100)))
+                    << BSON("$group" << BSON("_id" << "$a" << "n" << BSON("$sum" << 1)))
+                    << BSON("$sort" << BSON("_id" << 1)));
+                BSONObj expected = aggregate(pipeline, false);
+
+                FailPoint* hang =
+                    getGlobalFailPointRegistry()->getFailPoint("vlsParallelScanHangAfterStart");
+                const int held = ScanBitAllocator::totalHeld();
+                hang->setMode(FailPoint::alwaysOn);
+                vlsParallelScan = true;
+                boost::thread scan(boost::bind(&PreservesQueryFields::runScan, this, pipeline));
+
+                // the scan took its bit and waits before reading any record
+                while (ScanBitAllocator::totalHeld() == held) {
+                    sleepmillis(1);
+                }
+                client.update(ns, BSONObj(), BSON("$set" << BSON("b" << 0)), false, true);
+
+                hang->setMode(FailPoint::off);
+                scan.join();
+                vlsParallelScan = false;
+
+                ASSERT(_ok);
+                ASSERT_EQUALS(expected, _result["result"].Obj());
+                ASSERT_EQUALS(BSONObj(), aggregate(pipeline, true));
+            }
+        private:
+            void runScan(const BSONObj& pipeline) {
+                Client::initThread("vls parallel scan");
+                DBDirectClient scanClient;
+                _ok = scanClient.runCommand("unittests",
+                                            BSON("aggregate" << "documentsourcetests"
+                                                 << "pipeline" << pipeline),
+                                            _result);
+                _result = _result.getOwned();
+                cc().shutdown();
+            }
+            bool _ok;
+            BSONObj _result;
+        };
+
+    } // namespace DocumentSourceVLSParallelScan
+
+    namespace GroupScan {
+
+        /** A $group run in the collection scan returns the documents of DocumentSourceGroup. */
+        class MatchesDocumentSourceGroup : public CollectionBase {
+        public:
+            void run() {
+                for (int i = 0; i < 1000; ++i) {
+                    if (i % 10 == 0) {
+                        client.insert(ns, BSON("_id" << i << "b" << i));
+                    }
+                    else {
+                        client.insert(ns, BSON("_id" << i << "a" << i % 7 << "b" << i));
+                    }
+                }
+
+                // as the YCSB aggregate: both fields of the $project are constants
+                BSONObj constantKey = BSON_ARRAY(
+                    BSON("$project" << BSON("key" << BSON("$add" << BSON_ARRAY(0))
+                                            << "val" << BSON("$add" << BSON_ARRAY(1))))
+                    << BSON("$group" << BSON("_id" << "$key"
+                                             << "count" << BSON("$sum" << "$val"))));
+                BSONObj fused = aggregate(constantKey, true);
+                ASSERT_EQUALS(fused, aggregate(constantKey, false));
+                ASSERT_EQUALS(BSON("0" << BSON("_id" << 0 << "count" << 1000)), fused);
+
+                BSONObj fieldKey = BSON_ARRAY(
+                    BSON("$match" << BSON("b" << BSON("$gte" << 100)))
+                    << BSON("$project" << BSON("_id" << 0 << "a" << 1 << "c" << "$b"))
+                    << BSON("$group" << BSON("_id" << "$a"
+                                             << "sum" << BSON("$sum" << "$c")
+                                             << "avg" << BSON("$avg" << "$c")
+                                             << "first" << BSON("$first" << "$c")
+                                             << "min" << BSON("$min" << "$a")
+                                             << "n" << BSON("$sum" << 1)))
+                    << BSON("$sort" << BSON("_id" << 1)));
+                fused = aggregate(fieldKey, true);
+                ASSERT_EQUALS(8, fused.nFields());
+                ASSERT_EQUALS(fused, aggregate(fieldKey, false));
+            }
+        private:
+            BSONObj aggregate(const BSONObj& pipeline, bool groupScan) {
+                aggregateGroupScan = groupScan;
+                BSONObj result;
+                bool ok = client.runCommand("unittests",
+                                            BSON("aggregate" << "documentsourcetests"
+                                                 << "pipeline" << pipeline),
+                                            result);
+                aggregateGroupScan = true;
+                ASSERT(ok);
+                return result["result"].Obj().getOwned();
+            }
+        };
+
+    } // namespace GroupScan
+
     class All : public Suite {
     public:
         All() : Suite( "documentsource" ) {
@@ -1979,6 +2139,10 @@ namespace DocumentSourceTests {
 
             add<DocumentSourceMatch::RedactSafePortion>();
             add<DocumentSourceMatch::Coalesce>();
+
+            add<DocumentSourceVLSParallelScan::MatchesSequentialScan>();
+            add<DocumentSourceVLSParallelScan::PreservesQueryFields>();
+            add<GroupScan::MatchesDocumentSourceGroup>();
         }
     } myall;
 
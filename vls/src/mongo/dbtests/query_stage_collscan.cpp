@@ -38,7 +38,9 @@
 #include "mongo/db/matcher/expression_parser.h"
 #include "mongo/db/pdfile.h"
 #include "mongo/db/query/plan_executor.h"
+#include "mongo/db/structure/collection.h"
 #include "mongo/dbtests/dbtests.h"
+#include "mongo/util/processinfo.h"
 
 namespace QueryStageCollectionScan {
 
@@ -590,6 +592,201 @@ namespace QueryStageCollectionScan {
         }
     };
 
+    // --------- VLS --------- //
+
+    //
+    // A VLS scan that skips the records updated while it runs, and reads their stable
+    // versions from the document set instead, must not grow the heap as it goes.
+    //
+    class QueryStageCollscanVLSSkipsWithoutAllocating {
+    public:
+        QueryStageCollscanVLSSkipsWithoutAllocating() { }
+
+        virtual ~QueryStageCollscanVLSSkipsWithoutAllocating() {
+            Client::WriteContext ctx(ns());
+            Collection* collection = ctx.ctx().db()->getCollection(ns());
+            if (NULL != collection) {
+                collection->setVLSEnabled(false);
+            }
+            _client.dropCollection(ns());
+        }
+
+        void run() {
+            Client::WriteContext ctx(ns());
+
+            for (int i = 0; i < numObj(); ++i) {
+                _client.insert(ns(), BSON("foo" << i));
+            }
+            Collection* collection = ctx.ctx().db()->getCollection(ns());
+            ASSERT(NULL != collection);
+            ASSERT_OK(collection->setVLSEnabled(true));
+
+            CollectionScanParams params;
+            params.ns = ns();
+            params.direction = CollectionScanParams::FORWARD;
+            params.tailable = false;
+
+            WorkingSet ws;
+            scoped_ptr<CollectionScan> scan(new CollectionScan(params, &ws, NULL, true));
+
+            // Read the first document, so that the scan holds its bit.
+            int count = 0;
+            long long total = 0;
+            while (0 == count) {
+                WorkingSetID id;
+                PlanStage::StageState state = scan->work(&id);
+                ASSERT_NOT_EQUALS(PlanStage::IS_EOF, state);
+                if (PlanStage::ADVANCED == state) {
+                    total += ws.get(id)->obj["foo"].numberInt();
+                    ws.free(id);
+                    ++count;
+                }
+            }
+
+            // Every record the scan has not read yet changes under it: it has to skip them and read
+            // their stable versions from the document set.
+            _client.update(ns(), BSONObj(), BSON("$inc" << BSON("foo" << numObj())),
+                           false, true);
+
+            long long heapBefore = heapUsage();
+            while (!scan->isEOF()) {
+                WorkingSetID id;
+                PlanStage::StageState state = scan->work(&id);
+                if (PlanStage::ADVANCED == state) {
+                    total += ws.get(id)->obj["foo"].numberInt();
+                    ws.free(id);
+                    ++count;
+                }
+            }
+            long long heapAfter = heapUsage();
+
+            // The scan saw the collection as of when it started.
+            ASSERT_EQUALS(numObj(), count);
+            ASSERT_EQUALS(static_cast<long long>(numObj()) * (numObj() - 1) / 2, total);
+
+            scoped_ptr<PlanStageStats> stats(scan->getStats());
+            CollectionScanStats* csStats =
+                static_cast<CollectionScanStats*>(stats->specific.get());
+            ASSERT_EQUALS(static_cast<uint64_t>(numObj() - 1), csStats->docsSkipped);
+            ASSERT_EQUALS(static_cast<uint64_t>(numObj() - 1), csStats->docsFromRemset);
+
+            // Allocating anything per skipped record would take at least this much.
+            if (heapBefore >= 0 && heapAfter >= 0) {
+                ASSERT_LESS_THAN(heapAfter - heapBefore,
+                                 static_cast<long long>(csStats->docsSkipped * sizeof(DiskLoc)));
+            }
+        }
+
+    private:
+        // Bytes in use on the heap, or -1 if the platform does not report it.
+        static long long heapUsage() {
+            BSONObjBuilder b;
+            ProcessInfo().getExtraInfo(b);
+            BSONObj info = b.obj();
+            return info.hasField("heap_usage_bytes") ?
+                info["heap_usage_bytes"].numberLong() : -1;
+        }
+
+        static int numObj() { return 10000; }
+
+        static const char* ns() { return "unittests.QueryStageCollectionScanVLS"; }
+
+        static DBDirectClient _client;
+    };
+
+    DBDirectClient QueryStageCollscanVLSSkipsWithoutAllocating::_client;
+
+    //
+    // With vlsSharedScans, a VLS scan that starts while another one runs starts at the extent
+    // the other one is reading, and wraps around to read the same snapshot as a scan from the
+    // first extent.
+    //
+    class QueryStageCollscanVLSSharedScan {
+    public:
+        QueryStageCollscanVLSSharedScan() { }
+
+        virtual ~QueryStageCollscanVLSSharedScan() {
+            vlsSharedScans = false;
+            Client::WriteContext ctx(ns());
+            Collection* collection = ctx.ctx().db()->getCollection(ns());
+            if (NULL != collection) {
+                collection->setVLSEnabled(false);
+            }
+            _client.dropCollection(ns());
+        }
+
+        void run() {
+            Client::WriteContext ctx(ns());
+
+            // Big enough documents to fill several extents.
+            const string pad(100, 'x');
+            for (int i = 0; i < numObj(); ++i) {
+                _client.insert(ns(), BSON("foo" << i << "pad" << pad));
+            }
+            Collection* collection = ctx.ctx().db()->getCollection(ns());
+            ASSERT(NULL != collection);
+            ASSERT_OK(collection->setVLSEnabled(true));
+            vlsSharedScans = true;
+
+            CollectionScanParams params;
+            params.ns = ns();
+            params.direction = CollectionScanParams::FORWARD;
+            params.tailable = false;
+
+            WorkingSet ws;
+            scoped_ptr<CollectionScan> first(new CollectionScan(params, &ws, NULL, true));
+            int firstCount = 0;
+            long long firstTotal = 0;
+            while (firstCount < numObj() / 2) {
+                ASSERT(work(first.get(), &ws, &firstCount, &firstTotal));
+            }
+
+            // The second scan joins the first one mid-way.
+            scoped_ptr<CollectionScan> second(new CollectionScan(params, &ws, NULL, true));
+            int secondCount = 0;
+            long long secondTotal = 0;
+            while (0 == secondCount) {
+                ASSERT(work(second.get(), &ws, &secondCount, &secondTotal));
+            }
+            ASSERT_NOT_EQUALS(0, secondTotal);
+
+            // Both scans see the collection as of when they started.
+            _client.update(ns(), BSONObj(), BSON("$inc" << BSON("foo" << numObj())),
+                           false, true);
+            while (work(first.get(), &ws, &firstCount, &firstTotal)) { }
+            while (work(second.get(), &ws, &secondCount, &secondTotal)) { }
+
+            const long long expectedTotal = static_cast<long long>(numObj()) * (numObj() - 1) / 2;
+            ASSERT_EQUALS(numObj(), firstCount);
+            ASSERT_EQUALS(expectedTotal, firstTotal);
+            ASSERT_EQUALS(numObj(), secondCount);
+            ASSERT_EQUALS(expectedTotal, secondTotal);
+        }
+
+    private:
+        // Works the scan once, counting the document it returns; false at EOF.
+        static bool work(CollectionScan* scan, WorkingSet* ws, int* count, long long* total) {
+            WorkingSetID id;
+            PlanStage::StageState state = scan->work(&id);
+            if (PlanStage::ADVANCED == state) {
+                *total += ws->get(id)->obj["foo"].numberInt();
+                ws->free(id);
+                ++*count;
+            }
+            return PlanStage::IS_EOF != state;
+        }
+
+        static int numObj() { return 10000; }
+
+        static const char* ns() { return "unittests.QueryStageCollectionScanVLSShared"; }
+
+        static DBDirectClient _client;
+    };
+
+    DBDirectClient QueryStageCollscanVLSSharedScan::_client;
+
+    // --------- VLS --------- //
+
     class All : public Suite {
     public:
         All() : Suite( "QueryStageCollectionScan" ) {}
@@ -618,6 +815,8 @@ namespace QueryStageCollectionScan {
             add<QueryStageCollscanObjectsInOrderBackward>();
             add<QueryStageCollscanInvalidateUpcomingObject>();
             add<QueryStageCollscanInvalidateUpcomingObjectBackward>();
+            add<QueryStageCollscanVLSSkipsWithoutAllocating>();
+            add<QueryStageCollscanVLSSharedScan>();
         }
     } all;
 
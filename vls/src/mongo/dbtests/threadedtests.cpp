@@ -36,6 +36,7 @@
 
 #include "mongo/bson/util/atomic_int.h"
 #include "mongo/db/d_concurrency.h"
+#include "mongo/db/structure/scan_bit_allocator.h"
 #include "mongo/dbtests/dbtests.h"
 #include "mongo/platform/atomic_word.h"
 #include "mongo/util/concurrency/mvar.h"
@@ -981,6 +982,47 @@ namespace ThreadedTests {
 
     };
 
+    /**
+     * Throughput of taking and returning VLS scan bits with as many scanners
+     * as there are bits, so the wait queue is only used by chance, and with
+     * more scanners than bits, so it is used all the time. Also checks that a
+     * bit is never held by two scanners at once.
+     */
+    template <int nscanners>
+    class ScanBitAllocatorThroughput : public ThreadedTest<nscanners> {
+        static const int bits = 64;
+        static const int millis = 1000;
+    public:
+        ScanBitAllocatorThroughput() : _allocator( bits ) {}
+    private:
+        ScanBitAllocator _allocator;
+        AtomicUInt32 _holders[bits];
+        AtomicUInt64 _ops;
+        AtomicUInt32 _overlaps;
+
+        virtual void subthread(int x) {
+            Timer t;
+            unsigned long long ops = 0;
+            while ( t.millis() < millis ) {
+                int n = _allocator.acquire();
+                if ( _holders[n].fetchAndAdd( 1 ) != 0 )
+                    _overlaps.fetchAndAdd( 1 );
+                _holders[n].fetchAndSubtract( 1 );
+                _allocator.release( n );
+                ops++;
+            }
+            _ops.fetchAndAdd( ops );
+        }
+
+        virtual void validate() {
+            ASSERT_EQUALS( 0U, _overlaps.load() );
+            ASSERT( _allocator.allFree() );
+            ASSERT_EQUALS( 0, _allocator.numWaiters() );
+            cout << "ScanBitAllocator " << nscanners << " scanners, " << bits << " bits: "
+                 << ( _ops.load() * 1000 / millis ) << " acquire/release per second" << endl;
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "threading" ) { }
@@ -1017,6 +1059,8 @@ namespace ThreadedTests {
 
             add< MongoMutexTest >();
             add< TicketHolderWaits >();
+            add< ScanBitAllocatorThroughput<64> >();
+            add< ScanBitAllocatorThroughput<80> >();
         }
     } myall;
 }
@@ -732,6 +732,10 @@ namespace mongo {
                     countCmdBuilder.append(cmdObj[LiteParsedQuery::cmdOptionMaxTimeMS]);
                 }
 
+                if (cmdObj.hasField(LiteParsedQuery::cmdOptionSnapshot)) {
+                    countCmdBuilder.append(cmdObj[LiteParsedQuery::cmdOptionSnapshot]);
+                }
+
                 vector<Strategy::CommandResult> countResult;
 
                 SHARDED->commandOp( dbName, countCmdBuilder.done(),
@@ -1423,7 +1427,8 @@ namespace mongo {
                             fn == "scope" ||
                             fn == "verbose" ||
                             fn == "$queryOptions" ||
-                            fn == LiteParsedQuery::cmdOptionMaxTimeMS) {
+                            fn == LiteParsedQuery::cmdOptionMaxTimeMS ||
+                            fn == LiteParsedQuery::cmdOptionSnapshot) {
                         b.append( e );
                     }
                     else if ( fn == "out" ||